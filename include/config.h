@@ -39,15 +39,20 @@
 //LIDAR top
 #define LIDAR_TOP_SDA 13
 #define LIDAR_TOP_SCL 14
+#define LIDAR_TOP_INT -1      // GPIO1 data ready; -1 when not wired, polled on a timer
 
 //LIDAR bottom
 #define LIDAR_BOTTOM_SDA 39
 #define LIDAR_BOTTOM_SCL 12
+#define LIDAR_BOTTOM_INT -1
 
 
 //Force Sensor
 #define FORCE_SENSOR_LEFT_PIN   11
 #define FORCE_SENSOR_RIGHT_PIN  07
+#define FORCE_SAMPLE_RATE_HZ    2000  // per pin, 1000..10000
+#define FORCE_DECIMATION        4     // conversions averaged per value
+#define FORCE_WINDOW_MS         10    // span of the read_average window
 
 
 
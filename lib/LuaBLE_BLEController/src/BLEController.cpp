@@ -11,6 +11,7 @@ extern "C" {
 #endif
 #include "BLEController.h"
 #include <Arduino.h>
+#include "esp_timer.h"
 
 BLEController bleController;
 
@@ -22,17 +23,59 @@ public:
 
      void onConnect(BLEServer *pServer, NimBLEConnInfo& connInfo)
     {
+        controller.connectedCount++;
         controller.deviceConnected = true;
+        controller.enqueueRx(RX_EVENT_CONNECT, connInfo.getConnHandle(), std::string());
+        controller.resetTxCredits();
+        controller.onLinkConnected(connInfo.getConnHandle());
+        // Advertising stops on connect; keep it up for the next viewer
+        if (controller.connectedCount < BLE_MAX_SESSIONS)
+        {
+            controller.startAdvertising();
+        }
         if (controller.onConnectCallback)
         {
             controller.onConnectCallback();
         }
-        pServer->updateConnParams(connInfo.getConnHandle(), 24, 48, 0, 180);
+    }
+
+    // linkInfo follows the most recent connection
+    void onPhyUpdate(NimBLEConnInfo &connInfo, uint8_t txPhy, uint8_t rxPhy)
+    {
+        if (connInfo.getConnHandle() != controller.linkInfo.connHandle)
+        {
+            return;
+        }
+        controller.linkInfo.txPhy = txPhy;
+        controller.linkInfo.rxPhy = rxPhy;
+    }
+
+    void onConnParamsUpdate(NimBLEConnInfo &connInfo)
+    {
+        if (connInfo.getConnHandle() != controller.linkInfo.connHandle)
+        {
+            return;
+        }
+        controller.linkInfo.interval = connInfo.getConnInterval();
+        controller.linkInfo.latency = connInfo.getConnLatency();
+        controller.linkInfo.timeout = connInfo.getConnTimeout();
     }
 
     void onDisconnect(BLEServer *pServer, NimBLEConnInfo& connInfo, int reason)
     {
-        controller.deviceConnected = false;
+        if (controller.connectedCount > 0)
+        {
+            controller.connectedCount--;
+        }
+        controller.deviceConnected = controller.connectedCount > 0;
+        // Stop notifying the link right away; the worker closes the session
+        BLESession *session = controller.findSession(connInfo.getConnHandle());
+        if (session)
+        {
+            session->subscribed = false;
+        }
+        controller.resetTxCredits();
+        controller.enqueueRx(RX_EVENT_DISCONNECT, connInfo.getConnHandle(), std::string());
         controller.startAdvertising();
         if (controller.onDisconnectCallback)
         {
@@ -43,7 +86,10 @@ public:
 
     void onMTUChange( uint16_t newMtu, NimBLEConnInfo& connInfo)
     {
-        controller.handleMtuChange(newMtu);
+        std::string value(2, '\0');
+        value[0] = newMtu & 0xFF;
+        value[1] = newMtu >> 8;
+        controller.enqueueRx(RX_EVENT_MTU, connInfo.getConnHandle(), value);
     }
 };
 
@@ -57,8 +103,34 @@ public:
     void onWrite(BLECharacteristic *pCharacteristic,NimBLEConnInfo& connInfo)
     {
         std::string rxValue = pCharacteristic->getValue();
-        controller.handleReceivedMessage(rxValue);
-        rxValue.clear();
+        controller.enqueueRx(RX_SOURCE_MAIN, connInfo.getConnHandle(), rxValue);
+    }
+};
+
+// Notification completions hand back transmit credits
+class BLEController::TxCallbacks : public BLECharacteristicCallbacks
+{
+    BLEController &controller;
+
+public:
+    TxCallbacks(BLEController &ctrl) : controller(ctrl) {}
+
+    void onStatus(BLECharacteristic *pCharacteristic, int code)
+    {
+        if (controller.txCredits)
+        {
+            xSemaphoreGive(controller.txCredits);
+        }
+    }
+
+    // Only subscribed sessions are notified: a notify to any other connection
+    // is skipped by the stack and would never hand its credit back
+    void onSubscribe(BLECharacteristic *pCharacteristic, NimBLEConnInfo &connInfo, uint16_t subValue)
+    {
+        std::string value(2, '\0');
+        value[0] = subValue & 0xFF;
+        value[1] = subValue >> 8;
+        controller.enqueueRx(RX_EVENT_SUBSCRIBE, connInfo.getConnHandle(), value);
     }
 };
 
@@ -71,8 +143,7 @@ public:
      void onWrite(BLECharacteristic *pCharacteristic,NimBLEConnInfo& connInfo)
     {
         std::string pData = pCharacteristic->getValue();
-        int len = pData.length();
-        controller.receiveOTA(pData);
+        controller.enqueueRx(RX_SOURCE_OTA, connInfo.getConnHandle(), pData);
     }
 };
 
@@ -80,23 +151,451 @@ void BLEController::receiveOTA(const std::string &pData)
 {
     if (pData.length() > 0)
     {
+        xSemaphoreTake(otaQueueMutex, portMAX_DELAY);
+        // Windowed and resumable chunks are always exactly one write, no terminator needed
+        if (blankota.empty() &&
+            ((uint8_t)pData[0] == OTA_MSG_WINDOW_CHUNK || (uint8_t)pData[0] == OTA_MSG_RESUME_CHUNK))
+        {
+            msgota.push(pData);
+            otaChunkRxUs = currentRxUs;
+            diagnostics.maxOtaQueue = std::max(diagnostics.maxOtaQueue, (uint16_t)msgota.size());
+            xSemaphoreGive(otaQueueMutex);
+            return;
+        }
         if (pData.find('\4') != std::string::npos)
         {
             blankota = blankota + pData;
             blankota.erase(blankota.length() - 1);
             msgota.push(blankota);
+            otaChunkRxUs = currentRxUs;
+            diagnostics.maxOtaQueue = std::max(diagnostics.maxOtaQueue, (uint16_t)msgota.size());
             blankota = "";
         }
         else
         {
             blankota = blankota + pData;
         }
+        xSemaphoreGive(otaQueueMutex);
+    }
+}
+
+// NimBLE host task: hand the write to the worker, or handle it inline when
+// the application still polls from loop()
+void BLEController::enqueueRx(BLERxSource source, uint16_t connHandle, const std::string &data)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    if (source == RX_SOURCE_MAIN || source == RX_SOURCE_OTA)
+    {
+        diagnostics.rxWrites++;
+        diagnostics.rxBytes += data.length();
+    }
+    if (!rxQueue)
+    {
+        rxSlot.source = source;
+        rxSlot.connHandle = connHandle;
+        rxSlot.length = std::min(data.length(), (size_t)BLE_RX_SLOT_SIZE);
+        rxSlot.rxUs = now;
+        memcpy(rxSlot.data, data.data(), rxSlot.length);
+        handleRxSlot();
+        return;
+    }
+
+    // Split writes longer than a slot; both receive paths are stream based.
+    // Only the host task gets here, so one staging slot is enough.
+    static BLERxSlot slot;
+    size_t offset = 0;
+    do
+    {
+        size_t n = std::min(data.length() - offset, (size_t)BLE_RX_SLOT_SIZE);
+        slot.source = source;
+        slot.connHandle = connHandle;
+        slot.length = n;
+        slot.rxUs = now;
+        memcpy(slot.data, data.data() + offset, n);
+        if (xQueueSend(rxQueue, &slot, pdMS_TO_TICKS(BLE_RX_ENQUEUE_WAIT_MS)) != pdTRUE)
+        {
+            wireStats.rxDropped++;
+            return;
+        }
+        offset += n;
+    } while (offset < data.length());
+
+    uint16_t depth = uxQueueMessagesWaiting(rxQueue);
+    if (depth > diagnostics.maxRxQueue)
+    {
+        diagnostics.maxRxQueue = depth;
+    }
+}
+
+void BLEController::handleRxSlot()
+{
+    currentRxUs = rxSlot.rxUs;
+    BLESession *session = findSession(rxSlot.connHandle);
+    uint16_t value = rxSlot.length >= 2 ? rxSlot.data[0] | (rxSlot.data[1] << 8) : 0;
+    switch (rxSlot.source)
+    {
+    case RX_SOURCE_MAIN:
+        // Writes from a link beyond BLE_MAX_SESSIONS have nowhere to go
+        if (session)
+        {
+            rxSession = session;
+            handleReceivedMessage(std::string((const char *)rxSlot.data, rxSlot.length));
+        }
+        break;
+    case RX_SOURCE_OTA:
+        receiveOTA(std::string((const char *)rxSlot.data, rxSlot.length));
+        break;
+    case RX_EVENT_CONNECT:
+        openSession(rxSlot.connHandle);
+        reportMinMtu();
+        break;
+    case RX_EVENT_DISCONNECT:
+        closeSession(rxSlot.connHandle);
+        reportMinMtu();
+        break;
+    case RX_EVENT_SUBSCRIBE:
+        if (session)
+        {
+            session->subscribed = value & 0x0001;
+        }
+        break;
+    case RX_EVENT_MTU:
+        handleMtuChange(session, value);
+        reportMinMtu();
+        break;
+    case RX_EVENT_POLL:
+        break; // processTextMessages runs the callback next
+    }
+}
+
+BLESession *BLEController::findSession(uint16_t connHandle)
+{
+    for (BLESession &session : sessions)
+    {
+        if (session.connHandle == connHandle)
+        {
+            return &session;
+        }
+    }
+    return nullptr;
+}
+
+BLESession *BLEController::openSession(uint16_t connHandle)
+{
+    BLESession *session = findSession(BLE_HS_CONN_HANDLE_NONE);
+    if (!session)
+    {
+        return nullptr;
+    }
+    session->mtu = BLE_ATT_MTU_DFLT;
+    session->subscribed = false;
+    session->textMode = defaultTextMode;
+    session->executeTextBufferFlag = false;
+    session->wireFormat = WIRE_FORMAT_JSON;
+    session->connHandle = connHandle; // publish last, other tasks read the table
+    return session;
+}
+
+void BLEController::closeSession(uint16_t connHandle)
+{
+    BLESession *session = findSession(connHandle);
+    if (!session)
+    {
+        return;
+    }
+    if (scriptSession == session - sessions)
+    {
+        scriptSession = -1;
+    }
+    if (rxSession == session)
+    {
+        rxSession = nullptr;
+    }
+    session->subscribed = false;
+    session->executeTextBufferFlag = false;
+    session->textBuffer.clear();
+    session->receivedData.clear();
+    session->frameBuffer.clear();
+    session->connHandle = BLE_HS_CONN_HANDLE_NONE;
+}
+
+uint8_t BLEController::sessionBit(const BLESession *session)
+{
+    return session ? 1 << (session - sessions) : 0;
+}
+
+// Sessions that can be notified, optionally only those using one wire format
+uint8_t BLEController::subscribedMask(int wireFormat)
+{
+    uint8_t mask = 0;
+    for (uint8_t i = 0; i < BLE_MAX_SESSIONS; i++)
+    {
+        const BLESession &session = sessions[i];
+        if (session.connHandle != BLE_HS_CONN_HANDLE_NONE && session.subscribed &&
+            (wireFormat < 0 || session.wireFormat == wireFormat))
+        {
+            mask |= 1 << i;
+        }
     }
+    return mask;
 }
 
-void BLEController::handleMtuChange(uint16_t newMtu)
+uint16_t BLEController::getMinMtu()
+{
+    uint16_t minMtu = 0;
+    for (const BLESession &session : sessions)
+    {
+        if (session.connHandle != BLE_HS_CONN_HANDLE_NONE && (minMtu == 0 || session.mtu < minMtu))
+        {
+            minMtu = session.mtu;
+        }
+    }
+    return minMtu ? minMtu : mtu;
+}
+
+void BLEController::workerTaskFn(void *param)
+{
+    BLEController *self = static_cast<BLEController *>(param);
+    for (;;)
+    {
+        // Only wake without data to drop an idle link back from BULK
+        TickType_t wait = self->linkInfo.profile == LINK_PROFILE_BULK ? pdMS_TO_TICKS(BLE_LINK_IDLE_AFTER_MS)
+                                                                      : portMAX_DELAY;
+        if (xQueueReceive(self->rxQueue, &self->rxSlot, wait) != pdTRUE)
+        {
+            self->checkLinkIdle();
+            continue;
+        }
+        self->handleRxSlot();
+        self->processOTAData();
+        self->processJsonMessages();
+        self->processTextMessages();
+    }
+}
+
+bool BLEController::startWorker(UBaseType_t priority, BaseType_t core)
+{
+    if (workerTask)
+    {
+        return true;
+    }
+    // Slots are copied by value, so the queue storage is the only RX buffer pool
+    rxQueue = xQueueCreate(BLE_RX_QUEUE_DEPTH, sizeof(BLERxSlot));
+    if (!rxQueue)
+    {
+        return false;
+    }
+    if (xTaskCreatePinnedToCore(workerTaskFn, "BLEWorker", BLE_WORKER_STACK_SIZE, this,
+                                priority, &workerTask, core) != pdPASS)
+    {
+        vQueueDelete(rxQueue);
+        rxQueue = nullptr;
+        workerTask = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void BLEController::recordExecStart()
+{
+    uint32_t requested = execRequestUs;
+    if (requested)
+    {
+        execRequestUs = 0;
+        diagnostics.execLatency.add((uint32_t)esp_timer_get_time() - requested);
+    }
+}
+
+void BLEController::recordOtaAck()
+{
+    if (otaChunkRxUs)
+    {
+        diagnostics.otaAckLatency.add((uint32_t)esp_timer_get_time() - otaChunkRxUs);
+        otaChunkRxUs = 0;
+    }
+}
+
+void BLEController::resetDiagnostics()
+{
+    memset(&diagnostics, 0, sizeof(diagnostics));
+    memset(&wireStats, 0, sizeof(wireStats));
+    diagnostics.resetMs = millis();
+}
+
+static void histogramToJson(JsonObject obj, const BLELatencyHistogram &hist)
+{
+    obj["count"] = hist.count;
+    obj["avg_us"] = hist.count ? (uint32_t)(hist.sumUs / hist.count) : 0;
+    obj["max_us"] = hist.maxUs;
+    JsonArray buckets = obj["buckets"].to<JsonArray>();
+    for (uint8_t i = 0; i < BLE_HIST_BUCKETS; i++)
+    {
+        buckets.add(hist.buckets[i]);
+    }
+}
+
+void BLEController::diagnosticsToJson(JsonDocument &doc)
+{
+    uint32_t elapsed = millis() - diagnostics.resetMs;
+    uint32_t seconds = elapsed / 1000 ? elapsed / 1000 : 1;
+    doc["elapsed_ms"] = elapsed;
+
+    JsonObject rx = doc["rx"].to<JsonObject>();
+    rx["bytes"] = diagnostics.rxBytes;
+    rx["writes"] = diagnostics.rxWrites;
+    rx["bytes_ps"] = (uint32_t)(diagnostics.rxBytes / seconds);
+    rx["writes_ps"] = diagnostics.rxWrites / seconds;
+    rx["dropped"] = wireStats.rxDropped;
+
+    JsonObject tx = doc["tx"].to<JsonObject>();
+    tx["bytes"] = wireStats.txBytes;
+    tx["notifies"] = wireStats.txNotifies;
+    tx["bytes_ps"] = (uint32_t)(wireStats.txBytes / seconds);
+    tx["notifies_ps"] = wireStats.txNotifies / seconds;
+    tx["retries"] = wireStats.txRetries;
+    tx["credit_timeouts"] = diagnostics.txCreditTimeouts;
+    tx["dropped"] = diagnostics.txDropped;
+    tx["credits_in_use"] = txCredits ? BLE_TX_CREDITS - uxSemaphoreGetCount(txCredits) : 0;
+    tx["last_throughput"] = wireStats.lastThroughput;
+
+    JsonObject frames = doc["frames"].to<JsonObject>();
+    frames["rx"] = wireStats.rxFrames;
+    frames["tx"] = wireStats.txFrames;
+    frames["crc_errors"] = wireStats.crcErrors;
+    frames["decode_errors"] = wireStats.decodeErrors;
+
+    JsonObject queues = doc["queues"].to<JsonObject>();
+    queues["messages"] = messageQueue.size();
+    queues["messages_max"] = diagnostics.maxMessageQueue;
+    xSemaphoreTake(otaQueueMutex, portMAX_DELAY);
+    queues["ota"] = msgota.size();
+    xSemaphoreGive(otaQueueMutex);
+    queues["ota_max"] = diagnostics.maxOtaQueue;
+    queues["rx"] = rxQueue ? uxQueueMessagesWaiting(rxQueue) : 0;
+    queues["rx_max"] = diagnostics.maxRxQueue;
+
+    histogramToJson(doc["exec_latency"].to<JsonObject>(), diagnostics.execLatency);
+    histogramToJson(doc["ota_ack"].to<JsonObject>(), diagnostics.otaAckLatency);
+
+    if (diagnosticsCallback)
+    {
+        diagnosticsCallback(doc);
+    }
+}
+
+void BLEController::handleMtuChange(BLESession *session, uint16_t newMtu)
 {
     mtu = newMtu;
+    if (!session)
+    {
+        return;
+    }
+    session->mtu = newMtu;
+    if (session->connHandle == linkInfo.connHandle)
+    {
+        linkInfo.mtu = newMtu;
+    }
+}
+
+void BLEController::reportMinMtu()
+{
+    if (onMtuChangeCallback)
+    {
+        onMtuChangeCallback(getMinMtu());
+    }
+}
+
+// Ask for 2M PHY and 251-byte PDUs, then start in BULK: a fresh connection
+// usually begins with a sync or script upload. Results arrive in callbacks.
+void BLEController::onLinkConnected(uint16_t connHandle)
+{
+    uint32_t txThroughput[LINK_PROFILE_COUNT];
+    uint32_t rxThroughput[LINK_PROFILE_COUNT];
+    memcpy(txThroughput, linkInfo.txThroughput, sizeof(txThroughput));
+    memcpy(rxThroughput, linkInfo.rxThroughput, sizeof(rxThroughput));
+    memset(&linkInfo, 0, sizeof(linkInfo));
+    memcpy(linkInfo.txThroughput, txThroughput, sizeof(txThroughput));
+    memcpy(linkInfo.rxThroughput, rxThroughput, sizeof(rxThroughput));
+
+    linkInfo.connHandle = connHandle;
+    linkInfo.txPhy = BLE_HCI_LE_PHY_1M;
+    linkInfo.rxPhy = BLE_HCI_LE_PHY_1M;
+    linkInfo.mtu = BLE_ATT_MTU_DFLT;
+    linkInfo.autoProfile = true;
+
+    pServer->updatePhy(connHandle, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+    pServer->setDataLen(connHandle, BLE_LINK_DATA_LEN);
+    setLinkProfile(LINK_PROFILE_BULK, false);
+}
+
+void BLEController::setLinkProfile(BLELinkProfile profile, bool manual)
+{
+    if (manual)
+    {
+        linkInfo.autoProfile = false;
+    }
+    linkInfo.profile = profile;
+    linkInfo.lastActivityMs = millis();
+    if (!deviceConnected)
+    {
+        return;
+    }
+    // Every central shares the profile: they all carry the same output
+    for (uint16_t connHandle : pServer->getPeerDevices())
+    {
+        if (profile == LINK_PROFILE_BULK)
+        {
+            pServer->updateConnParams(connHandle, BLE_LINK_BULK_MIN_INTERVAL, BLE_LINK_BULK_MAX_INTERVAL,
+                                      BLE_LINK_BULK_LATENCY, BLE_LINK_BULK_TIMEOUT);
+        }
+        else
+        {
+            pServer->updateConnParams(connHandle, BLE_LINK_IDLE_MIN_INTERVAL, BLE_LINK_IDLE_MAX_INTERVAL,
+                                      BLE_LINK_IDLE_LATENCY, BLE_LINK_IDLE_TIMEOUT);
+        }
+    }
+}
+
+// Transfers raise the link to BULK; any traffic keeps it there
+void BLEController::noteLinkActivity(bool transfer)
+{
+    linkInfo.lastActivityMs = millis();
+    if (transfer && linkInfo.autoProfile && linkInfo.profile != LINK_PROFILE_BULK)
+    {
+        setLinkProfile(LINK_PROFILE_BULK, false);
+    }
+}
+
+void BLEController::checkLinkIdle()
+{
+    if (deviceConnected && linkInfo.autoProfile && linkInfo.profile == LINK_PROFILE_BULK &&
+        millis() - linkInfo.lastActivityMs >= BLE_LINK_IDLE_AFTER_MS)
+    {
+        setLinkProfile(LINK_PROFILE_IDLE, false);
+    }
+}
+
+const char *BLEController::linkProfileName(BLELinkProfile profile)
+{
+    return profile == LINK_PROFILE_BULK ? "bulk" : "idle";
+}
+
+void BLEController::linkInfoToJson(JsonDocument &doc)
+{
+    doc["profile"] = linkProfileName(linkInfo.profile);
+    doc["auto"] = linkInfo.autoProfile;
+    doc["txphy"] = linkInfo.txPhy;
+    doc["rxphy"] = linkInfo.rxPhy;
+    doc["mtu"] = linkInfo.mtu;
+    doc["interval_ms"] = linkInfo.interval * 1.25f;
+    doc["latency"] = linkInfo.latency;
+    doc["timeout_ms"] = linkInfo.timeout * 10;
+    for (uint8_t p = 0; p < LINK_PROFILE_COUNT; p++)
+    {
+        JsonObject throughput = doc["throughput"][linkProfileName((BLELinkProfile)p)].to<JsonObject>();
+        throughput["tx"] = linkInfo.txThroughput[p];
+        throughput["rx"] = linkInfo.rxThroughput[p];
+    }
 }
 
 BLEController::BLEController() : deviceConnected(false), mtu(250),
@@ -110,9 +609,33 @@ BLEController::BLEController() : deviceConnected(false), mtu(250),
                                  otaTxUUID(OTA_UUID_TX),
                                  otaRxUUID(OTA_UUID_RX),
                                  currentBatteryLevel(0), otaHandler(0),
-                                 TextMode(true)
+                                 connectedCount(0), rxSession(nullptr),
+                                 scriptSession(-1), defaultTextMode(true),
+                                 txSeq(0), txCredits(nullptr)
 {
+    for (BLESession &session : sessions)
+    {
+        session.connHandle = BLE_HS_CONN_HANDLE_NONE;
+    }
     memset(currentSWVersion, 0, sizeof(currentSWVersion));
+    memset(&wireStats, 0, sizeof(wireStats));
+    memset(&windowRx, 0, sizeof(windowRx));
+    memset(&otaStream, 0, sizeof(otaStream));
+    memset(&inflateState, 0, sizeof(inflateState));
+    memset(&linkInfo, 0, sizeof(linkInfo));
+    memset(&diagnostics, 0, sizeof(diagnostics));
+    currentRxUs = 0;
+    execRequestUs = 0;
+    pollRequested = false;
+    otaChunkRxUs = 0;
+    otaFullQueue = nullptr;
+    otaFreeQueue = nullptr;
+    otaWriterTask = nullptr;
+    rxQueue = nullptr;
+    workerTask = nullptr;
+    pStreamCharacteristic = nullptr;
+    otaQueueMutex = xSemaphoreCreateMutex();
+    txMutex = xSemaphoreCreateRecursiveMutex();
 }
 
 void BLEController::setDeviceName(String name)
@@ -154,10 +677,13 @@ void BLEController::begin(const String Name)
 
     pTxCharacteristic = pService->createCharacteristic(txUUID.c_str(), NIMBLE_PROPERTY::NOTIFY);
     pRxCharacteristic = pService->createCharacteristic(rxUUID.c_str(), NIMBLE_PROPERTY::WRITE);
+    pStreamCharacteristic = pService->createCharacteristic(BLE_UUID_STREAM, NIMBLE_PROPERTY::NOTIFY);
     pBatCharacteristic = pBatService->createCharacteristic(
         "2A19", NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
 
     pRxCharacteristic->setCallbacks(new CharCallbacks(*this));
+    txCredits = xSemaphoreCreateCounting(BLE_TX_CREDITS, BLE_TX_CREDITS);
+    pTxCharacteristic->setCallbacks(new TxCallbacks(*this));
 
     bool success = pService->start();
 
@@ -168,45 +694,510 @@ void BLEController::begin(const String Name)
     _initialized = true;
 }
 
-void BLEController::initOTA()
-{
-    esp_ota_mark_app_valid_cancel_rollback();
-    BLEService *otaService = pServer->createService(OTA_SERVICE_UUID);
-    otaTX = otaService->createCharacteristic(
-        OTA_UUID_TX, NIMBLE_PROPERTY::NOTIFY | NIMBLE_PROPERTY::READ);
-    otaRX = otaService->createCharacteristic(
-        OTA_UUID_RX, NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::READ |
-                         NIMBLE_PROPERTY::WRITE_NR);
-    otaRX->setCallbacks(new OtaCallbacks(*this));
-    otaTX->setCallbacks(new OtaCallbacks(*this));
-    otaService->start();
-    LittleFSFile::initFS(); 
+void BLEController::initOTA()
+{
+    esp_ota_mark_app_valid_cancel_rollback();
+    BLEService *otaService = pServer->createService(OTA_SERVICE_UUID);
+    otaTX = otaService->createCharacteristic(
+        OTA_UUID_TX, NIMBLE_PROPERTY::NOTIFY | NIMBLE_PROPERTY::READ);
+    otaRX = otaService->createCharacteristic(
+        OTA_UUID_RX, NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::READ |
+                         NIMBLE_PROPERTY::WRITE_NR);
+    otaRX->setCallbacks(new OtaCallbacks(*this));
+    otaTX->setCallbacks(new OtaCallbacks(*this));
+    otaService->start();
+    LittleFSFile::initFS(); 
+}
+
+void BLEController::processOTAData()
+{
+    checkLinkIdle();
+    // Drain everything queued: windowed uploads deliver many chunks per loop
+    for (;;)
+    {
+        xSemaphoreTake(otaQueueMutex, portMAX_DELAY);
+        if (msgota.empty())
+        {
+            xSemaphoreGive(otaQueueMutex);
+            return;
+        }
+        std::string data = std::move(msgota.front());
+        msgota.pop();
+        xSemaphoreGive(otaQueueMutex);
+        noteLinkActivity(true);
+
+        if ((uint8_t)data[0] == OTA_MSG_WINDOW_CHUNK)
+        {
+            handleWindowChunk(data);
+        }
+        else if ((uint8_t)data[0] == OTA_MSG_RESUME_CHUNK)
+        {
+            handleResumeChunk(data);
+        }
+        else
+        {
+            processOTAMessage(data);
+        }
+    }
+}
+
+void BLEController::processOTAMessage(const std::string &data)
+{
+    uint8_t msgId;
+    if (data[0] == 0x01)
+    {
+        msgId = data[1];
+        String jsonData = data.substr(1).c_str();
+        handleOTA(jsonData, msgId);
+    }
+    else if (data[0] == 0x02)
+    {
+        msgId = data[1];
+        const uint8_t *fileData = (const uint8_t *)data.data() + 1;
+        size_t fileLength = data.length() - 1;
+        LittleFSFile::ErrorCode errorCode = writeTransferChunk(fileData, fileLength);
+        updateFileTransferProgress(fileLength);
+        sendResponseBinaryOTA((byte)errorCode, msgId);
+        if (otaStream.active && errorCode != LittleFSFile::FILE_OK)
+        {
+            completeStreamOta(errorCode);
+        }
+    }
+}
+
+// Chunks go to the open LittleFS file, or straight to flash during a streaming OTA
+LittleFSFile::ErrorCode BLEController::writeTransferChunk(const uint8_t *data, size_t length)
+{
+    if (inflateState.decompressor)
+    {
+        return inflateChunk(data, length);
+    }
+    return writeDecodedChunk(data, length);
+}
+
+LittleFSFile::ErrorCode BLEController::writeDecodedChunk(const uint8_t *data, size_t length)
+{
+    if (otaStream.active)
+    {
+        return writeStreamOta(data, length);
+    }
+    return LittleFSFile::writeFile(data, length);
+}
+
+// Only "deflate" (raw, no zlib header) is known; an empty codec means plain
+bool BLEController::beginInflate(const char *codec)
+{
+    endInflate();
+    if (!codec || !*codec)
+    {
+        return true;
+    }
+    if (strcmp(codec, "deflate") != 0)
+    {
+        return false;
+    }
+    return inflate_begin(inflateState);
+}
+
+void BLEController::endInflate()
+{
+    inflate_end(inflateState);
+}
+
+// The target reports FILE_WRITE_COMPLETE as soon as it has every decoded
+// byte; the transfer only completes once the deflate stream has ended too
+LittleFSFile::ErrorCode BLEController::inflateChunk(const uint8_t *data, size_t length)
+{
+    LittleFSFile::ErrorCode sinkError = LittleFSFile::FILE_OK;
+    InflateResult result = inflate_feed(inflateState, data, length, [&](const uint8_t *out, size_t n) {
+        fileStatus.decompressedBytes += n;
+        LittleFSFile::ErrorCode errorCode = writeDecodedChunk(out, n);
+        if (errorCode == LittleFSFile::FILE_WRITE_COMPLETE)
+        {
+            return INFLATE_SINK_FULL;
+        }
+        if (errorCode != LittleFSFile::FILE_OK)
+        {
+            sinkError = errorCode;
+            return INFLATE_SINK_ERROR;
+        }
+        return INFLATE_SINK_OK;
+    });
+
+    switch (result)
+    {
+    case INFLATE_MORE:
+        return LittleFSFile::FILE_OK;
+    case INFLATE_DONE:
+        return LittleFSFile::FILE_WRITE_COMPLETE;
+    case INFLATE_SHORT:
+        return LittleFSFile::FILE_SIZE_MISMATCH;
+    case INFLATE_SINK_FAILED:
+        return sinkError;
+    default:
+        return LittleFSFile::FILE_WRITE_FAILED; // corrupt stream
+    }
+}
+
+void BLEController::otaWriterTaskFn(void *param)
+{
+    BLEController *self = (BLEController *)param;
+    uint8_t index;
+    for (;;)
+    {
+        xQueueReceive(self->otaFullQueue, &index, portMAX_DELAY);
+        OtaStream &stream = self->otaStream;
+        if (stream.writeError == ESP_OK)
+        {
+            stream.writeError = esp_ota_write(self->otaHandler, stream.buffers[index], stream.fill[index]);
+        }
+        stream.fill[index] = 0;
+        xQueueSend(self->otaFreeQueue, &index, portMAX_DELAY);
+    }
+}
+
+bool BLEController::beginStreamOta(size_t size, const char *sha256Hex)
+{
+    abortStreamOta();
+    otaStream.error = nullptr;
+
+    otaStream.partition = esp_ota_get_next_update_partition(NULL);
+    if (!otaStream.partition || size == 0 || size > otaStream.partition->size)
+    {
+        otaStream.error = "No OTA partition large enough";
+        return false;
+    }
+
+    otaStream.verify = sha256Hex && strlen(sha256Hex) == 64;
+    for (int i = 0; otaStream.verify && i < 32; i++)
+    {
+        char byteHex[3] = {sha256Hex[i * 2], sha256Hex[i * 2 + 1], 0};
+        otaStream.expectedSha[i] = strtoul(byteHex, nullptr, 16);
+    }
+
+    if (!otaFullQueue)
+    {
+        otaFullQueue = xQueueCreate(2, sizeof(uint8_t));
+        otaFreeQueue = xQueueCreate(2, sizeof(uint8_t));
+        xTaskCreatePinnedToCore(otaWriterTaskFn, "OtaWriter", 4096, this, 2, &otaWriterTask, 1);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        otaStream.buffers[i] = (uint8_t *)malloc(OTA_STREAM_BUFFER_SIZE);
+    }
+    if (!otaStream.buffers[0] || !otaStream.buffers[1] || !otaWriterTask)
+    {
+        otaStream.error = "Out of memory";
+        abortStreamOta();
+        return false;
+    }
+
+    // Sequential writes: sectors are erased as they are reached instead of all up front
+    if (esp_ota_begin(otaStream.partition, OTA_WITH_SEQUENTIAL_WRITES, &otaHandler) != ESP_OK)
+    {
+        otaStream.error = "esp_ota_begin failed";
+        abortStreamOta();
+        return false;
+    }
+
+    xQueueReset(otaFullQueue);
+    xQueueReset(otaFreeQueue);
+    uint8_t spare = 1;
+    xQueueSend(otaFreeQueue, &spare, 0); // buffer 0 is being filled
+    otaStream.current = 0;
+    otaStream.fill[0] = otaStream.fill[1] = 0;
+    otaStream.writeError = ESP_OK;
+    otaStream.size = size;
+    otaStream.received = 0;
+    otaStream.lastPercent = -1;
+    mbedtls_sha256_init(&otaStream.sha);
+    mbedtls_sha256_starts(&otaStream.sha, 0);
+    otaStream.active = true;
+
+    if (otaStartCallback)
+    {
+        otaStartCallback();
+    }
+    return true;
+}
+
+LittleFSFile::ErrorCode BLEController::writeStreamOta(const uint8_t *data, size_t length)
+{
+    if (otaStream.received + length > otaStream.size)
+    {
+        return LittleFSFile::FILE_SIZE_MISMATCH;
+    }
+    mbedtls_sha256_update(&otaStream.sha, data, length);
+    otaStream.received += length;
+
+    while (length > 0)
+    {
+        uint8_t index = otaStream.current;
+        size_t n = min(length, OTA_STREAM_BUFFER_SIZE - otaStream.fill[index]);
+        memcpy(otaStream.buffers[index] + otaStream.fill[index], data, n);
+        otaStream.fill[index] += n;
+        data += n;
+        length -= n;
+
+        // Full sector: hand it to the writer and keep receiving into the other one
+        if (otaStream.fill[index] == OTA_STREAM_BUFFER_SIZE)
+        {
+            xQueueSend(otaFullQueue, &index, portMAX_DELAY);
+            xQueueReceive(otaFreeQueue, &otaStream.current, portMAX_DELAY);
+        }
+    }
+    if (otaStream.writeError != ESP_OK)
+    {
+        return LittleFSFile::FILE_WRITE_FAILED;
+    }
+
+    int percent = (int)((uint64_t)otaStream.received * 100 / otaStream.size);
+    if (percent != otaStream.lastPercent && otaProgressCallback)
+    {
+        otaStream.lastPercent = percent;
+        otaProgressCallback(percent);
+    }
+    return otaStream.received == otaStream.size ? LittleFSFile::FILE_WRITE_COMPLETE : LittleFSFile::FILE_OK;
+}
+
+// Flush the partial buffer and wait until the writer has both buffers back
+bool BLEController::drainStreamOta()
+{
+    uint8_t index = otaStream.current;
+    if (otaStream.fill[index] > 0)
+    {
+        xQueueSend(otaFullQueue, &index, portMAX_DELAY);
+    }
+    else
+    {
+        xQueueSend(otaFreeQueue, &index, portMAX_DELAY);
+    }
+    while (uxQueueMessagesWaiting(otaFreeQueue) < 2)
+    {
+        vTaskDelay(1);
+    }
+    return otaStream.writeError == ESP_OK;
+}
+
+bool BLEController::finishStreamOta()
+{
+    bool ok = drainStreamOta();
+    if (!ok)
+    {
+        otaStream.error = "Flash write failed";
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&otaStream.sha, digest);
+    mbedtls_sha256_free(&otaStream.sha);
+    if (ok && otaStream.verify && memcmp(digest, otaStream.expectedSha, sizeof(digest)) != 0)
+    {
+        otaStream.error = "SHA-256 mismatch";
+        ok = false;
+    }
+
+    // On any failure the boot partition is untouched, so the running image stays
+    if (!ok)
+    {
+        esp_ota_abort(otaHandler);
+    }
+    else if (esp_ota_end(otaHandler) != ESP_OK)
+    {
+        otaStream.error = "Image validation failed";
+        ok = false;
+    }
+    else if (esp_ota_set_boot_partition(otaStream.partition) != ESP_OK)
+    {
+        otaStream.error = "Could not set boot partition";
+        ok = false;
+    }
+    otaHandler = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        free(otaStream.buffers[i]);
+        otaStream.buffers[i] = nullptr;
+    }
+    otaStream.active = false;
+    return ok;
+}
+
+void BLEController::abortStreamOta()
+{
+    if (otaStream.active)
+    {
+        drainStreamOta();
+        esp_ota_abort(otaHandler);
+        mbedtls_sha256_free(&otaStream.sha);
+        otaHandler = 0;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        free(otaStream.buffers[i]);
+        otaStream.buffers[i] = nullptr;
+    }
+    otaStream.active = false;
+}
+
+void BLEController::completeStreamOta(LittleFSFile::ErrorCode errorCode)
+{
+    bool success = false;
+    if (errorCode == LittleFSFile::FILE_WRITE_COMPLETE)
+    {
+        success = finishStreamOta();
+    }
+    else
+    {
+        otaStream.error = errorCode == LittleFSFile::FILE_SIZE_MISMATCH ? "Size mismatch" : "Flash write failed";
+        abortStreamOta();
+    }
+    endWindowTransfer();
+    endInflate();
+
+    if (success)
+    {
+        sendResponseJsonOTA("OTA update successful", "otaupdate", 0);
+        if (otaSuccessCallback)
+        {
+            otaSuccessCallback();
+        }
+        delay(1000);
+        ESP.restart();
+    }
+    else
+    {
+        sendResponseJsonOTA(otaStream.error, "otaupdate", 0);
+        if (otaErrorCallback)
+        {
+            otaErrorCallback(otaStream.error);
+        }
+    }
+}
+
+bool BLEController::beginWindowTransfer(uint16_t window, uint16_t chunkSize, uint16_t ackEvery)
+{
+    endWindowTransfer();
+
+    // Power of two so seq % window stays consistent across the u16 wrap
+    uint16_t size = 1;
+    while (size * 2 <= min(window, (uint16_t)OTA_WINDOW_MAX))
+    {
+        size *= 2;
+    }
+    windowRx.slots = (uint8_t *)(psramFound() ? ps_malloc((size_t)size * chunkSize) : malloc((size_t)size * chunkSize));
+    if (!windowRx.slots)
+    {
+        return false;
+    }
+    windowRx.window = size;
+    windowRx.chunkSize = chunkSize;
+    windowRx.ackEvery = ackEvery > 0 ? min(ackEvery, size) : min((uint16_t)OTA_WINDOW_DEFAULT_ACK_EVERY, size);
+    windowRx.active = true;
+    return true;
+}
+
+void BLEController::endWindowTransfer()
+{
+    free(windowRx.slots);
+    memset(&windowRx, 0, sizeof(windowRx));
+}
+
+void BLEController::sendWindowAck()
+{
+    uint8_t ack[8] = {OTA_MSG_WINDOW_CHUNK,
+                      (uint8_t)(windowRx.nextSeq & 0xFF), (uint8_t)(windowRx.nextSeq >> 8),
+                      (uint8_t)(windowRx.received & 0xFF), (uint8_t)(windowRx.received >> 8),
+                      (uint8_t)(windowRx.received >> 16), (uint8_t)(windowRx.received >> 24),
+                      '\04'};
+    otaTX->notify(ack, sizeof(ack));
+    recordOtaAck();
+    windowRx.sinceAck = 0;
+}
+
+void BLEController::handleWindowChunk(const std::string &data)
+{
+    if (!windowRx.active)
+    {
+        sendResponseBinaryOTA((byte)LittleFSFile::FILE_NOT_OPENED, 0);
+        return;
+    }
+    if (data.length() < 3 || data.length() - 3 > windowRx.chunkSize)
+    {
+        return; // malformed, the sender will see the gap in the next ack
+    }
+
+    uint16_t seq = (uint8_t)data[1] | ((uint8_t)data[2] << 8);
+    int16_t distance = (int16_t)(seq - windowRx.nextSeq);
+    if (distance < 0 || distance >= windowRx.window || (windowRx.received & (1UL << distance)))
+    {
+        // Retransmit of something we already have (or a stale window): resync the sender
+        fileStatus.duplicateChunks++;
+        sendWindowAck();
+        return;
+    }
+
+    uint16_t slot = seq % windowRx.window;
+    memcpy(windowRx.slots + (size_t)slot * windowRx.chunkSize, data.data() + 3, data.length() - 3);
+    windowRx.slotLen[slot] = data.length() - 3;
+    windowRx.received |= 1UL << distance;
+
+    // First chunk past a gap: tell the sender once, so it retransmits only the hole
+    if (distance > 0 && !windowRx.gapAcked)
+    {
+        windowRx.gapAcked = true;
+        sendWindowAck();
+    }
+
+    while (windowRx.received & 1)
+    {
+        slot = windowRx.nextSeq % windowRx.window;
+        LittleFSFile::ErrorCode errorCode =
+            writeTransferChunk(windowRx.slots + (size_t)slot * windowRx.chunkSize, windowRx.slotLen[slot]);
+        updateFileTransferProgress(windowRx.slotLen[slot]);
+        windowRx.received >>= 1;
+        windowRx.nextSeq++;
+        windowRx.sinceAck++;
+        windowRx.gapAcked = false;
+
+        if (errorCode != LittleFSFile::FILE_OK)
+        {
+            // Complete or failed: final ack, then the usual binary status
+            sendWindowAck();
+            sendResponseBinaryOTA((byte)errorCode, 0);
+            if (otaStream.active)
+            {
+                completeStreamOta(errorCode);
+            }
+            endWindowTransfer();
+            return;
+        }
+    }
+
+    if (windowRx.sinceAck >= windowRx.ackEvery)
+    {
+        sendWindowAck();
+    }
 }
 
-void BLEController::processOTAData()
+// Resumable chunks are not acked one by one: the sender streams them and asks
+// with fileresume which ranges are still missing. Only errors are reported.
+void BLEController::handleResumeChunk(const std::string &data)
 {
-    if (msgota.empty())
+    if (data.length() < 3)
     {
         return;
     }
-
-    std::string data = msgota.front();
-    msgota.pop();
-
-    uint8_t msgId;
-    if (data[0] == 0x01)
+    uint16_t index = (uint8_t)data[1] | ((uint8_t)data[2] << 8);
+    size_t length = data.length() - 3;
+    LittleFSFile::ErrorCode errorCode =
+        ResumableFile::writeChunk(index, (const uint8_t *)data.data() + 3, length);
+    if (errorCode == LittleFSFile::FILE_OK || errorCode == LittleFSFile::FILE_WRITE_COMPLETE)
     {
-        msgId = data[1];
-        String jsonData = data.substr(1).c_str();
-        handleOTA(jsonData, msgId);
+        updateFileTransferProgress(length);
     }
-    else if (data[0] == 0x02)
+    else
     {
-        msgId = data[1];
-        std::string fileData = data.substr(1);
-        LittleFSFile::ErrorCode errorCode = LittleFSFile::writeFile(fileData);
-        updateFileTransferProgress(fileData.length());
-        sendResponseBinaryOTA((byte)errorCode, msgId);
+        sendResponseBinaryOTA((byte)errorCode, 0);
     }
 }
 
@@ -233,6 +1224,7 @@ void BLEController::sendResponseJsonOTA(String data, String msgtype, uint8_t msg
 
 void BLEController::sendmsgOTA(String str)
 {
+    recordOtaAck();
     str = str + '\04';
     int mtu = BLEDevice::getMTU();
     int cunkmtu = mtu - 3;
@@ -365,13 +1357,15 @@ void BLEController::setManufacturerData(BLEAdvertisementData &adData)
 
 void BLEController::handleReceivedMessage(const std::string &message)
 {
+    BLESession &session = *rxSession;
 
-    if (TextMode)
+    if (session.textMode)
     {
         if (message.find('\04') != std::string::npos) // run code
         {                                             // Control-D
             // executeTextBuffer();
-            executeTextBufferFlag = true;
+            session.executeTextBufferFlag = true;
+            execRequestUs = currentRxUs ? currentRxUs : 1;
         }
         else if (message.find('\01') != std::string::npos) // abort code execution
         {
@@ -386,30 +1380,40 @@ void BLEController::handleReceivedMessage(const std::string &message)
         {
             // call callbackabortTextAbortCallback
 
-            if (TextQueueCallback)
+            if (TextQueueDataCallback)
+            {
+                TextQueueDataCallback(message.data(), message.length());
+            }
+            else if (TextQueueCallback)
             {
                 TextQueueCallback(message.c_str());
             }
         }
         else if (message.find('\03') != std::string::npos) // to clear text buffer
         {
-            TextBuffer = "";
+            session.textBuffer.clear();
         }
         else
         {
-            TextBuffer += message;
+            session.textBuffer += message;
         }
         //  receivedData.clear();
     }
     else
     {
-        receivedData += message;
+        if (ble_frame_routed(session.frameBuffer, session.receivedData, message))
+        {
+            handleReceivedFrames(message);
+            return;
+        }
+
+        session.receivedData += message;
 
-        if (receivedData.find('\n') != std::string::npos)
+        if (session.receivedData.find('\n') != std::string::npos)
         {
-            // INFO_PRINTLN("Received message: %s", receivedData.c_str());
+            // INFO_PRINTLN("Received message: %s", session.receivedData.c_str());
             JsonDocument doc;
-            DeserializationError error = deserializeJson(doc, receivedData);
+            DeserializationError error = deserializeJson(doc, session.receivedData);
 
             if (error)
             {
@@ -418,25 +1422,94 @@ void BLEController::handleReceivedMessage(const std::string &message)
 
             if (!error)
             {
-
-                const char *msgType = doc["msgtyp"];
-                if (msgType)
-                {
-                    Message msg(msgType, doc);
-                    auto highPriorityCallback = highPriorityCallbacks.find(msgType);
-                    if (highPriorityCallback != highPriorityCallbacks.end())
-                    {
-                        processHighPriorityMessage(msg);
-                    }
-                    else
-                    {
-                        messageQueue.push(msg);
-                    }
-                }
+                dispatchMessage(doc);
             }
 
-            receivedData.clear();
+            session.receivedData.clear();
+        }
+    }
+}
+
+void BLEController::handleReceivedFrames(const std::string &message)
+{
+    auto onBadCrc = [this](uint8_t seq) {
+        wireStats.crcErrors++;
+        sendFrame(FRAME_TYPE_NACK, &seq, 1, sessionBit(rxSession));
+    };
+    ble_frame_receive(rxSession->frameBuffer, message, [this](const BLEFrame &frame) {
+        wireStats.rxFrames++;
+        if (frame.type != FRAME_TYPE_MSG)
+        {
+            return;
+        }
+        // Decoding copies strings out of the frame
+        JsonDocument doc;
+        if (deserializeMsgPack(doc, frame.payload, frame.length))
+        {
+            wireStats.decodeErrors++;
+            return;
+        }
+        dispatchMessage(doc);
+    }, onBadCrc);
+}
+
+void BLEController::dispatchMessage(JsonDocument &doc)
+{
+    const char *msgType = doc["msgtyp"];
+    if (!msgType)
+    {
+        return;
+    }
+
+    if (strcmp(msgType, "diag") == 0)
+    {
+        if (doc["reset"] | false)
+        {
+            resetDiagnostics();
+        }
+        JsonDocument response;
+        response["msgtyp"] = "diag";
+        diagnosticsToJson(response);
+        sendMessageTo(response, sessionBit(rxSession));
+        return;
+    }
+
+    if (strcmp(msgType, "link") == 0)
+    {
+        // {"msgtyp":"link"} reports, "profile":"bulk"|"idle"|"auto" also selects
+        const char *profile = doc["profile"];
+        if (profile && strcmp(profile, "auto") == 0)
+        {
+            setLinkAuto(true);
+        }
+        else if (profile)
+        {
+            setLinkProfile(strcmp(profile, "bulk") == 0 ? LINK_PROFILE_BULK : LINK_PROFILE_IDLE);
         }
+        JsonDocument response;
+        response["msgtyp"] = "link";
+        linkInfoToJson(response);
+        sendMessageTo(response, sessionBit(rxSession));
+        return;
+    }
+
+    if (strcmp(msgType, "wire") == 0)
+    {
+        const char *format = doc["format"] | "json";
+        setWireFormat(strcmp(format, "msgpack") == 0 ? WIRE_FORMAT_MSGPACK : WIRE_FORMAT_JSON);
+        return;
+    }
+
+    Message msg(msgType, doc);
+    auto highPriorityCallback = highPriorityCallbacks.find(msgType);
+    if (highPriorityCallback != highPriorityCallbacks.end())
+    {
+        processHighPriorityMessage(msg);
+    }
+    else
+    {
+        messageQueue.push(msg);
+        diagnostics.maxMessageQueue = std::max(diagnostics.maxMessageQueue, (uint16_t)messageQueue.size());
     }
 }
 
@@ -506,50 +1579,256 @@ void BLEController::processJsonMessages()
     }
 }
 
-void BLEController::processTextMessages()
+// Any task. The worker handles its own request after the current slot, so
+// it never waits on its own queue.
+void BLEController::requestPoll()
 {
+    pollRequested = true;
+    if (rxQueue && xTaskGetCurrentTaskHandle() != workerTask)
+    {
+        enqueueRx(RX_EVENT_POLL, BLE_HS_CONN_HANDLE_NONE, std::string());
+    }
+}
 
-    if (TextMode && executeTextBufferFlag)
+void BLEController::processTextMessages()
+{
+    if (pollRequested)
+    {
+        pollRequested = false;
+        if (PollCallback)
+        {
+            PollCallback();
+        }
+    }
+    for (BLESession &session : sessions)
     {
-        executeTextBufferFlag = false;
+        if (session.connHandle != BLE_HS_CONN_HANDLE_NONE && session.textMode && session.executeTextBufferFlag)
+        {
+            session.executeTextBufferFlag = false;
 
-        executeTextBuffer();
+            executeTextBuffer(session);
+        }
     }
 }
 
 void BLEController::sendMessage(const JsonDocument &message)
 {
-    String jsonString;
-    serializeJson(message, jsonString);
-    jsonString += '\n'; // Add newline as message delimiter
+    sendMessageTo(message, BLE_ALL_SESSIONS);
+}
 
-    int sendMtu = mtu - 3; // 3 bytes overhead
-    // INFO_PRINTLN("Sending BLE message: %s", jsonString.c_str());
-    for (size_t i = 0; i < jsonString.length(); i += sendMtu)
+// Serialised at most once per wire format, whatever the number of sessions
+void BLEController::sendMessageTo(const JsonDocument &message, uint8_t sessionMask)
+{
+    uint8_t packMask = sessionMask & subscribedMask(WIRE_FORMAT_MSGPACK);
+    uint8_t jsonMask = sessionMask & subscribedMask(WIRE_FORMAT_JSON);
+    if (packMask)
+    {
+        sendMsgPack(message, packMask);
+    }
+    if (!jsonMask)
     {
-        String chunk = jsonString.substring(i, std::min(i + sendMtu, jsonString.length()));
-        pTxCharacteristic->setValue((uint8_t *)chunk.c_str(), chunk.length());
-        pTxCharacteristic->notify();
-        // delay(10); // Give the client time to process
-        delayMicroseconds(100); // Give the client time to process
+        return;
     }
+
+    // Serialise into one exact-size buffer; the terminator slot becomes the delimiter
+    size_t length = measureJson(message);
+    std::vector<uint8_t> buffer(length + 1);
+    serializeJson(message, (char *)buffer.data(), buffer.size());
+    buffer[length] = '\n'; // Add newline as message delimiter
+    notifyChunked(buffer.data(), buffer.size(), -1, jsonMask);
 }
 
 void BLEController::sendMessage(String jsonString)
 {
+    uint8_t packMask = subscribedMask(WIRE_FORMAT_MSGPACK);
+    if (packMask)
+    {
+        // Pre-serialised JSON from callers: re-encode, or pass through as text
+        JsonDocument doc;
+        if (deserializeJson(doc, jsonString))
+        {
+            sendFrame(FRAME_TYPE_TEXT, (const uint8_t *)jsonString.c_str(), jsonString.length(), packMask);
+        }
+        else
+        {
+            sendMsgPack(doc, packMask);
+        }
+    }
+
+    notifyChunked((const uint8_t *)jsonString.c_str(), jsonString.length(), '\n',
+                  subscribedMask(WIRE_FORMAT_JSON));
+}
+
+void BLEController::setWireFormat(BLEWireFormat format)
+{
+    if (!rxSession)
+    {
+        return;
+    }
+    rxSession->wireFormat = format;
+
+    // Acknowledge in the new format so the client can confirm the switch
+    JsonDocument doc;
+    doc["msgtyp"] = "wire";
+    doc["format"] = format == WIRE_FORMAT_MSGPACK ? "msgpack" : "json";
+    sendMessageTo(doc, sessionBit(rxSession));
+}
+
+BLEWireFormat BLEController::getWireFormat()
+{
+    BLESession *session = rxSession ? rxSession : findSession(linkInfo.connHandle);
+    return session ? session->wireFormat : WIRE_FORMAT_JSON;
+}
+
+void BLEController::sendFrame(BLEFrameType type, const uint8_t *payload, size_t length, uint8_t sessionMask)
+{
+    if (!(sessionMask & subscribedMask()))
+    {
+        return;
+    }
+    if (length > BLE_FRAME_MAX_PAYLOAD)
+    {
+        Serial.printf("BLE frame too large: %u\n", (unsigned)length);
+        return;
+    }
+    std::vector<uint8_t> frame(BLE_FRAME_HEADER_SIZE + length + BLE_FRAME_CRC_SIZE);
+    memcpy(frame.data() + BLE_FRAME_HEADER_SIZE, payload, length);
+
+    // Sequence numbers go out in order and frames never interleave
+    xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+    size_t total = seal_frame(frame.data(), type, txSeq++, length);
+    notifyChunked(frame.data(), total, -1, sessionMask);
+    wireStats.txFrames++;
+    xSemaphoreGiveRecursive(txMutex);
+}
+
+void BLEController::sendMsgPack(const JsonDocument &message, uint8_t sessionMask)
+{
+    if (!(sessionMask & subscribedMask()))
+    {
+        return;
+    }
+    size_t length = measureMsgPack(message);
+    if (length > BLE_FRAME_MAX_PAYLOAD)
+    {
+        Serial.printf("BLE frame too large: %u\n", (unsigned)length);
+        return;
+    }
+    // Serialise straight into the frame, no intermediate String
+    std::vector<uint8_t> frame(BLE_FRAME_HEADER_SIZE + length + BLE_FRAME_CRC_SIZE);
+    serializeMsgPack(message, frame.data() + BLE_FRAME_HEADER_SIZE, length);
+
+    xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+    size_t total = seal_frame(frame.data(), FRAME_TYPE_MSG, txSeq++, length);
+    notifyChunked(frame.data(), total, -1, sessionMask);
+    wireStats.txFrames++;
+    xSemaphoreGiveRecursive(txMutex);
+}
+
+void BLEController::resetTxCredits()
+{
+    // Completions for notifications in flight at disconnect never arrive
+    if (txCredits)
+    {
+        while (xSemaphoreGive(txCredits) == pdTRUE)
+        {
+        }
+    }
+}
+
+// The buffer is serialised once by the caller and each session is notified
+// from it in turn; a session that drops out does not hold up the others.
+// Senders run on the BLE worker, the output task and the Lua task, so the
+// whole buffer goes out under txMutex and messages never interleave.
+void BLEController::notifyChunked(const uint8_t *data, size_t length, int trailer, uint8_t sessionMask)
+{
+    sessionMask &= subscribedMask();
+    if (!sessionMask)
+    {
+        return;
+    }
+    xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+    int64_t start = esp_timer_get_time();
+    size_t total = length + (trailer >= 0 ? 1 : 0);
+    size_t sent = 0;
+    uint16_t sendMtu = BLE_ATT_MTU_MAX;
 
-    jsonString += '\n'; // Add newline as message delimiter
+    for (uint8_t i = 0; i < BLE_MAX_SESSIONS; i++)
+    {
+        if ((sessionMask & (1 << i)) && notifySession(sessions[i], data, length, trailer))
+        {
+            sent += total;
+            sendMtu = std::min(sendMtu, (uint16_t)(sessions[i].mtu - 3));
+        }
+    }
+    if (sent == 0)
+    {
+        xSemaphoreGiveRecursive(txMutex);
+        return;
+    }
+
+    int64_t elapsed = esp_timer_get_time() - start;
+    if (elapsed > 0 && total >= sendMtu)
+    {
+        wireStats.lastThroughput = (uint32_t)((uint64_t)sent * 1000000 / elapsed);
+        linkInfo.txThroughput[linkInfo.profile] = wireStats.lastThroughput;
+    }
+    xSemaphoreGiveRecursive(txMutex);
+    noteLinkActivity(false);
+}
+
+// Notify straight from slices of the caller's buffer. Pacing comes from the
+// stack: a credit is taken per notification and returned in onStatus, and a
+// notify refused for lack of buffers is retried instead of sleeping blindly.
+// trailer >= 0 appends one byte; only the last slice is copied for it.
+// Called with txMutex held.
+bool BLEController::notifySession(BLESession &session, const uint8_t *data, size_t length, int trailer)
+{
+    uint16_t connHandle = session.connHandle;
+    size_t sendMtu = session.mtu - 3; // 3 bytes overhead
+    size_t total = length + (trailer >= 0 ? 1 : 0);
+    uint8_t tail[BLE_ATT_MTU_MAX];
 
-    int sendMtu = mtu - 3; // 3 bytes overhead
-    // INFO_PRINTLN("Sending BLE message: %s", jsonString.c_str());
-    for (size_t i = 0; i < jsonString.length(); i += sendMtu)
+    for (size_t i = 0; i < total; i += sendMtu)
     {
-        String chunk = jsonString.substring(i, std::min(i + sendMtu, jsonString.length()));
-        pTxCharacteristic->setValue((uint8_t *)chunk.c_str(), chunk.length());
-        pTxCharacteristic->notify();
-        //    delay(1); // Give the client time to process
-        delayMicroseconds(100); // Give the client time to process
+        size_t n = std::min(sendMtu, total - i);
+        const uint8_t *slice = data + i;
+        if (i + n > length) // slice carries the trailer
+        {
+            memcpy(tail, data + i, length - i);
+            tail[length - i] = (uint8_t)trailer;
+            slice = tail;
+        }
+
+        bool sent = false;
+        for (uint8_t attempt = 0; attempt < BLE_TX_MAX_RETRIES && session.subscribed; attempt++)
+        {
+            bool credit = xSemaphoreTake(txCredits, pdMS_TO_TICKS(BLE_TX_CREDIT_TIMEOUT_MS)) == pdTRUE;
+            if (!credit)
+            {
+                diagnostics.txCreditTimeouts++;
+            }
+            if (pTxCharacteristic->notify(slice, n, connHandle))
+            {
+                sent = true;
+                break;
+            }
+            if (credit)
+            {
+                xSemaphoreGive(txCredits); // nothing queued, no status will come back
+            }
+            wireStats.txRetries++;
+            vTaskDelay(1);
+        }
+        if (!sent)
+        {
+            diagnostics.txDropped++;
+            return false;
+        }
+        wireStats.txNotifies++;
+        wireStats.txBytes += n;
     }
+    return true;
 }
 
 void BLEController::registerMessageCallback(const String &msgType, std::function<void(JsonDocument &)> callback)
@@ -614,8 +1893,20 @@ BLEController::FileTransferStatus BLEController::getFileTransferStatus()
 
 void BLEController::updateFileTransferProgress(size_t bytesReceived)
 {
+    if (fileStatus.startMs == 0)
+    {
+        fileStatus.startMs = millis();
+    }
     fileStatus.bytesTransferred += bytesReceived;
-    fileStatus.progressPercentage = (fileStatus.bytesTransferred * 100) / fileStatus.totalSize;
+    uint32_t elapsed = millis() - fileStatus.startMs;
+    if (elapsed > 0)
+    {
+        fileStatus.bytesPerSecond = (uint64_t)fileStatus.bytesTransferred * 1000 / elapsed;
+        linkInfo.rxThroughput[linkInfo.profile] = fileStatus.bytesPerSecond;
+    }
+    // totalSize is the decoded size, bytesTransferred counts what crossed the link
+    size_t done = inflateState.decompressor ? fileStatus.decompressedBytes : fileStatus.bytesTransferred;
+    fileStatus.progressPercentage = (done * 100) / fileStatus.totalSize;
     // You might want to send a progress update to the client here
 }
 
@@ -639,26 +1930,84 @@ void BLEController::handleOTA(String data, uint8_t msgId)
     const char *msgtype = doc["msgtype"];
     if (strcmp(msgtype, "fileopen") == 0)
     {
-        const char *filename = doc["filename"];
+        // Inside a sync transaction uploads land in <name>.new until synccommit
+        std::string target = ManifestFile::stage(doc["filename"] | "");
+        const char *filename = target.c_str();
         size_t size = doc["filesize"];
         fileStatus.currentFileName = doc["filename"].as<String>();
         fileStatus.fileIndex = fileStatus.fileIndex;
         fileStatus.totalSize = doc["filesize"].as<size_t>();
-        LittleFSFile::ErrorCode errorCode = LittleFSFile::createFile(filename, size);
+        fileStatus.bytesTransferred = 0;
+        fileStatus.startMs = 0;
+        fileStatus.duplicateChunks = 0;
+        // {"resumable":true,"chunksize":N}: keep chunks from an earlier attempt
+        bool resumable = doc["resumable"] | false;
+        LittleFSFile::ErrorCode errorCode = resumable
+                                                ? ResumableFile::open(filename, size, doc["chunksize"] | (uint16_t)(mtu - 6))
+                                                : LittleFSFile::createFile(filename, size);
+        if (resumable && errorCode == LittleFSFile::FILE_OK)
+        {
+            fileStatus.bytesTransferred = (size_t)ResumableFile::receivedCount * ResumableFile::header.chunkSize;
+        }
+        // {"codec":"deflate"}: filesize is the decompressed size. Offsets of
+        // resumable chunks are meaningless in a compressed stream, so no mix.
+        fileStatus.decompressedBytes = 0;
+        const char *codec = doc["codec"] | "";
+        if (errorCode == LittleFSFile::FILE_OK && !beginInflate(resumable ? "" : codec))
+        {
+            LittleFSFile::closeFile();
+            errorCode = LittleFSFile::FILE_OPEN_FAILED;
+        }
+        // Optional windowed mode: {"window":16,"chunksize":509,"ackevery":8}
+        uint16_t window = doc["window"] | 0;
+        if (errorCode == LittleFSFile::FILE_OK && !resumable && window > 0 &&
+            !beginWindowTransfer(window, doc["chunksize"] | (uint16_t)(mtu - 6), doc["ackevery"] | 0))
+        {
+            LittleFSFile::closeFile();
+            errorCode = LittleFSFile::FILE_OPEN_FAILED;
+        }
         response = LittleFSFile::errorCodeToString(errorCode);
         sendResponseJsonOTA(response, msgtype, msgId);
     }
     else if (strcmp(msgtype, "fileclose") == 0)
     {
-        LittleFSFile::ErrorCode errorCode = LittleFSFile::closeFile();
+        if (!ManifestFile::syncActive)
+        {
+            ManifestFile::invalidate(fileStatus.currentFileName.c_str());
+        }
+        LittleFSFile::ErrorCode errorCode = ResumableFile::active() ? ResumableFile::close() : LittleFSFile::closeFile();
+        endWindowTransfer();
+        endInflate();
         resetFileTransferStatus();
         fileStatus.fileIndex++;
         response = LittleFSFile::errorCodeToString(errorCode);
         sendResponseJsonOTA(response, msgtype, msgId);
     }
+    else if (strcmp(msgtype, "fileresume") == 0)
+    {
+        // Missing chunk ranges of a resumable upload, also after a reboot
+        std::string filename = ManifestFile::stage(doc["filename"] | "");
+        LittleFSFile::ErrorCode errorCode = ResumableFile::reopen(filename);
+        if (errorCode != LittleFSFile::FILE_OK)
+        {
+            sendResponseJsonOTA(LittleFSFile::errorCodeToString(errorCode), msgtype, msgId);
+            return;
+        }
+        ResumableFile::flushJournal();
+
+        JsonDocument responseDoc;
+        responseDoc["filesize"] = ResumableFile::header.totalSize;
+        responseDoc["chunksize"] = ResumableFile::header.chunkSize;
+        responseDoc["chunks"] = ResumableFile::header.chunkCount;
+        responseDoc["received"] = ResumableFile::receivedCount;
+        ResumableFile::missingRanges(responseDoc["missing"].to<JsonArray>(), OTA_RESUME_MAX_RANGES);
+        serializeJson(responseDoc, response);
+        sendResponseJsonOTA(response, msgtype, msgId);
+    }
     else if (strcmp(msgtype, "filedelete") == 0)
     {
         const char *filename = doc["filename"];
+        ManifestFile::invalidate(filename);
         LittleFSFile::ErrorCode errorCode = LittleFSFile::deleteFile(filename);
         response = LittleFSFile::errorCodeToString(errorCode);
         sendResponseJsonOTA(response, msgtype, msgId);
@@ -667,6 +2016,8 @@ void BLEController::handleOTA(String data, uint8_t msgId)
     {
         const char *oldFilename = doc["oldfilename"];
         const char *newFilename = doc["newfilename"];
+        ManifestFile::invalidate(oldFilename);
+        ManifestFile::invalidate(newFilename);
         LittleFSFile::ErrorCode errorCode = LittleFSFile::renameFile(oldFilename, newFilename);
         response = LittleFSFile::errorCodeToString(errorCode);
         sendResponseJsonOTA(response, msgtype, msgId);
@@ -693,14 +2044,55 @@ void BLEController::handleOTA(String data, uint8_t msgId)
             sendResponseJsonOTA(errorStr, msgtype, msgId);
         }
     }
+    else if (strcmp(msgtype, "filemanifest") == 0)
+    {
+        // Like filelist, plus a cached SHA-256 per file for incremental sync
+        JsonDocument responseDoc;
+        LittleFSFile::ErrorCode errorCode = ManifestFile::list(responseDoc["fileList"].to<JsonArray>());
+        if (errorCode == LittleFSFile::FILE_OK)
+        {
+            responseDoc["msgtype"] = msgtype;
+            responseDoc["response"] = "OK";
+            serializeJson(responseDoc, response);
+        }
+        else
+        {
+            response = LittleFSFile::errorCodeToString(errorCode);
+        }
+        sendResponseJsonOTA(response, msgtype, msgId);
+    }
+    else if (strcmp(msgtype, "syncbegin") == 0)
+    {
+        // {"msgtype":"syncbegin","delete":["/old.lua"]}, then fileopen/fileclose per changed file
+        ManifestFile::begin(doc["delete"].as<JsonArray>());
+        sendResponseJsonOTA(LittleFSFile::errorCodeToString(LittleFSFile::FILE_OK), msgtype, msgId);
+    }
+    else if (strcmp(msgtype, "synccommit") == 0)
+    {
+        LittleFSFile::ErrorCode errorCode = ManifestFile::commit();
+        sendResponseJsonOTA(LittleFSFile::errorCodeToString(errorCode), msgtype, msgId);
+    }
+    else if (strcmp(msgtype, "syncabort") == 0)
+    {
+        ManifestFile::rollback();
+        sendResponseJsonOTA(LittleFSFile::errorCodeToString(LittleFSFile::FILE_OK), msgtype, msgId);
+    }
 
     else if (strcmp(msgtype, "formatLittleFS") == 0)
     {
-        esp_task_wdt_delete(NULL);
+        // Only re-subscribe a task that was watched before; the worker task is not
+        bool watched = esp_task_wdt_status(NULL) == ESP_OK;
+        if (watched)
+        {
+            esp_task_wdt_delete(NULL);
+        }
         LittleFSFile::ErrorCode errorCode = LittleFSFile::formatFS();
         response = LittleFSFile::errorCodeToString(errorCode);
         sendResponseJsonOTA(response, msgtype, msgId);
-        esp_task_wdt_add(NULL);
+        if (watched)
+        {
+            esp_task_wdt_add(NULL);
+        }
     }
     else if (strcmp(msgtype, "initLittleFS") == 0)
     {
@@ -708,6 +2100,30 @@ void BLEController::handleOTA(String data, uint8_t msgId)
         response = LittleFSFile::errorCodeToString(errorCode);
         sendResponseJsonOTA(response, msgtype, msgId);
     }
+    else if (strcmp(msgtype, "otaupdate") == 0 && (doc["stream"] | false))
+    {
+        // {"msgtype":"otaupdate","stream":true,"filesize":N,"sha256":"<hex>","window":16}
+        // Image chunks follow as 0x02 or windowed 0x03 messages, straight into flash
+        size_t size = doc["filesize"] | 0;
+        resetFileTransferStatus();
+        fileStatus.totalSize = size;
+        bool success = beginStreamOta(size, doc["sha256"] | "");
+        if (success && !beginInflate(doc["codec"] | ""))
+        {
+            abortStreamOta();
+            otaStream.error = "Unsupported codec";
+            success = false;
+        }
+        uint16_t window = doc["window"] | 0;
+        if (success && window > 0 &&
+            !beginWindowTransfer(window, doc["chunksize"] | (uint16_t)(mtu - 6), doc["ackevery"] | 0))
+        {
+            abortStreamOta();
+            otaStream.error = "Out of memory";
+            success = false;
+        }
+        sendResponseJsonOTA(success ? "OTA_STREAM_READY" : otaStream.error, msgtype, msgId);
+    }
     else if (strcmp(msgtype, "otaupdate") == 0)
     {
         const char *filename = doc["filename"];
@@ -771,6 +2187,11 @@ void BLEController::setOnDisconnectCallback(std::function<void()> callback)
     // bleController.switchToJsonMode();
 }
 
+void BLEController::setOnMtuChangeCallback(std::function<void(uint16_t minMtu)> callback)
+{
+    onMtuChangeCallback = callback;
+}
+
 void BLEController::stop()
 {
 
@@ -834,6 +2255,7 @@ void BLEController::stop()
     highPriorityCallbacks.clear();
     onConnectCallback = nullptr;
     onDisconnectCallback = nullptr;
+    onMtuChangeCallback = nullptr;
     otaStartCallback = nullptr;
     otaProgressCallback = nullptr;
     otaSuccessCallback = nullptr;
@@ -844,6 +2266,17 @@ void BLEController::stop()
 
     // Reset all state variables
     deviceConnected = false;
+    connectedCount = 0;
+    rxSession = nullptr;
+    scriptSession = -1;
+    for (BLESession &session : sessions)
+    {
+        session.connHandle = BLE_HS_CONN_HANDLE_NONE;
+        session.subscribed = false;
+        session.textBuffer.clear();
+        session.receivedData.clear();
+        session.frameBuffer.clear();
+    }
     isBlockingOperationRunning = false;
     currentBatteryLevel = 0;
     memset(currentSWVersion, 0, sizeof(currentSWVersion));
@@ -861,53 +2294,106 @@ void BLEController::stop()
     // INFO_PRINTLN("BLEController::stop() complete");
 }
 
+// A script switching modes only affects the central that sent it
+uint8_t BLEController::modeTargetMask()
+{
+    int8_t index = scriptSession;
+    return index >= 0 ? 1 << index : BLE_ALL_SESSIONS;
+}
+
+void BLEController::applyTextMode(bool textMode)
+{
+    uint8_t mask = modeTargetMask();
+    if (mask == BLE_ALL_SESSIONS)
+    {
+        defaultTextMode = textMode;
+    }
+    for (uint8_t i = 0; i < BLE_MAX_SESSIONS; i++)
+    {
+        if (mask & (1 << i))
+        {
+            sessions[i].textMode = textMode;
+            sessions[i].executeTextBufferFlag = false;
+            sessions[i].textBuffer.clear();
+        }
+    }
+}
+
 void BLEController::switchToTextMode()
 {
-    TextMode = true;
-    executeTextBufferFlag = false;
-    TextBuffer.clear();
-    sendMessage("Entered Text mode. Use Control-D to execute.");
+    applyTextMode(true);
+    String text = "Entered Text mode. Use Control-D to execute.";
+    uint8_t mask = modeTargetMask();
+    notifyChunked((const uint8_t *)text.c_str(), text.length(), '\n', mask & subscribedMask(WIRE_FORMAT_JSON));
+    sendFrame(FRAME_TYPE_TEXT, (const uint8_t *)text.c_str(), text.length(), mask & subscribedMask(WIRE_FORMAT_MSGPACK));
 
     // Register BLE-specific Text functions
 }
 
 void BLEController::switchToJsonMode()
 {
-    TextMode = false;
-    TextBuffer.clear();
+    applyTextMode(false);
     JsonDocument doc;
     doc["msgtyp"] = "jsonmode";
-    sendMessage(doc);
+    sendMessageTo(doc, modeTargetMask());
 }
 
-void BLEController::executeTextBuffer()
+void BLEController::executeTextBuffer(BLESession &session)
 {
     textBufferIsExecuting = true;
-    if (TextMessageCallback != nullptr)
+    scriptSession = &session - sessions;
+    if (TextExecuteCallback != nullptr)
+    {
+        TextExecuteCallback(session.textBuffer.data(), session.textBuffer.length());
+    }
+    else if (TextMessageCallback != nullptr)
     {
-        TextMessageCallback(TextBuffer.c_str());
+        TextMessageCallback(session.textBuffer.c_str());
     }
 
     textBufferIsExecuting = false;
-    executeTextBufferFlag = false;
+    session.executeTextBufferFlag = false;
 
-    TextBuffer.clear();
+    session.textBuffer.clear();
 }
 
 void BLEController::sendTextOutput(const std::string &_output)
 {
-    String output = _output.c_str();
-    output = output + '\n';
-    int sendMtu = mtu - 3; // 3 bytes overhead
-    // INFO_PRINTLN("Sending BLE message: %s", output.c_str());
-    for (size_t i = 0; i < output.length(); i += sendMtu)
+    notifyChunked((const uint8_t *)_output.data(), _output.length(), '\n');
+}
+
+void BLEController::sendRawText(const char *data, size_t length)
+{
+    uint8_t packMask = subscribedMask(WIRE_FORMAT_MSGPACK);
+    if (packMask)
+    {
+        sendFrame(FRAME_TYPE_TEXT, (const uint8_t *)data, length, packMask);
+    }
+    notifyChunked((const uint8_t *)data, length, -1, subscribedMask(WIRE_FORMAT_JSON));
+}
+
+// The stack notifies each subscribed connection from the same buffer, so the
+// frame has to fit the smallest MTU
+bool BLEController::notifyStream(const uint8_t *data, size_t length)
+{
+    if (!deviceConnected || !pStreamCharacteristic || length > (size_t)(getMinMtu() - 3))
+    {
+        return false;
+    }
+    xSemaphoreTakeRecursive(txMutex, portMAX_DELAY);
+    bool sent = pStreamCharacteristic->notify(data, length);
+    if (sent)
     {
-        String chunk = output.substring(i, std::min(i + sendMtu, output.length()));
-        pTxCharacteristic->setValue((uint8_t *)chunk.c_str(), chunk.length());
-        pTxCharacteristic->notify();
-        //    delay(1); // Give the client time to process
-        delayMicroseconds(100); // Give the client time to process
+        wireStats.txNotifies++;
+        wireStats.txBytes += length;
     }
+    xSemaphoreGiveRecursive(txMutex);
+    if (!sent)
+    {
+        return false;
+    }
+    noteLinkActivity(true); // a running stream is a bulk transfer
+    return true;
 }
 
 bool BLEController::transferFileFromLittleFS(const char *filename, uint16_t mtu)
@@ -916,6 +2402,7 @@ bool BLEController::transferFileFromLittleFS(const char *filename, uint16_t mtu)
     {
         return false;
     }
+    noteLinkActivity(true);
 
     File file = LittleFS.open(filename, "r");
     if (!file)
@@ -935,9 +2422,7 @@ bool BLEController::transferFileFromLittleFS(const char *filename, uint16_t mtu)
             break;
         }
 
-        pTxCharacteristic->setValue(buffer, bytesRead);
-        pTxCharacteristic->notify();
-        delay(20);
+        notifyChunked(buffer, bytesRead);
     }
 
     file.close();
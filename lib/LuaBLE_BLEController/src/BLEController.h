@@ -6,19 +6,26 @@
 #include <NimBLEDevice.h>
 #include <ArduinoJson.h>
 #include <queue>
+#include <vector>
 #include <string>
 #include <functional>
 #include <map>
 #include "esp_ota_ops.h"
+#include "mbedtls/sha256.h"
 // #include "config.h"
 #include "LittleFS.h"               // switched from SPIFFS to LittleFS  #include "SPIFFS.h" 
 #include "FFat.h"
 #include "littlefsfile.h"
+#include "resumablefile.h"
+#include "manifestfile.h"
+#include "bleframe.h"
+#include "inflatewindow.h"
 #include <Update.h>
 
 #define BLE_SERVICE_UUID "6e400001-b5a3-f393-e0a9-e50e24dcca9e"
 #define BLE_UUID_TX "6e400003-b5a3-f393-e0a9-e50e24dcca9e"
 #define BLE_UUID_RX "6e400002-b5a3-f393-e0a9-e50e24dcca9e"
+#define BLE_UUID_STREAM "6e400004-b5a3-f393-e0a9-e50e24dcca9e" // binary telemetry, notify only
 
 #define BATTERY_SERVICE_UUID "180f"
 
@@ -32,10 +39,185 @@
 
 #define BLE_NAME_LENGTH 20
 
+// Worker mode: NimBLE callbacks only copy each write into a preallocated slot
+// queue; one worker task owns every receive buffer and runs the handlers
+#ifndef BLE_RX_QUEUE_DEPTH
+#define BLE_RX_QUEUE_DEPTH 32
+#endif
+#define BLE_RX_SLOT_SIZE 512            // largest attribute write
+#define BLE_RX_ENQUEUE_WAIT_MS 20       // host task never blocks longer on a full queue
+#define BLE_WORKER_STACK_SIZE 8192
+
+enum BLERxSource : uint8_t
+{
+    RX_SOURCE_MAIN = 0,  // Nordic UART RX characteristic
+    RX_SOURCE_OTA,       // OTA characteristic
+    RX_EVENT_CONNECT,    // open a session for the connection
+    RX_EVENT_DISCONNECT, // link dropped, close the connection's session
+    RX_EVENT_SUBSCRIBE,  // data: CCCD value, u16 LE
+    RX_EVENT_MTU,        // data: negotiated MTU, u16 LE
+    RX_EVENT_POLL,       // wake the worker for the poll callback, no data
+};
+
+// Centrals connected at once, each with its own session. Must not exceed
+// CONFIG_BT_NIMBLE_MAX_CONNECTIONS.
+#ifndef BLE_MAX_SESSIONS
+#define BLE_MAX_SESSIONS 3
+#endif
+#define BLE_ALL_SESSIONS 0xFF // session mask: every subscribed session
+
+// Link profiles, connection interval in 1.25 ms units. BULK keeps iOS's 15 ms
+// floor; IDLE uses slave latency so the radio skips most empty events.
+#define BLE_LINK_BULK_MIN_INTERVAL 12   // 15 ms
+#define BLE_LINK_BULK_MAX_INTERVAL 24   // 30 ms
+#define BLE_LINK_BULK_LATENCY 0
+#define BLE_LINK_BULK_TIMEOUT 400       // 4 s, 10 ms units
+#define BLE_LINK_IDLE_MIN_INTERVAL 48   // 60 ms
+#define BLE_LINK_IDLE_MAX_INTERVAL 96   // 120 ms
+#define BLE_LINK_IDLE_LATENCY 4
+#define BLE_LINK_IDLE_TIMEOUT 600       // 6 s
+#define BLE_LINK_IDLE_AFTER_MS 3000     // quiet time before BULK drops to IDLE
+#define BLE_LINK_DATA_LEN 251           // LL payload with Data Length Extension
+
+enum BLELinkProfile : uint8_t
+{
+    LINK_PROFILE_IDLE = 0,
+    LINK_PROFILE_BULK,
+    LINK_PROFILE_COUNT
+};
+
+struct BLELinkInfo
+{
+    uint16_t connHandle;
+    uint8_t txPhy;             // 1 = 1M, 2 = 2M, 3 = Coded
+    uint8_t rxPhy;
+    uint16_t mtu;
+    uint16_t interval;         // 1.25 ms units, as negotiated
+    uint16_t latency;
+    uint16_t timeout;          // 10 ms units
+    BLELinkProfile profile;
+    bool autoProfile;          // BULK on transfers, IDLE after BLE_LINK_IDLE_AFTER_MS
+    uint32_t lastActivityMs;
+    uint32_t txThroughput[LINK_PROFILE_COUNT]; // bytes/s, last multi-notify send
+    uint32_t rxThroughput[LINK_PROFILE_COUNT]; // bytes/s, last completed upload
+};
+
+struct BLERxSlot
+{
+    uint8_t source;
+    uint16_t connHandle;
+    uint16_t length;
+    uint32_t rxUs;      // arrival time, low 32 bits of esp_timer
+    uint8_t data[BLE_RX_SLOT_SIZE];
+};
+
+// Windowed upload on the OTA characteristic: one write-without-response per
+// chunk, [0x03][seq lo][seq hi][payload], no 0x04 terminator. The device acks
+// with [0x03][next seq lo][next seq hi][sack bitmap u32 LE][0x04], where bit i
+// marks seq next+i as already buffered.
+#define OTA_MSG_WINDOW_CHUNK 0x03
+#define OTA_WINDOW_MAX 32
+#define OTA_WINDOW_DEFAULT_ACK_EVERY 8
+
+// Resumable upload chunk, one write each: [0x04][index lo][index hi][payload]
+#define OTA_MSG_RESUME_CHUNK 0x04
+#define OTA_RESUME_MAX_RANGES 32
+
+// Streaming firmware update: chunks fill one flash-sector buffer while the
+// writer task programs the other
+#define OTA_STREAM_BUFFER_SIZE 4096
+
 #ifndef BLE_PRODUCT_UUID
 #define BLE_PRODUCT_UUID "AE05"
 #endif
 
+// Notifications allowed in flight before waiting for completions
+#ifndef BLE_TX_CREDITS
+#define BLE_TX_CREDITS 8
+#endif
+#define BLE_TX_CREDIT_TIMEOUT_MS 50
+#define BLE_TX_MAX_RETRIES 50
+#define BLE_ATT_MTU_MAX 512
+
+enum BLEWireFormat : uint8_t
+{
+    WIRE_FORMAT_JSON = 0,    // newline-delimited JSON
+    WIRE_FORMAT_MSGPACK = 1, // framed MessagePack
+};
+
+// Per-connection state: each central reassembles its own writes and picks
+// its own mode and wire format. Connection events travel through the receive
+// queue, so only the worker opens and closes sessions.
+struct BLESession
+{
+    uint16_t connHandle;   // BLE_HS_CONN_HANDLE_NONE while the slot is free
+    uint16_t mtu;
+    bool subscribed;       // notifications enabled on the TX characteristic
+    bool textMode;
+    bool executeTextBufferFlag;
+    BLEWireFormat wireFormat;
+    std::string textBuffer;
+    std::string receivedData;
+    std::string frameBuffer;
+};
+
+struct BLEWireStats
+{
+    uint32_t rxFrames;
+    uint32_t txFrames;
+    uint32_t crcErrors;
+    uint32_t decodeErrors;
+    uint32_t txNotifies;
+    uint32_t txRetries;       // notify refused by the stack (out of buffers)
+    uint64_t txBytes;
+    uint32_t lastThroughput;  // bytes/s of the last multi-notification send
+    uint32_t rxDropped;       // writes lost to a full worker queue
+};
+
+// Latency histogram: bucket 0 is < 250 us, each next bucket doubles the
+// limit, the last one is open ended (>= 256 ms)
+#define BLE_HIST_BUCKETS 12
+#define BLE_HIST_FIRST_LIMIT_US 250
+
+struct BLELatencyHistogram
+{
+    uint32_t buckets[BLE_HIST_BUCKETS];
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t sumUs;
+
+    void add(uint32_t us)
+    {
+        uint8_t bucket = 0;
+        for (uint32_t limit = BLE_HIST_FIRST_LIMIT_US; us >= limit && bucket < BLE_HIST_BUCKETS - 1; limit <<= 1)
+        {
+            bucket++;
+        }
+        buckets[bucket]++;
+        count++;
+        sumUs += us;
+        if (us > maxUs)
+        {
+            maxUs = us;
+        }
+    }
+};
+
+// Link and pipeline diagnostics since the last reset, next to BLEWireStats
+struct BLEDiagnostics
+{
+    uint32_t resetMs;
+    uint32_t rxWrites;
+    uint64_t rxBytes;
+    uint32_t txCreditTimeouts;          // waited a full credit timeout: link congested
+    uint32_t txDropped;                 // notification given up after all retries
+    uint16_t maxMessageQueue;
+    uint16_t maxOtaQueue;
+    uint16_t maxRxQueue;
+    BLELatencyHistogram execLatency;    // \x04 received -> script starts on the Lua task
+    BLELatencyHistogram otaAckLatency;  // OTA chunk received -> response notified
+};
+
 class BLEController
 {
 public:
@@ -51,6 +233,9 @@ public:
     void setCharacteristicUUIDs(const char *txUuid, const char *rxUuid);
     void setOnConnectCallback(std::function<void()> callback);
     void setOnDisconnectCallback(std::function<void()> callback);
+    // Called with getMinMtu() whenever a connection opens, closes or
+    // negotiates a new MTU
+    void setOnMtuChangeCallback(std::function<void(uint16_t minMtu)> callback);
     void setOtaCallbacks(std::function<void()> startCallback,
                          std::function<void(int)> progressCallback,
                          std::function<void()> successCallback,
@@ -70,16 +255,64 @@ public:
 
     void stop();
 
+    // Handle all received data on a dedicated task that sleeps until a write
+    // arrives; the process* functions then no longer need to be polled
+    bool startWorker(UBaseType_t priority = 2, BaseType_t core = 1);
+
+    // Connection parameters for the current link; manual selection turns the
+    // automatic BULK/IDLE switching off until the next connection
+    void setLinkProfile(BLELinkProfile profile, bool manual = true);
+    void setLinkAuto(bool enabled) { linkInfo.autoProfile = enabled; }
+    BLELinkInfo getLinkInfo() { return linkInfo; }
+    void linkInfoToJson(JsonDocument &doc);
+    static const char *linkProfileName(BLELinkProfile profile);
+
     String getMacAddress();
 
     void sendTextOutput(const std::string &output);
+    void sendRawText(const char *data, size_t length); // no delimiter added
+    // One notification on the telemetry characteristic; false if the stack
+    // has no room or nobody subscribed. Never waits for transmit credits.
+    bool notifyStream(const uint8_t *data, size_t length);
+    // Called from a script: only the session that sent it switches. Otherwise
+    // every session switches, and new connections start in that mode.
     void switchToTextMode();
     void switchToJsonMode();
+
+    // Connected centrals, and the smallest MTU among them (what a single
+    // payload must fit to reach every session)
+    uint8_t getSessionCount() { return connectedCount; }
+    uint16_t getMinMtu();
+
+    // Per connection; reset to JSON on disconnect. Clients can also switch
+    // with {"msgtyp":"wire","format":"msgpack"|"json"} in either format.
+    // Applies to the session whose message is being handled.
+    void setWireFormat(BLEWireFormat format);
+    BLEWireFormat getWireFormat();
+    BLEWireStats getWireStats() { return wireStats; }
+
+    // {"msgtyp":"diag"} answers with diagnosticsToJson, "reset":true clears first.
+    // The extra callback lets the application add its own sections.
+    BLEDiagnostics getDiagnostics() { return diagnostics; }
+    void diagnosticsToJson(JsonDocument &doc);
+    void resetDiagnostics();
+    void setDiagnosticsCallback(std::function<void(JsonDocument &)> callback)
+    {
+        diagnosticsCallback = callback;
+    }
+    // Called by the Lua task when a script submitted through text mode starts
+    void recordExecStart();
     void setTextMessageCallback(std::function<void(String)> callback)
     {
         TextMessageCallback = callback;
     }
 
+    // Preferred over the String callback: hands out the text buffer in place, no copy
+    void setTextExecuteCallback(std::function<void(const char *, size_t)> callback)
+    {
+        TextExecuteCallback = callback;
+    }
+
     void setTextAbortCallback(std::function<void(String)> callback)
     {
         TextAbortCallback = callback;
@@ -88,9 +321,24 @@ public:
     {
         TextQueueCallback = callback;
     }
+
+    // Preferred over the String callback: raw payload including the \x02 marker
+    void setTextQueueDataCallback(std::function<void(const char *, size_t)> callback)
+    {
+        TextQueueDataCallback = callback;
+    }
+
+    // Work other tasks hand to the receive side: runs on the worker, or from
+    // loop() while it polls, and never anywhere else
+    void setPollCallback(std::function<void()> callback)
+    {
+        PollCallback = callback;
+    }
+    void requestPoll();
     void handleOTA(String data, uint8_t msgId);
     void receiveOTA(const std::string &pData);
     void processOTAData();
+    void processOTAMessage(const std::string &data);
     void sendResponseBinaryOTA(byte data, uint8_t msgId);
     void sendResponseJsonOTA(String data, String msgtype, uint8_t msgId);
     void sendmsgOTA(String str);
@@ -113,6 +361,10 @@ public:
         size_t totalSize;
         size_t bytesTransferred;
         int progressPercentage;
+        uint32_t startMs;
+        uint32_t bytesPerSecond;
+        uint32_t duplicateChunks; // windowed mode: retransmits already received
+        size_t decompressedBytes; // compressed mode: output written so far
     };
 
     FileTransferStatus getFileTransferStatus();
@@ -150,6 +402,7 @@ private:
     BLECharacteristic *pTxCharacteristic;
     BLECharacteristic *pRxCharacteristic;
     BLECharacteristic *pBatCharacteristic;
+    BLECharacteristic *pStreamCharacteristic;
     BLECharacteristic *otaTX;
     BLECharacteristic *otaRX;
     //     static BLECharacteristic *otaTX;
@@ -160,37 +413,71 @@ private:
 
     std::function<void()> onConnectCallback;
     std::function<void()> onDisconnectCallback;
+    std::function<void(uint16_t)> onMtuChangeCallback;
     std::function<void()> otaStartCallback;
     std::function<void(int)> otaProgressCallback;
     std::function<void()> otaSuccessCallback;
     std::function<void(const char *)> otaErrorCallback;
     std::function<void(String)> TextMessageCallback;
+    std::function<void(const char *, size_t)> TextExecuteCallback;
     std::function<void(String)> TextAbortCallback;
     std::function<void(String)> TextQueueCallback;
+    std::function<void(const char *, size_t)> TextQueueDataCallback;
+    std::function<void()> PollCallback;
+    volatile bool pollRequested;
 
     void setManufacturerData(BLEAdvertisementData &adData);
     void startAdvertising();
     void initOTA();
     void handleReceivedMessage(const std::string &message);
+    void handleReceivedFrames(const std::string &message);
+    void dispatchMessage(JsonDocument &doc);
+    void sendMessageTo(const JsonDocument &message, uint8_t sessionMask);
+    void sendFrame(BLEFrameType type, const uint8_t *payload, size_t length, uint8_t sessionMask);
+    void sendMsgPack(const JsonDocument &message, uint8_t sessionMask);
+    // Fan-out: the same bytes go to every subscribed session in the mask,
+    // sliced to each connection's own MTU
+    void notifyChunked(const uint8_t *data, size_t length, int trailer = -1,
+                       uint8_t sessionMask = BLE_ALL_SESSIONS);
+    bool notifySession(BLESession &session, const uint8_t *data, size_t length, int trailer);
+    void resetTxCredits();
     void processHighPriorityMessage(Message &msg);
-    void handleMtuChange(uint16_t newMtu);
+    void handleMtuChange(BLESession *session, uint16_t newMtu);
+    void reportMinMtu();
 
     class ServerCallbacks;
     class CharCallbacks;
     class OtaCallbacks;
+    class TxCallbacks;
     ServerCallbacks *serverCallbacks;
     int currentBatteryLevel;
     uint8_t currentSWVersion[3];
     uint8_t currentHWVersion[3];
     esp_ota_handle_t otaHandler;
-    std::string receivedData;
 
-    bool TextMode;
-    std::string TextBuffer;
+    BLESession sessions[BLE_MAX_SESSIONS];
+    volatile uint8_t connectedCount;
+    BLESession *rxSession;        // session whose write is being handled
+    volatile int8_t scriptSession; // session that started the running script, -1 none
+    bool defaultTextMode;         // mode new sessions start in
+    BLESession *findSession(uint16_t connHandle);
+    BLESession *openSession(uint16_t connHandle);
+    void closeSession(uint16_t connHandle);
+    uint8_t sessionBit(const BLESession *session);
+    uint8_t subscribedMask(int wireFormat = -1);
+    uint8_t modeTargetMask();
+    void applyTextMode(bool textMode);
+
+    uint8_t txSeq;
+    SemaphoreHandle_t txCredits;
+    // Recursive: frames are sealed and sent under it, and sending a frame
+    // goes through notifyChunked, which takes it for callers sending raw
+    SemaphoreHandle_t txMutex;
+    BLEWireStats wireStats;
+
     std::queue<std::string> TextOutputQueue;
     bool textBufferIsExecuting;
-    bool executeTextBufferFlag;
-    void executeTextBuffer();
+    void executeTextBuffer(BLESession &session);
 
     // File transfer tracking
     FileTransferStatus fileStatus;
@@ -202,6 +489,84 @@ private:
     void handleFileOpen(JsonDocument &doc);
     void handleFileWrite(JsonDocument &doc);
     void handleFileClose(JsonDocument &doc);
+
+    // Windowed upload receiver: out-of-order chunks wait in slots until the
+    // gap before them is filled, then everything is written in order
+    struct WindowRx
+    {
+        bool active;
+        uint16_t window;    // power of two, <= OTA_WINDOW_MAX
+        uint16_t ackEvery;
+        uint16_t chunkSize;
+        uint16_t nextSeq;   // next seq to be written
+        uint32_t received;  // bit i: seq nextSeq + i is buffered
+        uint16_t sinceAck;
+        bool gapAcked;
+        uint8_t *slots;
+        uint16_t slotLen[OTA_WINDOW_MAX];
+    };
+    WindowRx windowRx;
+    SemaphoreHandle_t otaQueueMutex;
+
+    BLEDiagnostics diagnostics;
+    std::function<void(JsonDocument &)> diagnosticsCallback;
+    uint32_t currentRxUs;             // arrival of the write being handled
+    volatile uint32_t execRequestUs;  // \x04 arrival, 0 when none pending
+    uint32_t otaChunkRxUs;            // last OTA message awaiting a response
+    void recordOtaAck();
+
+    BLELinkInfo linkInfo;
+    void onLinkConnected(uint16_t connHandle);
+    void noteLinkActivity(bool transfer);
+    void checkLinkIdle();
+
+    QueueHandle_t rxQueue;
+    TaskHandle_t workerTask;
+    BLERxSlot rxSlot; // worker-owned copy of the slot being handled
+    void enqueueRx(BLERxSource source, uint16_t connHandle, const std::string &data);
+    void handleRxSlot();
+    static void workerTaskFn(void *param);
+    bool beginWindowTransfer(uint16_t window, uint16_t chunkSize, uint16_t ackEvery);
+    void endWindowTransfer();
+    void handleWindowChunk(const std::string &data);
+    void sendWindowAck();
+    void handleResumeChunk(const std::string &data);
+
+    // Direct-to-partition firmware update, written through otaHandler
+    struct OtaStream
+    {
+        bool active;
+        const esp_partition_t *partition;
+        size_t size;
+        size_t received;
+        bool verify;
+        uint8_t expectedSha[32];
+        mbedtls_sha256_context sha;
+        uint8_t *buffers[2];
+        size_t fill[2];
+        uint8_t current;
+        int lastPercent;
+        volatile esp_err_t writeError;
+        const char *error;
+    };
+    OtaStream otaStream;
+    QueueHandle_t otaFullQueue;  // buffer indices ready to be programmed
+    QueueHandle_t otaFreeQueue;  // buffer indices free to be filled
+    TaskHandle_t otaWriterTask;
+    static void otaWriterTaskFn(void *param);
+    bool beginStreamOta(size_t size, const char *sha256Hex);
+    LittleFSFile::ErrorCode writeStreamOta(const uint8_t *data, size_t length);
+    bool finishStreamOta();
+    void abortStreamOta();
+    void completeStreamOta(LittleFSFile::ErrorCode errorCode);
+    bool drainStreamOta();
+    LittleFSFile::ErrorCode writeTransferChunk(const uint8_t *data, size_t length);
+    LittleFSFile::ErrorCode writeDecodedChunk(const uint8_t *data, size_t length);
+
+    InflateWindow inflateState;
+    bool beginInflate(const char *codec);
+    void endInflate();
+    LittleFSFile::ErrorCode inflateChunk(const uint8_t *data, size_t length);
 };
 
 extern BLEController bleController;
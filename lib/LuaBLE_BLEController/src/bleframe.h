@@ -0,0 +1,153 @@
+#ifndef BLEFRAME_H
+#define BLEFRAME_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// Binary framing on the UART characteristic, little-endian:
+// [sync][type][seq][len lo][len hi][payload ...][crc lo][crc hi]
+// CRC-16/CCITT-FALSE covers type..payload. Payload is MessagePack.
+// No Arduino dependencies, so the framing is tested on the host.
+#define BLE_FRAME_SYNC 0xB5
+#define BLE_FRAME_HEADER_SIZE 5
+#define BLE_FRAME_CRC_SIZE 2
+#ifndef BLE_FRAME_MAX_PAYLOAD
+#define BLE_FRAME_MAX_PAYLOAD 4096
+#endif
+
+enum BLEFrameType : uint8_t
+{
+    FRAME_TYPE_MSG = 0x01,  // MessagePack map carrying "msgtyp"
+    FRAME_TYPE_TEXT = 0x02, // raw text output
+    FRAME_TYPE_NACK = 0x03, // payload: seq of the rejected frame
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), bitwise: frames are small
+inline uint16_t crc16_ccitt(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Fill in header and trailing CRC around a payload already at frame + HEADER
+inline size_t seal_frame(uint8_t *frame, uint8_t type, uint8_t seq, uint16_t length)
+{
+    frame[0] = BLE_FRAME_SYNC;
+    frame[1] = type;
+    frame[2] = seq;
+    frame[3] = length & 0xFF;
+    frame[4] = length >> 8;
+    uint16_t crc = crc16_ccitt(frame + 1, BLE_FRAME_HEADER_SIZE - 1 + length);
+    frame[BLE_FRAME_HEADER_SIZE + length] = crc & 0xFF;
+    frame[BLE_FRAME_HEADER_SIZE + length + 1] = crc >> 8;
+    return BLE_FRAME_HEADER_SIZE + length + BLE_FRAME_CRC_SIZE;
+}
+
+enum BLEFrameStatus : uint8_t
+{
+    FRAME_INCOMPLETE,  // wait for more bytes
+    FRAME_COMPLETE,    // frame at the head of the buffer; erase frame.total when done
+    FRAME_BAD_LENGTH,  // sync byte dropped, scan again
+    FRAME_BAD_CRC,     // sync byte dropped, frame.seq names the rejected frame
+};
+
+struct BLEFrame
+{
+    uint8_t type;
+    uint8_t seq;
+    uint16_t length;
+    const uint8_t *payload; // points into the buffer
+    size_t total;
+};
+
+// Look for the next frame in a reassembly buffer. Bytes before a sync byte
+// are discarded; a rejected frame only loses its sync byte so the scan
+// resyncs on the next one.
+inline BLEFrameStatus ble_frame_next(std::string &buffer, BLEFrame &frame)
+{
+    size_t sync = buffer.find((char)BLE_FRAME_SYNC);
+    if (sync == std::string::npos)
+    {
+        buffer.clear();
+        return FRAME_INCOMPLETE;
+    }
+    if (sync > 0)
+    {
+        buffer.erase(0, sync);
+    }
+    if (buffer.size() < BLE_FRAME_HEADER_SIZE)
+    {
+        return FRAME_INCOMPLETE;
+    }
+
+    const uint8_t *data = (const uint8_t *)buffer.data();
+    frame.type = data[1];
+    frame.seq = data[2];
+    frame.length = data[3] | (data[4] << 8);
+    if (frame.length > BLE_FRAME_MAX_PAYLOAD)
+    {
+        buffer.erase(0, 1);
+        return FRAME_BAD_LENGTH;
+    }
+    frame.total = BLE_FRAME_HEADER_SIZE + frame.length + BLE_FRAME_CRC_SIZE;
+    if (buffer.size() < frame.total)
+    {
+        return FRAME_INCOMPLETE;
+    }
+
+    uint16_t crc = data[frame.total - 2] | (data[frame.total - 1] << 8);
+    if (crc != crc16_ccitt(data + 1, BLE_FRAME_HEADER_SIZE - 1 + frame.length))
+    {
+        buffer.erase(0, 1);
+        return FRAME_BAD_CRC;
+    }
+    frame.payload = data + BLE_FRAME_HEADER_SIZE;
+    return FRAME_COMPLETE;
+}
+
+// Which stream a write from one connection belongs to. Frames are recognised
+// by the sync byte whatever format the connection selected; JSON never starts
+// with it, but a JSON line under way can continue with it (0xB5 is the second
+// byte of "µ" in UTF-8), so it keeps going until its newline.
+inline bool ble_frame_routed(const std::string &frameBuffer, const std::string &jsonLine, const std::string &message)
+{
+    return !frameBuffer.empty() ||
+           (jsonLine.empty() && !message.empty() && (uint8_t)message[0] == BLE_FRAME_SYNC);
+}
+
+// Append one write to a connection's reassembly buffer and hand over every
+// frame it completes: onFrame(const BLEFrame &) for good ones, whose payload
+// is dropped from the buffer when it returns, onBadCrc(seq) for rejected ones.
+template <typename OnFrame, typename OnBadCrc>
+void ble_frame_receive(std::string &buffer, const std::string &message, OnFrame &&onFrame, OnBadCrc &&onBadCrc)
+{
+    buffer += message;
+    while (true)
+    {
+        BLEFrame frame;
+        BLEFrameStatus status = ble_frame_next(buffer, frame);
+        if (status == FRAME_INCOMPLETE)
+        {
+            return; // wait for the rest
+        }
+        if (status == FRAME_BAD_CRC)
+        {
+            onBadCrc(frame.seq);
+        }
+        else if (status == FRAME_COMPLETE)
+        {
+            onFrame(frame);
+            buffer.erase(0, frame.total);
+        }
+    }
+}
+
+#endif
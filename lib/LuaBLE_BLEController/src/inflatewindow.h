@@ -0,0 +1,117 @@
+#ifndef INFLATEWINDOW_H
+#define INFLATEWINDOW_H
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_ESP32S3
+#include "esp32s3/rom/miniz.h"
+#else
+#include "esp32/rom/miniz.h"
+#endif
+#else
+#include "tinfl.h" // host tests
+#endif
+
+// Compressed transfers ("codec":"deflate"): raw deflate inflated by the ROM
+// tinfl into a circular window. Senders must compress with a window no larger
+// than this (zlib wbits -12 for the default 4 KB).
+#ifndef OTA_INFLATE_WINDOW_SIZE
+#define OTA_INFLATE_WINDOW_SIZE 4096   // power of two
+#endif
+
+// What the sink says about each decoded span
+enum InflateSinkStatus : uint8_t
+{
+    INFLATE_SINK_OK,
+    INFLATE_SINK_FULL,   // everything the target expects has arrived
+    INFLATE_SINK_ERROR,
+};
+
+enum InflateResult : uint8_t
+{
+    INFLATE_MORE,        // input consumed, the stream goes on
+    INFLATE_DONE,        // end of stream and the sink is full
+    INFLATE_SHORT,       // end of stream before the sink was full
+    INFLATE_CORRUPT,
+    INFLATE_SINK_FAILED,
+};
+
+struct InflateWindow
+{
+    tinfl_decompressor *decompressor;
+    uint8_t *window;
+    size_t windowPos;
+    bool sinkFull;
+};
+
+inline void inflate_end(InflateWindow &state)
+{
+    free(state.decompressor);
+    free(state.window);
+    memset(&state, 0, sizeof(state));
+}
+
+inline bool inflate_begin(InflateWindow &state)
+{
+    inflate_end(state);
+    state.decompressor = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+    state.window = (uint8_t *)malloc(OTA_INFLATE_WINDOW_SIZE);
+    if (!state.decompressor || !state.window)
+    {
+        inflate_end(state);
+        return false;
+    }
+    tinfl_init(state.decompressor);
+    return true;
+}
+
+// Inflate straight into the window and pass each produced span to
+// sink(const uint8_t *data, size_t length); the window doubles as the
+// back-reference dictionary. The sink can be full while tinfl still holds
+// the final block's end bits, so completion waits for TINFL_STATUS_DONE and
+// the chunk carrying them is still accepted.
+template <typename Sink>
+InflateResult inflate_feed(InflateWindow &state, const uint8_t *data, size_t length, Sink &&sink)
+{
+    for (;;)
+    {
+        size_t inBytes = length;
+        size_t outBytes = OTA_INFLATE_WINDOW_SIZE - state.windowPos;
+        tinfl_status status = tinfl_decompress(state.decompressor, data, &inBytes,
+                                               state.window, state.window + state.windowPos,
+                                               &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+        data += inBytes;
+        length -= inBytes;
+
+        if (outBytes > 0)
+        {
+            InflateSinkStatus sinkStatus = sink(state.window + state.windowPos, outBytes);
+            state.windowPos = (state.windowPos + outBytes) & (OTA_INFLATE_WINDOW_SIZE - 1);
+            if (sinkStatus == INFLATE_SINK_ERROR)
+            {
+                return INFLATE_SINK_FAILED;
+            }
+            if (sinkStatus == INFLATE_SINK_FULL)
+            {
+                state.sinkFull = true;
+            }
+        }
+
+        if (status < TINFL_STATUS_DONE)
+        {
+            return INFLATE_CORRUPT;
+        }
+        if (status == TINFL_STATUS_DONE)
+        {
+            return state.sinkFull ? INFLATE_DONE : INFLATE_SHORT;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && length == 0)
+        {
+            return INFLATE_MORE;
+        }
+    }
+}
+
+#endif
@@ -48,6 +48,7 @@ inline ErrorCode initFS();
 inline ErrorCode formatFS();
 inline ErrorCode createFile(const std::string &filename, size_t size);
 inline ErrorCode writeFile(const std::string &data);
+inline ErrorCode writeFile(const uint8_t *data, size_t length);
 inline void flushBuffer();
 inline ErrorCode closeFile();
 inline ErrorCode deleteFile(const std::string &filename);
@@ -177,14 +178,19 @@ inline String errorCodeToString(ErrorCode errorCode);
   }
 
  inline ErrorCode writeFile(const std::string &data)
+  {
+    return writeFile(reinterpret_cast<const uint8_t *>(data.c_str()), data.length());
+  }
+
+ inline ErrorCode writeFile(const uint8_t *data, size_t length)
   {
     if (!currentFile)
     {
       return FILE_NOT_OPENED;
     }
 
-    const uint8_t *dataPtr = reinterpret_cast<const uint8_t *>(data.c_str());
-    size_t remainingBytes = data.length();
+    const uint8_t *dataPtr = data;
+    size_t remainingBytes = length;
 
     while (remainingBytes > 0)
     {
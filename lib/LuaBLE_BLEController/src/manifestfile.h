@@ -0,0 +1,308 @@
+#ifndef MANIFESTFILE_H
+#define MANIFESTFILE_H
+#include <Arduino.h>
+#include "LittleFS.h"
+#include <ArduinoJson.h>
+#include <vector>
+#include <algorithm>
+#include "mbedtls/sha256.h"
+#include "littlefsfile.h"
+
+// File manifest for incremental sync. SHA-256 digests are cached in a sidecar
+// index keyed by name and only recomputed when size or mtime change.
+//
+// A sync transaction stages every upload as <name>.new. Commit first writes the
+// list of staged names to SYNC_JOURNAL_PATH, then renames each file into place;
+// recover() finishes an interrupted commit on the next boot.
+#define MANIFEST_INDEX_PATH "/.manifest"
+#define SYNC_JOURNAL_PATH "/.sync"
+#define SYNC_STAGE_SUFFIX ".new"
+
+namespace ManifestFile {
+
+inline bool syncActive = false;
+inline std::vector<std::string> staged;
+inline std::vector<std::string> pendingDeletes;
+
+// Internal files never show up in the manifest
+inline bool isInternal(const String &name)
+{
+  return name.startsWith(".") || name.endsWith(SYNC_STAGE_SUFFIX) || name.endsWith(".part") ||
+         name.endsWith(".jnl");
+}
+
+inline bool hashFile(const char *path, char hex[65])
+{
+  File file = LittleFS.open(path, "r");
+  if (!file)
+  {
+    return false;
+  }
+  uint8_t chunk[MAX_DATA_LENGTH];
+  uint8_t digest[32];
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  size_t n;
+  while ((n = file.read(chunk, sizeof(chunk))) > 0)
+  {
+    mbedtls_sha256_update(&sha, chunk, n);
+    delay(0);
+  }
+  mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  file.close();
+  for (int i = 0; i < 32; i++)
+  {
+    sprintf(hex + i * 2, "%02x", digest[i]);
+  }
+  return true;
+}
+
+// Index entries: {"<name>":[size, mtime, "<sha256 hex>"]}
+inline void loadIndex(JsonDocument &index)
+{
+  File file = LittleFS.open(MANIFEST_INDEX_PATH, "r");
+  if (!file || deserializeJson(index, file) || !index.is<JsonObject>())
+  {
+    index.to<JsonObject>();
+  }
+  if (file)
+  {
+    file.close();
+  }
+}
+
+inline void saveIndex(JsonDocument &index)
+{
+  File file = LittleFS.open(MANIFEST_INDEX_PATH, "w");
+  if (file)
+  {
+    serializeJson(index, file);
+    file.close();
+  }
+}
+
+// Drop cached digests of files changed outside a sync transaction
+inline void invalidate(const std::string &name)
+{
+  JsonDocument index;
+  loadIndex(index);
+  String key = name.c_str();
+  if (key.startsWith("/"))
+  {
+    key.remove(0, 1);
+  }
+  if (index.containsKey(key))
+  {
+    index.remove(key);
+    saveIndex(index);
+  }
+}
+
+// One entry per file: name, size and SHA-256; stale entries are rehashed
+inline LittleFSFile::ErrorCode list(JsonArray files)
+{
+  JsonDocument index;
+  loadIndex(index);
+  JsonDocument fresh;
+  fresh.to<JsonObject>();
+  bool changed = false;
+
+  File root = LittleFS.open("/");
+  File file = root.openNextFile();
+  while (file)
+  {
+    String name = file.name();
+    if (!file.isDirectory() && !isInternal(name))
+    {
+      size_t size = file.size();
+      uint32_t mtime = (uint32_t)file.getLastWrite();
+      String path = "/" + name;
+      file.close();
+
+      JsonArray cached = index[name];
+      String hash;
+      if (!cached.isNull() && cached[0] == size && cached[1] == mtime)
+      {
+        hash = cached[2].as<String>();
+      }
+      else
+      {
+        char hex[65];
+        if (!hashFile(path.c_str(), hex))
+        {
+          return LittleFSFile::FILE_READ_FAILED;
+        }
+        hash = hex;
+        changed = true;
+      }
+
+      JsonArray entry = fresh[name].to<JsonArray>();
+      entry.add(size);
+      entry.add(mtime);
+      entry.add(hash);
+
+      JsonObject obj = files.add<JsonObject>();
+      obj["name"] = name;
+      obj["size"] = size;
+      obj["sha256"] = hash;
+    }
+    file = root.openNextFile();
+  }
+
+  // Rewrite when something was hashed or a file disappeared
+  if (changed || fresh.size() != index.size())
+  {
+    saveIndex(fresh);
+  }
+  return LittleFSFile::FILE_OK;
+}
+
+inline void removeStaged()
+{
+  for (const std::string &name : staged)
+  {
+    LittleFS.remove((name + SYNC_STAGE_SUFFIX).c_str());
+  }
+  staged.clear();
+  pendingDeletes.clear();
+}
+
+inline void begin(JsonArray deletes)
+{
+  removeStaged();
+  syncActive = true;
+  for (JsonVariant name : deletes)
+  {
+    pendingDeletes.push_back(name.as<std::string>());
+  }
+}
+
+// Upload target while a transaction is open: <name>.new, remembered for commit
+inline std::string stage(const std::string &name)
+{
+  if (!syncActive)
+  {
+    return name;
+  }
+  if (std::find(staged.begin(), staged.end(), name) == staged.end())
+  {
+    staged.push_back(name);
+  }
+  return name + SYNC_STAGE_SUFFIX;
+}
+
+inline LittleFSFile::ErrorCode applyJournal()
+{
+  File journal = LittleFS.open(SYNC_JOURNAL_PATH, "r");
+  if (!journal)
+  {
+    return LittleFSFile::FILE_NOT_FOUND;
+  }
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, journal);
+  journal.close();
+  if (error)
+  {
+    LittleFS.remove(SYNC_JOURNAL_PATH);
+    return LittleFSFile::FILE_READ_FAILED;
+  }
+
+  // Idempotent: a rename that already happened leaves no .new behind
+  LittleFSFile::ErrorCode errorCode = LittleFSFile::FILE_OK;
+  for (JsonVariant v : doc["rename"].as<JsonArray>())
+  {
+    std::string name = v.as<std::string>();
+    std::string stagedPath = name + SYNC_STAGE_SUFFIX;
+    if (!LittleFS.exists(stagedPath.c_str()))
+    {
+      continue;
+    }
+    if (!LittleFS.rename(stagedPath.c_str(), name.c_str()))
+    {
+      LittleFS.remove(name.c_str());
+      if (!LittleFS.rename(stagedPath.c_str(), name.c_str()))
+      {
+        errorCode = LittleFSFile::FILE_RENAME_FAILED;
+      }
+    }
+  }
+  for (JsonVariant v : doc["delete"].as<JsonArray>())
+  {
+    LittleFS.remove(v.as<const char *>());
+  }
+  LittleFS.remove(SYNC_JOURNAL_PATH);
+  return errorCode;
+}
+
+// Every staged file must be complete; nothing is touched otherwise
+inline LittleFSFile::ErrorCode commit()
+{
+  if (!syncActive)
+  {
+    return LittleFSFile::FILE_NOT_OPENED;
+  }
+  for (const std::string &name : staged)
+  {
+    if (!LittleFS.exists((name + SYNC_STAGE_SUFFIX).c_str()))
+    {
+      return LittleFSFile::FILE_NOT_FOUND;
+    }
+  }
+
+  JsonDocument doc;
+  JsonArray renames = doc["rename"].to<JsonArray>();
+  for (const std::string &name : staged)
+  {
+    renames.add(name);
+  }
+  JsonArray deletes = doc["delete"].to<JsonArray>();
+  for (const std::string &name : pendingDeletes)
+  {
+    deletes.add(name);
+  }
+  File journal = LittleFS.open(SYNC_JOURNAL_PATH, "w");
+  size_t written = journal ? serializeJson(doc, journal) : 0;
+  if (journal)
+  {
+    journal.close();
+  }
+  if (written == 0)
+  {
+    LittleFS.remove(SYNC_JOURNAL_PATH);
+    return LittleFSFile::FILE_WRITE_FAILED;
+  }
+
+  LittleFSFile::ErrorCode errorCode = applyJournal();
+  for (const std::string &name : staged)
+  {
+    invalidate(name);
+  }
+  for (const std::string &name : pendingDeletes)
+  {
+    invalidate(name);
+  }
+  staged.clear();
+  pendingDeletes.clear();
+  syncActive = false;
+  return errorCode;
+}
+
+inline void rollback()
+{
+  removeStaged();
+  syncActive = false;
+}
+
+// Boot: finish a commit cut short by a reset
+inline void recover()
+{
+  if (LittleFS.exists(SYNC_JOURNAL_PATH))
+  {
+    applyJournal();
+  }
+}
+
+} // namespace ManifestFile
+#endif
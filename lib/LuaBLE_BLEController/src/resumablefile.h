@@ -0,0 +1,298 @@
+#ifndef RESUMABLEFILE_H
+#define RESUMABLEFILE_H
+#include <Arduino.h>
+#include "LittleFS.h"
+#include <ArduinoJson.h>
+#include "littlefsfile.h"
+
+// Same CRC-32 as crc.c / crypto.crc32() in Lua, so senders can reuse it
+extern "C" uint32_t calcCRC32(const uint8_t *buf, uint32_t len);
+
+// Resumable upload: chunks are written at index * chunkSize into <name>.part
+// and tracked in <name>.jnl (header, received bitmap, per-chunk CRC32). After
+// a dropped link the journal tells the sender which ranges are still missing.
+#define RESUME_MAGIC 0x4D534552 // "RESM"
+#define RESUME_MAX_CHUNKS 8192
+#define RESUME_FLUSH_EVERY 32   // chunks between journal writes
+
+namespace ResumableFile {
+
+struct Header
+{
+  uint32_t magic;
+  uint32_t totalSize;
+  uint16_t chunkSize;
+  uint16_t reserved;
+  uint32_t chunkCount;
+};
+
+inline File dataFile;
+inline std::string targetName;
+inline Header header;
+inline uint8_t *bitmap = nullptr;
+inline uint32_t *crcs = nullptr;
+inline uint32_t receivedCount = 0;
+inline uint16_t unflushed = 0;
+
+inline bool active() { return bitmap != nullptr; }
+inline std::string partPath(const std::string &name) { return name + ".part"; }
+inline std::string journalPath(const std::string &name) { return name + ".jnl"; }
+inline size_t bitmapBytes() { return (header.chunkCount + 7) / 8; }
+inline bool hasChunk(uint32_t i) { return bitmap[i / 8] & (1 << (i % 8)); }
+
+inline size_t chunkLength(uint32_t index)
+{
+  size_t offset = (size_t)index * header.chunkSize;
+  return min((size_t)header.chunkSize, (size_t)header.totalSize - offset);
+}
+
+inline void release()
+{
+  if (dataFile)
+  {
+    dataFile.close();
+  }
+  free(bitmap);
+  free(crcs);
+  bitmap = nullptr;
+  crcs = nullptr;
+  receivedCount = 0;
+  unflushed = 0;
+  targetName.clear();
+}
+
+inline bool allocate()
+{
+  bitmap = (uint8_t *)calloc(1, bitmapBytes());
+  crcs = (uint32_t *)(psramFound() ? ps_calloc(header.chunkCount, sizeof(uint32_t))
+                                   : calloc(header.chunkCount, sizeof(uint32_t)));
+  if (!bitmap || !crcs)
+  {
+    release();
+    return false;
+  }
+  return true;
+}
+
+inline void flushJournal()
+{
+  if (!active())
+  {
+    return;
+  }
+  dataFile.flush();
+  File journal = LittleFS.open(journalPath(targetName).c_str(), "w");
+  if (journal)
+  {
+    journal.write((const uint8_t *)&header, sizeof(header));
+    journal.write(bitmap, bitmapBytes());
+    journal.write((const uint8_t *)crcs, header.chunkCount * sizeof(uint32_t));
+    journal.close();
+  }
+  unflushed = 0;
+}
+
+// Load the journal and drop every chunk whose data no longer matches its CRC
+inline bool loadJournal(const std::string &name)
+{
+  File journal = LittleFS.open(journalPath(name).c_str(), "r");
+  if (!journal)
+  {
+    return false;
+  }
+  bool ok = journal.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == RESUME_MAGIC && header.chunkCount <= RESUME_MAX_CHUNKS &&
+            header.chunkSize > 0 && header.chunkSize <= MAX_DATA_LENGTH && allocate();
+  ok = ok && journal.read(bitmap, bitmapBytes()) == bitmapBytes() &&
+       journal.read((uint8_t *)crcs, header.chunkCount * sizeof(uint32_t)) == header.chunkCount * sizeof(uint32_t);
+  journal.close();
+  if (!ok)
+  {
+    release();
+    return false;
+  }
+
+  File part = LittleFS.open(partPath(name).c_str(), "r");
+  uint8_t chunk[MAX_DATA_LENGTH];
+  for (uint32_t i = 0; i < header.chunkCount; i++)
+  {
+    if (!hasChunk(i))
+    {
+      continue;
+    }
+    size_t length = chunkLength(i);
+    bool valid = part && part.seek((size_t)i * header.chunkSize) &&
+                 part.read(chunk, length) == length && calcCRC32(chunk, length) == crcs[i];
+    if (valid)
+    {
+      receivedCount++;
+    }
+    else
+    {
+      bitmap[i / 8] &= ~(1 << (i % 8));
+    }
+  }
+  if (part)
+  {
+    part.close();
+  }
+  return true;
+}
+
+inline LittleFSFile::ErrorCode openData(const std::string &name)
+{
+  std::string path = partPath(name);
+  if (!LittleFS.exists(path.c_str()))
+  {
+    File created = LittleFS.open(path.c_str(), "w");
+    if (!created)
+    {
+      return LittleFSFile::FILE_OPEN_FAILED;
+    }
+    created.close();
+  }
+  dataFile = LittleFS.open(path.c_str(), "r+");
+  return dataFile ? LittleFSFile::FILE_OK : LittleFSFile::FILE_OPEN_FAILED;
+}
+
+// Start or resume; a journal for the same size and chunk size keeps its chunks
+inline LittleFSFile::ErrorCode open(const std::string &name, size_t size, uint16_t chunkSize)
+{
+  release();
+  if (name.length() > MAX_FILENAME_LENGTH || chunkSize == 0 || chunkSize > MAX_DATA_LENGTH)
+  {
+    return LittleFSFile::FILE_OPEN_FAILED;
+  }
+
+  bool resumed = loadJournal(name) && header.totalSize == size && header.chunkSize == chunkSize;
+  if (!resumed)
+  {
+    release();
+    LittleFS.remove(partPath(name).c_str());
+    header = {RESUME_MAGIC, (uint32_t)size, chunkSize, 0, (uint32_t)((size + chunkSize - 1) / chunkSize)};
+    if (header.chunkCount > RESUME_MAX_CHUNKS || !allocate())
+    {
+      return LittleFSFile::FILE_OPEN_FAILED;
+    }
+  }
+
+  LittleFSFile::ErrorCode errorCode = openData(name);
+  if (errorCode != LittleFSFile::FILE_OK)
+  {
+    release();
+    return errorCode;
+  }
+  targetName = name;
+  if (!resumed)
+  {
+    flushJournal();
+  }
+  return LittleFSFile::FILE_OK;
+}
+
+// Resume after a reboot, when only the journal knows size and chunk size
+inline LittleFSFile::ErrorCode reopen(const std::string &name)
+{
+  if (active() && targetName == name)
+  {
+    return LittleFSFile::FILE_OK;
+  }
+  release();
+  if (!loadJournal(name))
+  {
+    return LittleFSFile::FILE_NOT_FOUND;
+  }
+  LittleFSFile::ErrorCode errorCode = openData(name);
+  if (errorCode != LittleFSFile::FILE_OK)
+  {
+    release();
+    return errorCode;
+  }
+  targetName = name;
+  return LittleFSFile::FILE_OK;
+}
+
+inline LittleFSFile::ErrorCode writeChunk(uint32_t index, const uint8_t *data, size_t length)
+{
+  if (!active())
+  {
+    return LittleFSFile::FILE_NOT_OPENED;
+  }
+  if (index >= header.chunkCount || length != chunkLength(index))
+  {
+    return LittleFSFile::FILE_SIZE_MISMATCH;
+  }
+  if (hasChunk(index))
+  {
+    return LittleFSFile::FILE_OK; // retransmit
+  }
+  if (!dataFile.seek((size_t)index * header.chunkSize) || dataFile.write(data, length) != length)
+  {
+    return LittleFSFile::FILE_WRITE_FAILED;
+  }
+  crcs[index] = calcCRC32(data, length);
+  bitmap[index / 8] |= 1 << (index % 8);
+  receivedCount++;
+
+  if (++unflushed >= RESUME_FLUSH_EVERY)
+  {
+    flushJournal();
+  }
+  return receivedCount == header.chunkCount ? LittleFSFile::FILE_WRITE_COMPLETE : LittleFSFile::FILE_OK;
+}
+
+// Inclusive [first, last] chunk ranges still missing, at most maxRanges
+inline void missingRanges(JsonArray ranges, size_t maxRanges)
+{
+  uint32_t i = 0;
+  while (i < header.chunkCount && ranges.size() < maxRanges)
+  {
+    if (hasChunk(i))
+    {
+      i++;
+      continue;
+    }
+    uint32_t first = i;
+    while (i < header.chunkCount && !hasChunk(i))
+    {
+      i++;
+    }
+    JsonArray range = ranges.add<JsonArray>();
+    range.add(first);
+    range.add(i - 1);
+  }
+}
+
+// Complete: move the data into place and drop the journal. Otherwise keep both.
+inline LittleFSFile::ErrorCode close()
+{
+  if (!active())
+  {
+    return LittleFSFile::FILE_CLOSE_FAILED;
+  }
+  if (receivedCount != header.chunkCount)
+  {
+    flushJournal();
+    release();
+    return LittleFSFile::FILE_SIZE_MISMATCH;
+  }
+
+  std::string name = targetName;
+  dataFile.close();
+  release();
+  // LittleFS replaces the target in one step, so the old file stays whole
+  // until the new one is in place; remove first only if that is refused
+  if (!LittleFS.rename(partPath(name).c_str(), name.c_str()))
+  {
+    LittleFS.remove(name.c_str());
+    if (!LittleFS.rename(partPath(name).c_str(), name.c_str()))
+    {
+      return LittleFSFile::FILE_RENAME_FAILED;
+    }
+  }
+  LittleFS.remove(journalPath(name).c_str());
+  return LittleFSFile::FILE_OK;
+}
+
+} // namespace ResumableFile
+#endif
@@ -3,6 +3,8 @@
 
 
 #include "arduinoBindings.h"
+#include "luatoswrapper.h"
+#include "luaoutput.h"
 
 
 #undef  UART_SCLK_APB
@@ -23,8 +25,8 @@ int l_micros(lua_State* L) {
 
 int l_delay(lua_State* L) {
     int ms = luaL_checkinteger(L, 1);
-    if (ms > 0) {
-        delay(ms);
+    if (ms > 0 && !lua_wrapper_sleep(ms)) {
+        lua_wrapper_check_stop(L);  // woken early by a stop request
     }
     return 0;
 }
@@ -189,29 +191,42 @@ int l_constrain(lua_State* L) {
 }
 
 // Print functions
-int l_print(lua_State* L) {
+// Format all arguments into one string and hand it to the output pipeline
+static void write_print_args(lua_State* L, bool newline) {
     int n = lua_gettop(L);
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
     for (int i = 1; i <= n; i++) {
-        if (i > 1) Serial.print("\t");
-        
+        if (i > 1) luaL_addchar(&b, '\t');
+
         if (lua_isstring(L, i)) {
-            Serial.print(lua_tostring(L, i));
-        } else if (lua_isnumber(L, i)) {
-            Serial.print(lua_tonumber(L, i));
+            size_t len;
+            const char* s = lua_tolstring(L, i, &len);
+            luaL_addlstring(&b, s, len);
         } else if (lua_isboolean(L, i)) {
-            Serial.print(lua_toboolean(L, i) ? "true" : "false");
+            luaL_addstring(&b, lua_toboolean(L, i) ? "true" : "false");
         } else if (lua_isnil(L, i)) {
-            Serial.print("nil");
+            luaL_addstring(&b, "nil");
         } else {
-            Serial.print(luaL_typename(L, i));
+            luaL_addstring(&b, luaL_typename(L, i));
         }
     }
+    if (newline) luaL_addchar(&b, '\n');
+    luaL_pushresult(&b);
+
+    size_t len;
+    const char* out = lua_tolstring(L, -1, &len);
+    lua_output_write(out, len);
+    lua_pop(L, 1);
+}
+
+int l_print(lua_State* L) {
+    write_print_args(L, false);
     return 0;
 }
 
 int l_println(lua_State* L) {
-    l_print(L);  // Print all arguments
-    Serial.println();  // Add newline
+    write_print_args(L, true);
     return 0;
 }
 
@@ -0,0 +1,238 @@
+#include "luaoutput.h"
+#include "luatoswrapper.h"
+#include <atomic>
+
+#define RING_MASK (LUA_OUTPUT_RING_SIZE - 1)
+static_assert((LUA_OUTPUT_RING_SIZE & RING_MASK) == 0, "LUA_OUTPUT_RING_SIZE must be a power of two");
+
+// Free-running indices: fill is writeIdx - readIdx. Only the producer moves
+// writeIdx; readIdx is moved by the consumer, and by the producer only under
+// OUTPUT_DROP_OLDEST, hence the compare-exchange on both sides.
+static char ring[LUA_OUTPUT_RING_SIZE];
+static std::atomic<uint32_t> readIdx{0};
+static std::atomic<uint32_t> writeIdx{0};
+
+static LuaOutputSink outputSink = nullptr;
+static TaskHandle_t outputTaskHandle = nullptr;
+static TaskHandle_t producerTask = nullptr;
+static volatile OutputOverflowPolicy overflowPolicy = OUTPUT_DROP_NEWEST;
+static volatile uint16_t flushBytes = LUA_OUTPUT_DEFAULT_FLUSH_BYTES;
+static volatile uint16_t flushMs = LUA_OUTPUT_DEFAULT_FLUSH_MS;
+static LuaOutputStats outputStats = {};
+
+static void ring_copy_in(uint32_t pos, const char *data, size_t length)
+{
+    size_t offset = pos & RING_MASK;
+    size_t first = min(length, (size_t)LUA_OUTPUT_RING_SIZE - offset);
+    memcpy(ring + offset, data, first);
+    memcpy(ring, data + first, length - first);
+}
+
+static void ring_copy_out(uint32_t pos, char *out, size_t length)
+{
+    size_t offset = pos & RING_MASK;
+    size_t first = min(length, (size_t)LUA_OUTPUT_RING_SIZE - offset);
+    memcpy(out, ring + offset, first);
+    memcpy(out + first, ring, length - first);
+}
+
+static void drain()
+{
+    static char batch[LUA_OUTPUT_BATCH_MAX];
+    for (;;)
+    {
+        uint32_t r = readIdx.load(std::memory_order_acquire);
+        uint32_t w = writeIdx.load(std::memory_order_acquire);
+        size_t n = min((size_t)(w - r), (size_t)flushBytes);
+        if (n == 0)
+        {
+            return;
+        }
+        ring_copy_out(r, batch, n);
+        // Lost the race against drop-oldest: the copy may be torn, read again
+        if (!readIdx.compare_exchange_strong(r, r + n, std::memory_order_acq_rel))
+        {
+            continue;
+        }
+        outputSink(batch, n);
+        outputStats.sent += n;
+        outputStats.flushes++;
+    }
+}
+
+static void lua_output_task(void *param)
+{
+    for (;;)
+    {
+        // Woken early once a full batch is pending, otherwise flush on the deadline
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(flushMs));
+        drain();
+    }
+}
+
+bool lua_output_init(LuaOutputSink sink)
+{
+    if (outputTaskHandle)
+    {
+        return true;
+    }
+    outputSink = sink;
+    return xTaskCreatePinnedToCore(lua_output_task, "LuaOutputTask", 4096, nullptr,
+                                   tskIDLE_PRIORITY + 2, &outputTaskHandle, 0) == pdPASS;
+}
+
+void lua_output_set_producer(TaskHandle_t task)
+{
+    producerTask = task;
+}
+
+size_t lua_output_write(const char *data, size_t length)
+{
+    if (!outputTaskHandle || xTaskGetCurrentTaskHandle() != producerTask)
+    {
+        return Serial.write((const uint8_t *)data, length);
+    }
+
+    size_t accepted = 0;
+    while (accepted < length)
+    {
+        uint32_t w = writeIdx.load(std::memory_order_relaxed);
+        uint32_t r = readIdx.load(std::memory_order_acquire);
+        size_t space = LUA_OUTPUT_RING_SIZE - (w - r);
+        size_t want = length - accepted;
+
+        if (space < want && overflowPolicy == OUTPUT_DROP_OLDEST)
+        {
+            if (want > LUA_OUTPUT_RING_SIZE) // only the tail can survive
+            {
+                outputStats.dropped += want - LUA_OUTPUT_RING_SIZE;
+                accepted += want - LUA_OUTPUT_RING_SIZE;
+                want = LUA_OUTPUT_RING_SIZE;
+            }
+            size_t excess = want - space;
+            if (!readIdx.compare_exchange_strong(r, r + excess, std::memory_order_acq_rel))
+            {
+                continue; // consumer moved, recompute
+            }
+            outputStats.dropped += excess;
+            space += excess;
+        }
+
+        size_t n = min(space, want);
+        if (n > 0)
+        {
+            ring_copy_in(w, data + accepted, n);
+            writeIdx.store(w + n, std::memory_order_release);
+            accepted += n;
+
+            uint32_t fill = w + n - readIdx.load(std::memory_order_relaxed);
+            if (fill > outputStats.highWater)
+            {
+                outputStats.highWater = fill;
+            }
+            if (fill >= flushBytes)
+            {
+                xTaskNotifyGive(outputTaskHandle);
+            }
+        }
+        outputStats.written += n;
+
+        if (accepted < length)
+        {
+            if (overflowPolicy != OUTPUT_BLOCK)
+            {
+                outputStats.dropped += length - accepted;
+                break;
+            }
+            xTaskNotifyGive(outputTaskHandle);
+            outputStats.blockedMs++;
+            if (!lua_wrapper_sleep(1))
+            {
+                outputStats.dropped += length - accepted; // stop requested
+                break;
+            }
+        }
+    }
+    return accepted;
+}
+
+void lua_output_flush()
+{
+    if (outputTaskHandle)
+    {
+        xTaskNotifyGive(outputTaskHandle);
+    }
+}
+
+void lua_output_set_policy(OutputOverflowPolicy policy)
+{
+    overflowPolicy = policy;
+}
+
+void lua_output_set_flush(uint16_t bytes, uint16_t ms)
+{
+    flushBytes = constrain(bytes, 1, LUA_OUTPUT_BATCH_MAX);
+    flushMs = ms > 0 ? ms : 1;
+}
+
+void lua_output_set_mtu(uint16_t mtu)
+{
+    int payload = mtu - 3; // ATT notification header
+    flushBytes = constrain(payload, 1, LUA_OUTPUT_BATCH_MAX);
+}
+
+void lua_output_reset_stats()
+{
+    memset(&outputStats, 0, sizeof(outputStats));
+}
+
+void lua_output_get_stats(LuaOutputStats *stats)
+{
+    *stats = outputStats;
+}
+
+// Lua bindings
+static int l_output_stats(lua_State *L)
+{
+    LuaOutputStats stats;
+    lua_output_get_stats(&stats);
+    lua_newtable(L);
+    lua_pushinteger(L, stats.written);
+    lua_setfield(L, -2, "written");
+    lua_pushinteger(L, stats.sent);
+    lua_setfield(L, -2, "sent");
+    lua_pushinteger(L, stats.dropped);
+    lua_setfield(L, -2, "dropped");
+    lua_pushinteger(L, stats.blockedMs);
+    lua_setfield(L, -2, "blocked_ms");
+    lua_pushinteger(L, stats.flushes);
+    lua_setfield(L, -2, "flushes");
+    lua_pushinteger(L, stats.highWater);
+    lua_setfield(L, -2, "high_water");
+    return 1;
+}
+
+static int l_output_policy(lua_State *L)
+{
+    static const char *const names[] = {"drop_newest", "drop_oldest", "block", NULL};
+    lua_output_set_policy((OutputOverflowPolicy)luaL_checkoption(L, 1, NULL, names));
+    return 0;
+}
+
+static int l_output_flush(lua_State *L)
+{
+    lua_output_flush();
+    return 0;
+}
+
+void lua_output_register(lua_State *L)
+{
+    const luaL_Reg outputLib[] = {
+        {"stats", l_output_stats},
+        {"policy", l_output_policy},
+        {"flush", l_output_flush},
+        {NULL, NULL}};
+
+    luaL_newlib(L, outputLib);
+    lua_setglobal(L, "output");
+}
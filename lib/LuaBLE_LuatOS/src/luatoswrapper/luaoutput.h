@@ -0,0 +1,66 @@
+#ifndef LUAOUTPUT_H
+#define LUAOUTPUT_H
+
+#include <Arduino.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#ifdef __cplusplus
+}   /* extern "C" */
+#endif
+
+// Asynchronous print pipeline. The Lua task writes into a lock-free SPSC
+// ring; a dedicated output task drains it in batches of up to flushBytes,
+// at the latest flushMs after data arrives, and hands each batch to the sink.
+#ifndef LUA_OUTPUT_RING_SIZE
+#define LUA_OUTPUT_RING_SIZE 8192   // power of two
+#endif
+
+#ifndef LUA_OUTPUT_BATCH_MAX
+#define LUA_OUTPUT_BATCH_MAX 512
+#endif
+
+#define LUA_OUTPUT_DEFAULT_FLUSH_BYTES 244   // one notification at the default 247-byte MTU
+#define LUA_OUTPUT_DEFAULT_FLUSH_MS 20
+
+enum OutputOverflowPolicy {
+    OUTPUT_DROP_NEWEST,   // discard what does not fit and count it
+    OUTPUT_DROP_OLDEST,   // overwrite unsent output
+    OUTPUT_BLOCK          // wait for the output task (stop still interrupts)
+};
+
+struct LuaOutputStats {
+    uint32_t written;     // bytes accepted into the ring
+    uint32_t sent;        // bytes handed to the sink
+    uint32_t dropped;     // bytes lost to the overflow policy
+    uint32_t blockedMs;   // time the producer spent waiting (OUTPUT_BLOCK)
+    uint32_t flushes;     // sink calls
+    uint32_t highWater;   // peak ring fill in bytes
+};
+
+typedef void (*LuaOutputSink)(const char* data, size_t length);
+
+// Without init (or from any task other than the producer) output is written
+// synchronously to Serial.
+bool lua_output_init(LuaOutputSink sink);
+void lua_output_set_producer(TaskHandle_t task);
+size_t lua_output_write(const char* data, size_t length);
+void lua_output_flush();
+
+void lua_output_set_policy(OutputOverflowPolicy policy);
+void lua_output_set_flush(uint16_t flushBytes, uint16_t flushMs);
+// Size batches to fill one notification at this ATT MTU, up to LUA_OUTPUT_BATCH_MAX
+void lua_output_set_mtu(uint16_t mtu);
+
+// Counters are per session; call on connect
+void lua_output_reset_stats();
+void lua_output_get_stats(LuaOutputStats* stats);
+
+void lua_output_register(lua_State* L);
+
+#endif // LUAOUTPUT_H
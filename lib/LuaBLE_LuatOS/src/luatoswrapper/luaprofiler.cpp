@@ -0,0 +1,193 @@
+#include "luaprofiler.h"
+#include "luatoswrapper.h"
+#include "esp_timer.h"
+
+static LuaProfileEntry entries[LUA_PROFILER_ENTRIES];
+static uint8_t entryCount = 0;
+static volatile bool active = false;
+static uint16_t samplePeriod = LUA_PROFILER_DEFAULT_PERIOD;
+static uint16_t hookCalls = 0;
+static size_t lastVmUsed = 0;
+static uint32_t totalSamples = 0;
+static uint32_t droppedSamples = 0;   // table full
+static int64_t startTime = 0;
+static portMUX_TYPE profileLock = portMUX_INITIALIZER_UNLOCKED;
+
+// O(1) per-state count; bget's bstats walks the free list
+static size_t state_heap_used(lua_State *L)
+{
+    return (size_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+void lua_profiler_reset()
+{
+    taskENTER_CRITICAL(&profileLock);
+    memset(entries, 0, sizeof(entries));
+    entryCount = 0;
+    totalSamples = 0;
+    droppedSamples = 0;
+    hookCalls = 0;
+    taskEXIT_CRITICAL(&profileLock);
+    startTime = esp_timer_get_time();
+    lastVmUsed = 0; // first sample only sets the baseline
+}
+
+void lua_profiler_start(uint16_t period)
+{
+    samplePeriod = period > 0 ? period : 1;
+    lua_profiler_reset();
+    active = true;
+}
+
+void lua_profiler_stop()
+{
+    active = false;
+}
+
+bool lua_profiler_active()
+{
+    return active;
+}
+
+static LuaProfileEntry *find_entry(const char *source, int line, int funcLine, const char *function)
+{
+    for (uint8_t i = 0; i < entryCount; i++)
+    {
+        if (entries[i].line == line && entries[i].funcLine == funcLine &&
+            strncmp(entries[i].source, source, LUA_PROFILER_SOURCE_LEN - 1) == 0)
+        {
+            return &entries[i];
+        }
+    }
+    if (entryCount >= LUA_PROFILER_ENTRIES)
+    {
+        return nullptr;
+    }
+    LuaProfileEntry *entry = &entries[entryCount++];
+    strlcpy(entry->source, source, sizeof(entry->source));
+    entry->line = line;
+    entry->funcLine = funcLine;
+    strlcpy(entry->function, function, sizeof(entry->function));
+    return entry;
+}
+
+void lua_profiler_sample(lua_State *L, lua_Debug *ar)
+{
+    if (++hookCalls < samplePeriod)
+    {
+        return;
+    }
+    hookCalls = 0;
+
+    if (!lua_getinfo(L, "nSl", ar))
+    {
+        return;
+    }
+
+    size_t vmUsed = state_heap_used(L);
+    int32_t grown = lastVmUsed ? (int32_t)vmUsed - (int32_t)lastVmUsed : 0;
+    lastVmUsed = vmUsed;
+    const char *function = ar->name ? ar->name : (*ar->what == 'm' ? "main" : "");
+
+    taskENTER_CRITICAL(&profileLock);
+    totalSamples++;
+    LuaProfileEntry *entry = find_entry(ar->short_src, ar->currentline, ar->linedefined, function);
+    if (entry)
+    {
+        entry->samples++;
+        if (grown > 0)
+        {
+            entry->allocBytes += grown;
+        }
+    }
+    else
+    {
+        droppedSamples++;
+    }
+    taskEXIT_CRITICAL(&profileLock);
+}
+
+size_t lua_profiler_report(char *out, size_t outSize, int maxEntries)
+{
+    if (!out || outSize == 0)
+    {
+        return 0;
+    }
+
+    // Snapshot under the lock, format outside it
+    static LuaProfileEntry snapshot[LUA_PROFILER_ENTRIES];
+    uint8_t count;
+    uint32_t samples, dropped;
+    taskENTER_CRITICAL(&profileLock);
+    count = entryCount;
+    samples = totalSamples;
+    dropped = droppedSamples;
+    memcpy(snapshot, entries, sizeof(LuaProfileEntry) * count);
+    taskEXIT_CRITICAL(&profileLock);
+
+    maxEntries = profile_rank(snapshot, count, maxEntries);
+
+    size_t vmTotal, vmUsed, vmMax;
+    lua_wrapper_meminfo(&vmTotal, &vmUsed, &vmMax);
+
+    // {"msgtyp":"profile","active":1,"us":..,"samples":..,"dropped":..,"vm":[total,used,max],
+    //  "entries":[["src",line,"function",funcLine,samples,alloc],...]}
+    size_t pos = snprintf(out, outSize,
+                          "{\"msgtyp\":\"profile\",\"active\":%d,\"us\":%lu,\"samples\":%lu,\"dropped\":%lu,"
+                          "\"vm\":[%u,%u,%u],\"entries\":[",
+                          active ? 1 : 0, (unsigned long)(esp_timer_get_time() - startTime),
+                          (unsigned long)samples, (unsigned long)dropped,
+                          (unsigned)vmTotal, (unsigned)vmUsed, (unsigned)vmMax);
+    if (pos + 3 > outSize)
+    {
+        out[0] = '\0';
+        return 0;
+    }
+    // Entries that would not leave room for the closing "]}" are dropped,
+    // so the report is always valid JSON
+    pos = profile_format_entries(out, pos, outSize, 3, snapshot, maxEntries);
+    memcpy(out + pos, "]}", 3);
+    return pos + 2;
+}
+
+// Lua bindings
+static int l_profiler_start(lua_State *L)
+{
+    lua_profiler_start((uint16_t)luaL_optinteger(L, 1, LUA_PROFILER_DEFAULT_PERIOD));
+    return 0;
+}
+
+static int l_profiler_stop(lua_State *L)
+{
+    lua_profiler_stop();
+    return 0;
+}
+
+static int l_profiler_reset(lua_State *L)
+{
+    lua_profiler_reset();
+    return 0;
+}
+
+static int l_profiler_report(lua_State *L)
+{
+    int maxEntries = (int)luaL_optinteger(L, 1, 16);
+    luaL_Buffer b;
+    char *buf = luaL_buffinitsize(L, &b, 1536);
+    size_t len = lua_profiler_report(buf, 1536, maxEntries);
+    luaL_pushresultsize(&b, len);
+    return 1;
+}
+
+void lua_profiler_register(lua_State *L)
+{
+    const luaL_Reg profilerLib[] = {
+        {"start", l_profiler_start},
+        {"stop", l_profiler_stop},
+        {"reset", l_profiler_reset},
+        {"report", l_profiler_report},
+        {NULL, NULL}};
+
+    luaL_newlib(L, profilerLib);
+    lua_setglobal(L, "profiler");
+}
@@ -0,0 +1,41 @@
+#ifndef LUAPROFILER_H
+#define LUAPROFILER_H
+
+#include <Arduino.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#ifdef __cplusplus
+}   /* extern "C" */
+#endif
+
+#include "profilereport.h"
+
+// Sampling profiler driven by the wrapper's count hook. Every Nth hook call
+// the current source:line is charged one sample and the Lua heap growth since
+// the previous sample. The hook counts VM instructions, so samples measure
+// work done in Lua; time spent blocked in delays or receives is not charged.
+#ifndef LUA_PROFILER_DEFAULT_PERIOD
+#define LUA_PROFILER_DEFAULT_PERIOD 10   // hook calls per sample
+#endif
+
+void lua_profiler_start(uint16_t period = LUA_PROFILER_DEFAULT_PERIOD);
+void lua_profiler_stop();
+void lua_profiler_reset();
+bool lua_profiler_active();
+
+// Called from the hook on the Lua task
+void lua_profiler_sample(lua_State* L, lua_Debug* ar);
+
+// Compact JSON report of the top entries by samples; returns bytes written
+size_t lua_profiler_report(char* out, size_t outSize, int maxEntries = 16);
+
+// profiler.start([period]) / stop() / reset() / report([n])
+void lua_profiler_register(lua_State* L);
+
+#endif  /* LUAPROFILER_H */
@@ -1,5 +1,10 @@
 #include "luatoswrapper.h"
 #include "arduinobindings.h"
+#include "luaprofiler.h"
+#include "luaoutput.h"
+#include "esp_heap_caps.h"
+#include "freertos/event_groups.h"
+#include <atomic>
 
 // External declarations from LuatOS
 extern "C"
@@ -17,8 +22,18 @@ extern "C"
 // Static variables - no struct
 static lua_State *L = nullptr;
 static ExecutionState currentState = EXEC_STATE_UNINITIALIZED;
-static volatile bool stopRequested = false;
-static String stopScriptBuffer;
+// Stop handling: the flag is polled by a permanently installed count hook and
+// by blocking bindings; it stays set until the interrupted command unwinds so
+// a pcall in the script cannot swallow the stop.
+static std::atomic<bool> stopRequested(false);
+static std::atomic<ScriptHandle> stopScriptSlot(SCRIPT_HANDLE_INVALID);
+static bool stopHandled = false;
+static int64_t stopRequestTime = 0;
+static int hookBudget = LUA_WRAPPER_HOOK_BUDGET;
+static EventGroupHandle_t wakeEvents = nullptr;
+#define WAKE_STOP_BIT BIT0
+static std::atomic<uint32_t> runGeneration(0); // tags stop wakes; bumped whenever a run ends
+static LuaStopStats stopStats = {};
 static String lastErrorMessage;
 
 // Module names
@@ -34,10 +49,25 @@ static SemaphoreHandle_t stateMutex = nullptr;
 // Background task handle
 static TaskHandle_t bgTaskHandle = nullptr;
 
+// Warm spare state: built on the other core so STOP_CLEAN is a pointer swap
+static bool warmSpareEnabled = false;
+static lua_State *spareL = nullptr;
+static TaskHandle_t spareTaskHandle = nullptr;
+static SemaphoreHandle_t spareMutex = nullptr;
+static lua_State *retiredL = nullptr; // swapped out, closed by the Lua task once idle
+static SemaphoreHandle_t vmHeapMutex = nullptr;
+static lua_Alloc vmAllocator = luat_heap_alloc;
+static LuaSwapStats swapStats = {};
+
+// Script buffer pool
+static ScriptPool scriptPool;
+static LuaQueueStats queueStats = {};
+
 // Callbacks
 static OutputCallback outputCallback = nullptr;
 static ErrorCallback errorCallback = nullptr;
 static RegisterCallback registerCallback = nullptr;
+static ExecStartCallback execStartCallback = nullptr;
 
 // Command structure
 struct Command
@@ -50,16 +80,28 @@ struct Command
         CMD_STOP,
         CMD_DESTROY
     } type;
-    String data;
+    ScriptHandle slot; // Owned by the Lua task once queued
+    uint32_t length;
     bool persistent;
     bool autoRestart;
     StopMode stopMode;
+    int64_t submitTime;
 };
 
 // Forward declarations
 static void lua_task(void *param);
 static void lua_bg_task(void *param);
+static void lua_spare_task(void *param);
+static lua_State *build_lua_state();
+static void reset_lua_state();
+static void *locked_heap_alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+static void *system_heap_alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+static void close_retired_state();
 static void execution_hook(lua_State *L, lua_Debug *ar);
+static void handle_stop(lua_State *L);
+static void run_stop_script();
+static void clear_stop_request();
+static int stop_wake_handler(lua_State *L, void *ptr);
  bool create_lua_state();
  void destroy_lua_state();
 static void set_execution_state(ExecutionState state);
@@ -67,6 +109,10 @@ static ExecutionState get_execution_state();
 static bool execute_string_internal(const char *code, bool persistent, bool autoRestart);
 static bool execute_file_internal(const char *path, bool persistent, bool autoRestart);
 static bool execute_module_internal(const char *module, bool persistent, bool autoRestart);
+static bool init_script_slots();
+static void free_script_slots();
+static bool send_command(Command &cmd);
+static bool submit_copy(Command::Type type, const char *data, bool persistent, bool autoRestart);
 
 // Thread-safe state management
 static void set_execution_state(ExecutionState state)
@@ -89,49 +135,240 @@ static ExecutionState get_execution_state()
     return state;
 }
 
-// Hook for safe interruption
-static void execution_hook(lua_State *L, lua_Debug *ar)
+// Script buffer pool management
+static bool init_script_slots()
 {
-    if (stopRequested)
+    if (!scriptPool.init())
     {
-        // Run stop script if provided
-        if (!stopScriptBuffer.isEmpty())
-        {
-            luaL_dostring(L, stopScriptBuffer.c_str());
-            stopScriptBuffer.clear();
-        }
-        else if (autoRunStopModule && stopModuleName)
+        LLOGE("script slot allocation failed");
+        return false;
+    }
+    queueStats = {};
+    queueStats.slotsTotal = LUA_WRAPPER_SCRIPT_SLOTS;
+    queueStats.slotsMinFree = LUA_WRAPPER_SCRIPT_SLOTS;
+    return true;
+}
+
+static void free_script_slots()
+{
+    scriptPool.destroy();
+}
+
+static bool send_command(Command &cmd)
+{
+    cmd.submitTime = esp_timer_get_time();
+    if (xQueueSend(commandQueue, &cmd, pdMS_TO_TICKS(100)) == pdTRUE)
+    {
+        queueStats.submitted++;
+        return true;
+    }
+
+    queueStats.rejected++;
+    if (cmd.slot != SCRIPT_HANDLE_INVALID)
+    {
+        lua_wrapper_release_buffer(cmd.slot);
+    }
+    return false;
+}
+
+// Copy a NUL-terminated string into a pool slot and queue it
+static bool submit_copy(Command::Type type, const char *data, bool persistent, bool autoRestart)
+{
+    char *buffer;
+    size_t capacity;
+    ScriptHandle handle = lua_wrapper_acquire_buffer(&buffer, &capacity);
+    if (handle == SCRIPT_HANDLE_INVALID)
+    {
+        return false;
+    }
+
+    size_t length = strlen(data);
+    if (length >= capacity)
+    {
+        lastErrorMessage = "Script too large for buffer";
+        queueStats.rejected++;
+        lua_wrapper_release_buffer(handle);
+        return false;
+    }
+    memcpy(buffer, data, length + 1);
+
+    Command cmd = {};
+    cmd.type = type;
+    cmd.slot = handle;
+    cmd.length = length;
+    cmd.persistent = persistent;
+    cmd.autoRestart = autoRestart;
+    return send_command(cmd);
+}
+
+// Runs on the Lua task when a stop is pending: unwind the running script.
+// The stop script waits for run_stop_script, since Lua does not call the
+// hook again while it is inside it.
+static void handle_stop(lua_State *L)
+{
+    if (!stopHandled)
+    {
+        stopHandled = true;
+
+        uint32_t latency = (uint32_t)(esp_timer_get_time() - stopRequestTime);
+        stopStats.stops++;
+        stopStats.lastLatencyUs = latency;
+        if (latency > stopStats.maxLatencyUs)
         {
-            // Try to run stop module
-            char filename[64];
-            if (luat_search_module(stopModuleName, filename) == 0)
-            {
-                luaL_dofile(L, filename);
-            }
+            stopStats.maxLatencyUs = latency;
         }
+    }
+
+    set_execution_state(EXEC_STATE_STOPPING);
+    luaL_error(L, "Execution stopped");
+}
+
+// Called once the stopped script has unwound. The stop script then runs
+// like any other: the request is cleared so its delays and receives work,
+// the hook is live, and a second lua_wrapper_stop ends it.
+static void run_stop_script()
+{
+    if (!L || !stopRequested)
+    {
+        return;
+    }
+    ScriptHandle slot = stopScriptSlot.exchange(SCRIPT_HANDLE_INVALID);
+    char filename[64];
+    bool haveModule = slot == SCRIPT_HANDLE_INVALID && autoRunStopModule && stopModuleName &&
+                      luat_search_module(stopModuleName, filename) == 0;
+    if (slot == SCRIPT_HANDLE_INVALID && !haveModule)
+    {
+        return;
+    }
 
-        // Clear flag and raise error
-        stopRequested = false;
-        // Serial.println("*****************LUA SCRIPT STOP*****************");
+    runGeneration++;
+    stopRequested = false;
+    stopHandled = false;
+    if (wakeEvents)
+    {
+        xEventGroupClearBits(wakeEvents, WAKE_STOP_BIT);
+    }
 
-        luaL_error(L, "Execution stopped");
+    int result = slot != SCRIPT_HANDLE_INVALID ? luaL_dostring(L, scriptPool.data(slot)) : luaL_dofile(L, filename);
+    if (slot != SCRIPT_HANDLE_INVALID)
+    {
+        lua_wrapper_release_buffer(slot);
+    }
+    if (result != LUA_OK)
+    {
+        LLOGW("stop script: %s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+}
 
-        set_execution_state(EXEC_STATE_STOPPING);
+// Wakes posted for this run but never received are left on the msgbus; the
+// new generation makes stop_wake_handler skip them
+static void clear_stop_request()
+{
+    runGeneration++;
+    stopRequested = false;
+    stopHandled = false;
+    ScriptHandle slot = stopScriptSlot.exchange(SCRIPT_HANDLE_INVALID);
+    if (slot != SCRIPT_HANDLE_INVALID)
+    {
+        lua_wrapper_release_buffer(slot);
+    }
+    if (wakeEvents)
+    {
+        xEventGroupClearBits(wakeEvents, WAKE_STOP_BIT);
     }
 }
 
+// Hook for safe interruption, called every hookBudget VM instructions
+static void execution_hook(lua_State *L, lua_Debug *ar)
+{
+    if (xTaskGetCurrentTaskHandle() != luaTaskHandle)
+    {
+        return;
+    }
+    if (stopRequested)
+    {
+        handle_stop(L);
+    }
+    if (lua_profiler_active())
+    {
+        lua_profiler_sample(L, ar);
+    }
+}
+
+// Posted on the msgbus so a script parked in rtos.receive wakes up on stop.
+// rtos.receive leaves [timeout, msg] on the stack. A wake from an earlier
+// run is passed over: wait for the next message as if it was never posted.
+static int stop_wake_handler(lua_State *L, void *ptr)
+{
+    const rtos_msg_t *wake = (const rtos_msg_t *)lua_topointer(L, -1);
+    if ((uint32_t)wake->arg1 == runGeneration)
+    {
+        lua_wrapper_check_stop(L);
+        lua_pushinteger(L, -1); // looks like a receive timeout otherwise
+        return 1;
+    }
+
+    lua_pop(L, 1);
+    rtos_msg_t msg;
+    if (luat_msgbus_get(&msg, luaL_optinteger(L, 1, 0)) != 0)
+    {
+        lua_pushinteger(L, -1);
+        return 1;
+    }
+    lua_pushlightuserdata(L, (void *)&msg);
+    return msg.handler(L, msg.ptr);
+}
+
 // Lua state management
+// bget is not thread-safe; with the warm spare two states allocate from it
+// at the same time, so only then does every VM allocation take this mutex
+static void *locked_heap_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    xSemaphoreTake(vmHeapMutex, portMAX_DELAY);
+    void *result = luat_heap_alloc(ud, ptr, osize, nsize);
+    xSemaphoreGive(vmHeapMutex);
+    return result;
+}
+
+// Background states live on the system heap and never share bget with the
+// main state, so they need no lock either way
+static void *system_heap_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    if (nsize == 0)
+    {
+        heap_caps_free(ptr);
+        return nullptr;
+    }
+#ifdef LUAT_USE_PSRAM
+    return heap_caps_realloc_prefer(ptr, nsize, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_8BIT);
+#else
+    return heap_caps_realloc(ptr, nsize, MALLOC_CAP_8BIT);
+#endif
+}
+
  bool create_lua_state()
 {
-    L = lua_newstate(luat_heap_alloc, NULL);
+    L = build_lua_state();
     if (!L)
     {
         lastErrorMessage = "Failed to create Lua state";
         return false;
     }
+    return true;
+}
+
+// Build a fully initialised state: libraries, bindings and user registrations
+static lua_State *build_lua_state()
+{
+    lua_State *newL = lua_newstate(vmAllocator, NULL);
+    if (!newL)
+    {
+        return nullptr;
+    }
 
     // Set panic handler
-    lua_atpanic(L, [](lua_State *L) -> int
+    lua_atpanic(newL, [](lua_State *L) -> int
                 {
         const char* msg = lua_tostring(L, -1);
         if (errorCallback) {
@@ -139,10 +376,15 @@ static void execution_hook(lua_State *L, lua_Debug *ar)
         }
         return 0; });
 
+    // Cheap permanent preemption point, no per-instruction cost
+    lua_sethook(newL, execution_hook, LUA_MASKCOUNT, hookBudget);
+
     // Open libraries
-    luat_openlibs(L);
-    registerArduinoBindings(L);
-    lua_gc(L, LUA_GCCOLLECT, 0);
+    luat_openlibs(newL);
+    registerArduinoBindings(newL);
+    lua_profiler_register(newL);
+    lua_output_register(newL);
+    lua_gc(newL, LUA_GCCOLLECT, 0);
 
     // Register print override
     // lua_register(L, "print", [](lua_State* L) -> int {
@@ -162,10 +404,10 @@ static void execution_hook(lua_State *L, lua_Debug *ar)
     // User registrations
     if (registerCallback)
     {
-        registerCallback(L);
+        registerCallback(newL);
     }
 
-    return true;
+    return newL;
 }
 
  void destroy_lua_state()
@@ -179,6 +421,91 @@ static void execution_hook(lua_State *L, lua_Debug *ar)
     luat_timer_stop_all();
 }
 
+// Replace the running state with a clean one. With a spare ready this is a
+// pointer swap; the old state is closed later on this task, once the stop
+// has been reported, so its __gc finalizers still run on the Lua task.
+static void reset_lua_state()
+{
+    int64_t start = esp_timer_get_time();
+    lua_State *fresh = nullptr;
+
+    if (warmSpareEnabled && xSemaphoreTake(spareMutex, 0) == pdTRUE)
+    {
+        fresh = spareL;
+        spareL = nullptr;
+        xSemaphoreGive(spareMutex);
+    }
+
+    if (fresh)
+    {
+        close_retired_state();
+        retiredL = L;
+        L = fresh;
+        luat_timer_stop_all();
+        swapStats.warmSwaps++;
+    }
+    else
+    {
+        destroy_lua_state();
+        create_lua_state();
+        swapStats.coldRebuilds++;
+    }
+
+    swapStats.lastSwapUs = (uint32_t)(esp_timer_get_time() - start);
+    if (swapStats.lastSwapUs > swapStats.maxSwapUs)
+    {
+        swapStats.maxSwapUs = swapStats.lastSwapUs;
+    }
+
+    // Kick the spare task to build the next spare
+    if (warmSpareEnabled && spareTaskHandle)
+    {
+        xTaskNotifyGive(spareTaskHandle);
+    }
+}
+
+static void close_retired_state()
+{
+    if (retiredL)
+    {
+        lua_close(retiredL);
+        retiredL = nullptr;
+    }
+}
+
+// Runs on the core the Lua task is not pinned to
+static void lua_spare_task(void *param)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        bool needSpare = false;
+        if (xSemaphoreTake(spareMutex, portMAX_DELAY) == pdTRUE)
+        {
+            needSpare = (spareL == nullptr);
+            xSemaphoreGive(spareMutex);
+        }
+
+        if (needSpare)
+        {
+            int64_t start = esp_timer_get_time();
+            lua_State *built = build_lua_state();
+            if (built)
+            {
+                swapStats.lastBuildUs = (uint32_t)(esp_timer_get_time() - start);
+                xSemaphoreTake(spareMutex, portMAX_DELAY);
+                spareL = built;
+                xSemaphoreGive(spareMutex);
+            }
+            else
+            {
+                LLOGE("spare Lua state build failed");
+            }
+        }
+    }
+}
+
 // Internal execution functions
 static bool execute_string_internal(const char *code, bool persistent, bool autoRestart)
 {
@@ -190,7 +517,8 @@ static bool execute_string_internal(const char *code, bool persistent, bool auto
         }
     }
 
-    // Install hook for interruption
+    // Pick up budget changes made since the state was built
+    lua_sethook(L, execution_hook, LUA_MASKCOUNT, hookBudget);
 
     int result = luaL_dostring(L, code);
    lua_wrapper_print_memory_usage();
@@ -210,8 +538,7 @@ static bool execute_string_internal(const char *code, bool persistent, bool auto
         // Auto restart if requested
         if (autoRestart && !stopRequested)
         {
-            destroy_lua_state();
-            create_lua_state();
+            reset_lua_state();
             return execute_string_internal(code, persistent, false); // Only retry once CHANGE
         }
 
@@ -236,14 +563,12 @@ static bool execute_file_internal(const char *path, bool persistent, bool autoRe
         }
     }
 
-    // Install hook for interruption
-    // lua_sethook(L, execution_hook, LUA_MASKCOUNT, 1000);
+    // Pick up budget changes made since the state was built
+    lua_sethook(L, execution_hook, LUA_MASKCOUNT, hookBudget);
 
     int result = luaL_dofile(L, path);
    lua_wrapper_print_memory_usage();
         LLOGD("*****************LUA SCRIPT STOP*****************");
-    // Remove hook
-    lua_sethook(L, nullptr, 0, 0);
 
     if (result != LUA_OK)
     {
@@ -258,8 +583,7 @@ static bool execute_file_internal(const char *path, bool persistent, bool autoRe
         // Auto restart if requested
         if (autoRestart && !stopRequested)
         {
-            destroy_lua_state();
-            create_lua_state();
+            reset_lua_state();
             return execute_file_internal(path, persistent, false); // Only retry once
         }
 
@@ -298,6 +622,9 @@ static void lua_task(void *param)
 {
     Command cmd;
 
+    // print() from this task goes through the output ring
+    lua_output_set_producer(xTaskGetCurrentTaskHandle());
+
     // Initialize LuatOS system
     bootloader_random_enable();
 
@@ -317,15 +644,36 @@ static void lua_task(void *param)
     create_lua_state();
     set_execution_state(EXEC_STATE_READY);
 
+    // Start building the first spare now that LuatOS is up
+    if (spareTaskHandle)
+    {
+        xTaskNotifyGive(spareTaskHandle);
+    }
+
     while (true)
     {
         if (xQueueReceive(commandQueue, &cmd, portMAX_DELAY) == pdTRUE)
         {
+            uint32_t latency = (uint32_t)(esp_timer_get_time() - cmd.submitTime);
+            queueStats.lastLatencyUs = latency;
+            if (latency > queueStats.maxLatencyUs)
+            {
+                queueStats.maxLatencyUs = latency;
+            }
+            const char *data = cmd.slot != SCRIPT_HANDLE_INVALID ? scriptPool.data(cmd.slot) : "";
+
             switch (cmd.type)
             {
             case Command::CMD_EXEC_STRING:
+                clear_stop_request();
                 set_execution_state(EXEC_STATE_RUNNING);
-                execute_string_internal(cmd.data.c_str(), cmd.persistent, cmd.autoRestart);
+                if (execStartCallback)
+                {
+                    execStartCallback();
+                }
+                execute_string_internal(data, cmd.persistent, cmd.autoRestart);
+                run_stop_script();
+                clear_stop_request();
                 if (get_execution_state() == EXEC_STATE_RUNNING)
                 {
                     set_execution_state(EXEC_STATE_READY);
@@ -333,8 +681,11 @@ static void lua_task(void *param)
                 break;
 
             case Command::CMD_EXEC_FILE:
+                clear_stop_request();
                 set_execution_state(EXEC_STATE_RUNNING);
-                execute_file_internal(cmd.data.c_str(), cmd.persistent, cmd.autoRestart);
+                execute_file_internal(data, cmd.persistent, cmd.autoRestart);
+                run_stop_script();
+                clear_stop_request();
                 if (get_execution_state() == EXEC_STATE_RUNNING)
                 {
                     set_execution_state(EXEC_STATE_READY);
@@ -342,8 +693,11 @@ static void lua_task(void *param)
                 break;
 
             case Command::CMD_EXEC_MODULE:
+                clear_stop_request();
                 set_execution_state(EXEC_STATE_RUNNING);
-                execute_module_internal(cmd.data.c_str(), cmd.persistent, cmd.autoRestart);
+                execute_module_internal(data, cmd.persistent, cmd.autoRestart);
+                run_stop_script();
+                clear_stop_request();
                 if (get_execution_state() == EXEC_STATE_RUNNING)
                 {
                     set_execution_state(EXEC_STATE_READY);
@@ -351,21 +705,32 @@ static void lua_task(void *param)
                 break;
 
             case Command::CMD_STOP:
+                clear_stop_request();
                 // Process stop based on mode
                 if (cmd.stopMode == STOP_CLEAN)
                 {
-                    destroy_lua_state();
-                    create_lua_state();
+                    reset_lua_state();
                     }
                     set_execution_state(EXEC_STATE_READY);
                 
                 break;
 
             case Command::CMD_DESTROY:
+                close_retired_state();
                 destroy_lua_state();
                 vTaskDelete(NULL);
                 return;
             }
+
+            // Hand the buffer back to the pool
+            if (cmd.slot != SCRIPT_HANDLE_INVALID)
+            {
+                lua_wrapper_release_buffer(cmd.slot);
+            }
+            queueStats.completed++;
+
+            // Deferred from a warm swap: the stop is already reported
+            close_retired_state();
         }
     }
 }
@@ -376,7 +741,7 @@ static void lua_bg_task(void *param)
     String *code = (String *)param;
 
     // Create separate Lua state for background execution
-    lua_State *bgL = lua_newstate(luat_heap_alloc, NULL);
+    lua_State *bgL = lua_newstate(system_heap_alloc, NULL);
     if (bgL)
     {
         luat_openlibs(bgL);
@@ -419,6 +784,43 @@ bool lua_wrapper_init(size_t stackSize, int priority)
         return false;
     }
 
+    if (!init_script_slots())
+    {
+        free_script_slots();
+        vQueueDelete(commandQueue);
+        vSemaphoreDelete(stateMutex);
+        return false;
+    }
+
+    wakeEvents = xEventGroupCreate();
+    if (!wakeEvents)
+    {
+        free_script_slots();
+        vQueueDelete(commandQueue);
+        vSemaphoreDelete(stateMutex);
+        return false;
+    }
+
+    // The spare is built on another core while the main state runs, so the
+    // VM heap is serialised before either state exists. Without it only the
+    // Lua task allocates from bget and allocations stay lock-free.
+    if (warmSpareEnabled)
+    {
+        vmHeapMutex = xSemaphoreCreateMutex();
+        spareMutex = xSemaphoreCreateMutex();
+        if (!vmHeapMutex || !spareMutex ||
+            xTaskCreatePinnedToCore(lua_spare_task, "LuaSpareTask", 8192, nullptr,
+                                    tskIDLE_PRIORITY + 1, &spareTaskHandle, 0) != pdPASS)
+        {
+            LLOGE("warm spare disabled: task creation failed");
+            warmSpareEnabled = false;
+        }
+        else
+        {
+            vmAllocator = locked_heap_alloc;
+        }
+    }
+
     // Create task
     // BaseType_t result = xTaskCreate(
     //     lua_task,
@@ -439,6 +841,7 @@ bool lua_wrapper_init(size_t stackSize, int priority)
 
     if (result != pdPASS)
     {
+        free_script_slots();
         vQueueDelete(commandQueue);
         vSemaphoreDelete(stateMutex);
         return false;
@@ -456,8 +859,9 @@ void lua_wrapper_destroy()
 {
     if (commandQueue && luaTaskHandle)
     {
-        Command cmd = {
-            .type = Command::CMD_DESTROY};
+        Command cmd = {};
+        cmd.type = Command::CMD_DESTROY;
+        cmd.slot = SCRIPT_HANDLE_INVALID;
         xQueueSend(commandQueue, &cmd, portMAX_DELAY);
         vTaskDelay(pdMS_TO_TICKS(100));
     }
@@ -473,6 +877,8 @@ void lua_wrapper_destroy()
         vSemaphoreDelete(stateMutex);
         stateMutex = nullptr;
     }
+
+    free_script_slots();
 }
 
 bool lua_wrapper_exec_string(const char *code, bool persistent, bool autoRestart)
@@ -482,13 +888,7 @@ bool lua_wrapper_exec_string(const char *code, bool persistent, bool autoRestart
         return false;
     }
 
-    Command cmd = {
-        .type = Command::CMD_EXEC_STRING,
-        .data = code,
-        .persistent = persistent,
-        .autoRestart = autoRestart};
-
-    return xQueueSend(commandQueue, &cmd, pdMS_TO_TICKS(100)) == pdTRUE;
+    return submit_copy(Command::CMD_EXEC_STRING, code, persistent, autoRestart);
 }
 
 bool lua_wrapper_exec_file(const char *path, bool persistent, bool autoRestart)
@@ -498,13 +898,7 @@ bool lua_wrapper_exec_file(const char *path, bool persistent, bool autoRestart)
         return false;
     }
 
-    Command cmd = {
-        .type = Command::CMD_EXEC_FILE,
-        .data = path,
-        .persistent = persistent,
-        .autoRestart = autoRestart};
-
-    return xQueueSend(commandQueue, &cmd, pdMS_TO_TICKS(100)) == pdTRUE;
+    return submit_copy(Command::CMD_EXEC_FILE, path, persistent, autoRestart);
 }
 
 bool lua_wrapper_exec_module(const char *module, bool persistent, bool autoRestart)
@@ -514,13 +908,7 @@ bool lua_wrapper_exec_module(const char *module, bool persistent, bool autoResta
         return false;
     }
 
-    Command cmd = {
-        .type = Command::CMD_EXEC_MODULE,
-        .data = module,
-        .persistent = persistent,
-        .autoRestart = autoRestart};
-
-    return xQueueSend(commandQueue, &cmd, pdMS_TO_TICKS(100)) == pdTRUE;
+    return submit_copy(Command::CMD_EXEC_MODULE, module, persistent, autoRestart);
 }
 
 bool lua_wrapper_exec_string_bg(const char *code, bool persistent)
@@ -552,24 +940,150 @@ bool lua_wrapper_exec_string_bg(const char *code, bool persistent)
 
 bool lua_wrapper_stop(const char *stopScript, StopMode mode)
 {
+    // STOPPING: a stop script may be running, and this ends it
     ExecutionState state = get_execution_state();
-    if (state != EXEC_STATE_RUNNING)
+    if (state != EXEC_STATE_RUNNING && state != EXEC_STATE_STOPPING)
     {
         return false;
     }
 
-    // Set stop request
-    stopRequested = true;
-    stopScriptBuffer = stopScript ? stopScript : "";
+    // Hand the stop script to the Lua task through a pool slot
+    if (stopScript && stopScript[0] != '\0' && stopScriptSlot.load() == SCRIPT_HANDLE_INVALID)
+    {
+        char *buffer;
+        size_t capacity;
+        ScriptHandle slot = lua_wrapper_acquire_buffer(&buffer, &capacity, 0);
+        if (slot != SCRIPT_HANDLE_INVALID)
+        {
+            strlcpy(buffer, stopScript, capacity);
+            ScriptHandle expected = SCRIPT_HANDLE_INVALID;
+            if (!stopScriptSlot.compare_exchange_strong(expected, slot))
+            {
+                lua_wrapper_release_buffer(slot);
+            }
+        }
+    }
+
+    // Only the first request starts the latency clock
+    if (!stopRequested.exchange(true))
+    {
+        stopRequestTime = esp_timer_get_time();
+    }
+
+    // Wake anything parked in a blocking binding or rtos.receive
+    xEventGroupSetBits(wakeEvents, WAKE_STOP_BIT);
+    rtos_msg_t msg = {};
+    msg.handler = stop_wake_handler;
+    msg.arg1 = (int)runGeneration.load();
+    luat_msgbus_put(&msg, 0);
 
     // Queue cleanup command
-    Command cmd = {
-        .type = Command::CMD_STOP,
-        .data = "",
-        .stopMode = mode};
-        
-    lua_sethook(L, execution_hook, LUA_MASKCOUNT, 1);
-    return xQueueSend(commandQueue, &cmd, pdMS_TO_TICKS(100)) == pdTRUE;
+    Command cmd = {};
+    cmd.type = Command::CMD_STOP;
+    cmd.slot = SCRIPT_HANDLE_INVALID;
+    cmd.stopMode = mode;
+    return send_command(cmd);
+}
+
+bool lua_wrapper_stop_requested()
+{
+    return stopRequested;
+}
+
+bool lua_wrapper_sleep(uint32_t ms)
+{
+    if (stopRequested)
+    {
+        return false;
+    }
+    if (ms == 0)
+    {
+        return true;
+    }
+    if (!wakeEvents)
+    {
+        vTaskDelay(pdMS_TO_TICKS(ms));
+        return true;
+    }
+    EventBits_t bits = xEventGroupWaitBits(wakeEvents, WAKE_STOP_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(ms));
+    return (bits & WAKE_STOP_BIT) == 0;
+}
+
+void lua_wrapper_check_stop(lua_State *L)
+{
+    // Background-task states are never the target of a stop
+    if (stopRequested && xTaskGetCurrentTaskHandle() == luaTaskHandle)
+    {
+        handle_stop(L);
+    }
+}
+
+void lua_wrapper_set_hook_budget(int instructions)
+{
+    hookBudget = instructions > 0 ? instructions : LUA_WRAPPER_HOOK_BUDGET;
+}
+
+void lua_wrapper_get_stop_stats(LuaStopStats *stats)
+{
+    if (!stats)
+    {
+        return;
+    }
+    *stats = stopStats;
+    stats->hookBudget = hookBudget;
+}
+
+ScriptHandle lua_wrapper_acquire_buffer(char **buffer, size_t *capacity, uint32_t timeoutMs)
+{
+    ScriptHandle handle = scriptPool.acquire(buffer, capacity, timeoutMs);
+    if (handle == SCRIPT_HANDLE_INVALID)
+    {
+        lastErrorMessage = "No free script buffer";
+        queueStats.rejected++;
+        return SCRIPT_HANDLE_INVALID;
+    }
+    queueStats.slotsMinFree = scriptPool.minFree();
+    return handle;
+}
+
+bool lua_wrapper_submit_buffer(ScriptHandle handle, size_t length, bool persistent, bool autoRestart)
+{
+    if (!scriptPool.isValid(handle))
+    {
+        return false;
+    }
+
+    if (!commandQueue || get_execution_state() == EXEC_STATE_UNINITIALIZED ||
+        length >= LUA_WRAPPER_SCRIPT_SLOT_SIZE)
+    {
+        queueStats.rejected++;
+        lua_wrapper_release_buffer(handle);
+        return false;
+    }
+    scriptPool.data(handle)[length] = '\0';
+
+    Command cmd = {};
+    cmd.type = Command::CMD_EXEC_STRING;
+    cmd.slot = handle;
+    cmd.length = length;
+    cmd.persistent = persistent;
+    cmd.autoRestart = autoRestart;
+    return send_command(cmd);
+}
+
+void lua_wrapper_release_buffer(ScriptHandle handle)
+{
+    scriptPool.release(handle);
+}
+
+void lua_wrapper_get_queue_stats(LuaQueueStats *stats)
+{
+    if (!stats)
+    {
+        return;
+    }
+    *stats = queueStats;
+    stats->slotsFree = scriptPool.freeCount();
 }
 
 bool lua_wrapper_is_running()
@@ -603,6 +1117,11 @@ void lua_wrapper_set_register_cb(RegisterCallback cb)
     registerCallback = cb;
 }
 
+void lua_wrapper_set_exec_start_cb(ExecStartCallback cb)
+{
+    execStartCallback = cb;
+}
+
 void lua_wrapper_set_main_module(const char *name)
 {
     mainModuleName = name;
@@ -613,6 +1132,44 @@ void lua_wrapper_set_stop_module(const char *name)
     stopModuleName = name;
 }
 
+void lua_wrapper_set_warm_spare(bool enable)
+{
+    // Only honoured before lua_wrapper_init(), which starts the spare task
+    if (!commandQueue)
+    {
+        warmSpareEnabled = enable;
+    }
+}
+
+void lua_wrapper_get_swap_stats(LuaSwapStats *stats)
+{
+    if (!stats)
+    {
+        return;
+    }
+    *stats = swapStats;
+    stats->spareReady = false;
+    if (spareMutex && xSemaphoreTake(spareMutex, pdMS_TO_TICKS(10)) == pdTRUE)
+    {
+        stats->spareReady = (spareL != nullptr);
+        xSemaphoreGive(spareMutex);
+    }
+}
+
+// bstats walks the bget free list, so hold the heap lock while reading it
+void lua_wrapper_meminfo(size_t *total, size_t *used, size_t *maxUsed)
+{
+    if (vmHeapMutex)
+    {
+        xSemaphoreTake(vmHeapMutex, portMAX_DELAY);
+    }
+    luat_meminfo_luavm(total, used, maxUsed);
+    if (vmHeapMutex)
+    {
+        xSemaphoreGive(vmHeapMutex);
+    }
+}
+
 void lua_wrapper_print_memory_usage()
 {
     luat_os_print_heapinfo("Wrpper Memory Usage");
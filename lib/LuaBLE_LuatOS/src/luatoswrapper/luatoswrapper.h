@@ -8,6 +8,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
 #include "esp_timer.h"
+#include "scriptpool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +30,7 @@ extern "C" {
 #include "esp_task_wdt.h"
 #include "luat_rtos.h"
 #include "luat_fs.h"
+#include "luat_msgbus.h"
 #include <time.h>
 #include <sys/time.h>
 
@@ -51,10 +53,44 @@ enum StopMode {
     STOP_PERSISTENT  // Keep state after stop
 };
 
+struct LuaQueueStats {
+    uint32_t submitted;      // commands accepted by the queue
+    uint32_t completed;      // commands finished by the Lua task
+    uint32_t rejected;       // no free slot, oversized script or queue full
+    uint8_t slotsTotal;
+    uint8_t slotsFree;
+    uint8_t slotsMinFree;    // low-water mark of free slots
+    uint32_t lastLatencyUs;  // submit -> Lua task pickup
+    uint32_t maxLatencyUs;
+};
+
+// VM instructions between stop checks. The hook stays installed for the life
+// of the state, so stop latency is bounded without per-instruction cost.
+#ifndef LUA_WRAPPER_HOOK_BUDGET
+#define LUA_WRAPPER_HOOK_BUDGET 1000
+#endif
+
+struct LuaStopStats {
+    uint32_t stops;          // stops delivered to a running script
+    uint32_t lastLatencyUs;  // lua_wrapper_stop() -> script unwinding
+    uint32_t maxLatencyUs;
+    int hookBudget;
+};
+
+struct LuaSwapStats {
+    uint32_t warmSwaps;      // clean stops served by the spare state
+    uint32_t coldRebuilds;   // clean stops that had to rebuild inline
+    uint32_t lastSwapUs;     // time the Lua task spent replacing its state
+    uint32_t maxSwapUs;
+    uint32_t lastBuildUs;    // background build time of the last spare
+    bool spareReady;
+};
+
 // Callbacks
 typedef void (*OutputCallback)(const char* output);
 typedef void (*ErrorCallback)(const char* error);
 typedef void (*RegisterCallback)(lua_State* L);
+typedef void (*ExecStartCallback)();  // on the Lua task, right before a string runs
 
 // Initialization
 bool lua_wrapper_init(size_t stackSize = 16384, int priority = 1);
@@ -66,9 +102,24 @@ bool lua_wrapper_exec_file(const char* path, bool persistent = false, bool autoR
 bool lua_wrapper_exec_module(const char* module, bool persistent = false, bool autoRestart = false);
 bool lua_wrapper_exec_string_bg(const char* code, bool persistent = false);
 
+// Zero-copy submission: acquire a slot, fill it in place, then submit.
+// Submit always takes ownership of the slot, even when it fails; release is
+// only for abandoning a slot that was never submitted.
+ScriptHandle lua_wrapper_acquire_buffer(char** buffer, size_t* capacity, uint32_t timeoutMs = 100);
+bool lua_wrapper_submit_buffer(ScriptHandle handle, size_t length, bool persistent = false, bool autoRestart = false);
+void lua_wrapper_release_buffer(ScriptHandle handle);
+void lua_wrapper_get_queue_stats(LuaQueueStats* stats);
+
 // Control
 bool lua_wrapper_stop(const char* stopScript = nullptr, StopMode mode = STOP_CLEAN);
 bool lua_wrapper_is_running();
+bool lua_wrapper_stop_requested();
+void lua_wrapper_get_stop_stats(LuaStopStats* stats);
+
+// For blocking C bindings running on the Lua task. sleep returns false as soon
+// as a stop is requested; check_stop unwinds the script if one is pending.
+bool lua_wrapper_sleep(uint32_t ms);
+void lua_wrapper_check_stop(lua_State* L);
 ExecutionState lua_wrapper_get_state();
 const char* lua_wrapper_get_error();
 
@@ -76,11 +127,16 @@ const char* lua_wrapper_get_error();
 void lua_wrapper_set_output_cb(OutputCallback cb);
 void lua_wrapper_set_error_cb(ErrorCallback cb);
 void lua_wrapper_set_register_cb(RegisterCallback cb);
+void lua_wrapper_set_exec_start_cb(ExecStartCallback cb);
 void lua_wrapper_set_main_module(const char* name);
 void lua_wrapper_set_stop_module(const char* name);
+void lua_wrapper_set_warm_spare(bool enable);  // call before lua_wrapper_init
+void lua_wrapper_set_hook_budget(int instructions);  // applies from the next run
+void lua_wrapper_get_swap_stats(LuaSwapStats* stats);
 bool create_lua_state();
 void destroy_lua_state();
 // Utility
 void lua_wrapper_print_memory_usage();
+void lua_wrapper_meminfo(size_t* total, size_t* used, size_t* maxUsed);
 
 #endif  /* LUATOSWRAPPER_H */
@@ -0,0 +1,141 @@
+#ifndef PROFILEREPORT_H
+#define PROFILEREPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Profiler entries and their JSON form. Plain C++ so the report is tested on
+// the host.
+#ifndef LUA_PROFILER_ENTRIES
+#define LUA_PROFILER_ENTRIES 48
+#endif
+
+#ifndef LUA_PROFILER_SOURCE_LEN
+#define LUA_PROFILER_SOURCE_LEN 32
+#endif
+
+#ifndef LUA_PROFILER_NAME_LEN
+#define LUA_PROFILER_NAME_LEN 20
+#endif
+
+struct LuaProfileEntry {
+    char source[LUA_PROFILER_SOURCE_LEN];
+    int16_t line;         // current line when sampled
+    int16_t funcLine;     // line where the enclosing function is defined
+    char function[LUA_PROFILER_NAME_LEN];  // name it was called by, "" if unknown
+    uint32_t samples;
+    int32_t allocBytes;   // Lua heap growth charged to this line
+};
+
+// Partial selection sort: only the first maxEntries end up ranked by samples.
+// Returns how many are ranked.
+inline int profile_rank(LuaProfileEntry *entries, int count, int maxEntries)
+{
+    if (maxEntries > count)
+    {
+        maxEntries = count;
+    }
+    for (int i = 0; i < maxEntries; i++)
+    {
+        int best = i;
+        for (int j = i + 1; j < count; j++)
+        {
+            if (entries[j].samples > entries[best].samples)
+            {
+                best = j;
+            }
+        }
+        if (best != i)
+        {
+            LuaProfileEntry tmp = entries[i];
+            entries[i] = entries[best];
+            entries[best] = tmp;
+        }
+    }
+    return maxEntries < 0 ? 0 : maxEntries;
+}
+
+inline bool profile_append(char *out, size_t &pos, size_t limit, const char *text, size_t length)
+{
+    if (pos + length > limit)
+    {
+        return false;
+    }
+    memcpy(out + pos, text, length);
+    pos += length;
+    return true;
+}
+
+// Sources come from chunk names, and a luaL_dostring chunk is named after the
+// script's first line, so anything can be in them. Quotes, backslashes and
+// control characters are escaped; bytes above 0x7F become '?', since the copy
+// into the entry may have cut a UTF-8 sequence short.
+inline bool profile_append_string(char *out, size_t &pos, size_t limit, const char *text)
+{
+    if (!profile_append(out, pos, limit, "\"", 1))
+    {
+        return false;
+    }
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+    {
+        char escaped[8];
+        size_t length;
+        if (*c == '"' || *c == '\\')
+        {
+            escaped[0] = '\\';
+            escaped[1] = (char)*c;
+            length = 2;
+        }
+        else if (*c < 0x20)
+        {
+            length = snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+        }
+        else
+        {
+            escaped[0] = *c < 0x80 ? (char)*c : '?';
+            length = 1;
+        }
+        if (!profile_append(out, pos, limit, escaped, length))
+        {
+            return false;
+        }
+    }
+    return profile_append(out, pos, limit, "\"", 1);
+}
+
+// Appends ["src",line,"function",funcLine,samples,alloc] items, comma
+// separated, up to outSize - reserve. An item that does not fit is left out
+// whole, with the ones after it. Returns the new end of the text.
+inline size_t profile_format_entries(char *out, size_t pos, size_t outSize, size_t reserve,
+                                     const LuaProfileEntry *entries, int count)
+{
+    if (pos + reserve > outSize)
+    {
+        return pos;
+    }
+    size_t limit = outSize - reserve;
+    for (int i = 0; i < count; i++)
+    {
+        const LuaProfileEntry &e = entries[i];
+        size_t start = pos;
+        char number[16];
+        char counts[48];
+        int numberLen = snprintf(number, sizeof(number), ",%d,", e.line);
+        int countsLen = snprintf(counts, sizeof(counts), ",%d,%lu,%ld]", e.funcLine,
+                                 (unsigned long)e.samples, (long)e.allocBytes);
+        bool fits = profile_append(out, pos, limit, i ? ",[" : "[", i ? 2 : 1) &&
+                    profile_append_string(out, pos, limit, e.source) &&
+                    profile_append(out, pos, limit, number, numberLen) &&
+                    profile_append_string(out, pos, limit, e.function) &&
+                    profile_append(out, pos, limit, counts, countsLen);
+        if (!fits)
+        {
+            return start;
+        }
+    }
+    return pos;
+}
+
+#endif  /* PROFILEREPORT_H */
@@ -0,0 +1,95 @@
+#include "scriptpool.h"
+#include "esp_heap_caps.h"
+
+bool ScriptPool::init()
+{
+    freeQueue = xQueueCreate(LUA_WRAPPER_SCRIPT_SLOTS, sizeof(ScriptHandle));
+    if (!freeQueue)
+    {
+        return false;
+    }
+
+    for (ScriptHandle i = 0; i < LUA_WRAPPER_SCRIPT_SLOTS; i++)
+    {
+#ifdef LUAT_USE_PSRAM
+        slots[i] = (char *)heap_caps_malloc(LUA_WRAPPER_SCRIPT_SLOT_SIZE, MALLOC_CAP_SPIRAM);
+        if (!slots[i])
+#endif
+        {
+            slots[i] = (char *)heap_caps_malloc(LUA_WRAPPER_SCRIPT_SLOT_SIZE, MALLOC_CAP_8BIT);
+        }
+        if (!slots[i])
+        {
+            return false;
+        }
+        inUse[i] = false;
+        xQueueSend(freeQueue, &i, 0);
+    }
+    lowWater = LUA_WRAPPER_SCRIPT_SLOTS;
+    return true;
+}
+
+void ScriptPool::destroy()
+{
+    for (int i = 0; i < LUA_WRAPPER_SCRIPT_SLOTS; i++)
+    {
+        if (slots[i])
+        {
+            heap_caps_free(slots[i]);
+            slots[i] = nullptr;
+        }
+        inUse[i] = false;
+    }
+    if (freeQueue)
+    {
+        vQueueDelete(freeQueue);
+        freeQueue = nullptr;
+    }
+}
+
+ScriptHandle ScriptPool::acquire(char **buffer, size_t *capacity, uint32_t timeoutMs)
+{
+    ScriptHandle handle = SCRIPT_HANDLE_INVALID;
+    if (!freeQueue || xQueueReceive(freeQueue, &handle, pdMS_TO_TICKS(timeoutMs)) != pdTRUE)
+    {
+        return SCRIPT_HANDLE_INVALID;
+    }
+
+    uint8_t freeNow = uxQueueMessagesWaiting(freeQueue);
+    taskENTER_CRITICAL(&lock);
+    inUse[handle] = true;
+    if (freeNow < lowWater)
+    {
+        lowWater = freeNow;
+    }
+    taskEXIT_CRITICAL(&lock);
+
+    *buffer = slots[handle];
+    *capacity = LUA_WRAPPER_SCRIPT_SLOT_SIZE;
+    return handle;
+}
+
+bool ScriptPool::release(ScriptHandle handle)
+{
+    if (!isValid(handle) || !freeQueue)
+    {
+        return false;
+    }
+
+    bool owned;
+    taskENTER_CRITICAL(&lock);
+    owned = inUse[handle];
+    inUse[handle] = false;
+    taskEXIT_CRITICAL(&lock);
+
+    if (owned)
+    {
+        xQueueSend(freeQueue, &handle, 0);
+    }
+    return owned;
+}
+
+uint8_t ScriptPool::freeCount() const
+{
+    return freeQueue ? uxQueueMessagesWaiting(freeQueue) : 0;
+}
@@ -0,0 +1,50 @@
+#ifndef SCRIPTPOOL_H
+#define SCRIPTPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+// Script buffer pool. Commands carry a slot handle instead of a String so
+// submitting a script never touches the heap; slots live in PSRAM when available.
+#ifndef LUA_WRAPPER_SCRIPT_SLOTS
+#define LUA_WRAPPER_SCRIPT_SLOTS 4
+#endif
+
+#ifndef LUA_WRAPPER_SCRIPT_SLOT_SIZE
+#ifdef LUAT_USE_PSRAM
+#define LUA_WRAPPER_SCRIPT_SLOT_SIZE (32 * 1024)
+#else
+#define LUA_WRAPPER_SCRIPT_SLOT_SIZE (8 * 1024)
+#endif
+#endif
+
+typedef int16_t ScriptHandle;
+#define SCRIPT_HANDLE_INVALID ((ScriptHandle)-1)
+
+// Free list is a queue so producers can wait for a slot; the in-use flags
+// keep a double release from putting a slot on it twice. Only FreeRTOS and
+// heap_caps, so it also builds against the host shims in test/host.
+class ScriptPool
+{
+public:
+    bool init();
+    void destroy();
+    ScriptHandle acquire(char **buffer, size_t *capacity, uint32_t timeoutMs);
+    // false for an invalid handle or one that is not checked out
+    bool release(ScriptHandle handle);
+    char *data(ScriptHandle handle) { return slots[handle]; }
+    bool isValid(ScriptHandle handle) const { return handle >= 0 && handle < LUA_WRAPPER_SCRIPT_SLOTS; }
+    uint8_t freeCount() const;
+    uint8_t minFree() const { return lowWater; }
+
+private:
+    char *slots[LUA_WRAPPER_SCRIPT_SLOTS] = {nullptr};
+    bool inUse[LUA_WRAPPER_SCRIPT_SLOTS] = {false};
+    QueueHandle_t freeQueue = nullptr;
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    volatile uint8_t lowWater = 0;
+};
+
+#endif
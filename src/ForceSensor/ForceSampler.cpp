@@ -0,0 +1,261 @@
+/*
+ * ForceSampler.cpp - Background acquisition for both force sensors
+ */
+
+#include "ForceSampler.h"
+
+ForceSampler::ForceSampler() {
+  _pins[0] = _pins[1] = 0;
+  _dmaCapable = false;
+  _rateHz = 0;
+  _decimation = 1;
+  _windowLen = 1;
+  _alpha = 1;
+  _running = false;
+  _task = nullptr;
+  _adc = nullptr;
+  _timer = nullptr;
+  _frame = nullptr;
+  _frameBytes = 0;
+  memset(_channels, 0, sizeof(_channels));
+  memset(&_stats, 0, sizeof(_stats));
+  _lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+ForceSampler::~ForceSampler() {
+  stop();
+  if (_timer) {
+    esp_timer_delete(_timer);
+  }
+}
+
+void ForceSampler::begin(uint8_t leftPin, uint8_t rightPin) {
+  _pins[0] = leftPin;
+  _pins[1] = rightPin;
+  _dmaCapable = true;
+  for (int i = 0; i < FORCE_CHANNELS; i++) {
+    adc_unit_t unit;
+    if (adc_continuous_io_to_channel(_pins[i], &unit, &_adcChannels[i]) != ESP_OK || unit != ADC_UNIT_1) {
+      _dmaCapable = false;
+    }
+  }
+}
+
+bool ForceSampler::start(uint32_t rateHz, uint16_t decimation, uint16_t windowMs) {
+  if (_running || _task || decimation == 0 ||
+      rateHz < FORCE_RATE_MIN_HZ || rateHz > FORCE_RATE_MAX_HZ) {
+    return false;
+  }
+  _rateHz = _dmaCapable ? rateHz : min(rateHz, (uint32_t)FORCE_ONESHOT_MAX_HZ);
+  _decimation = decimation;
+  uint32_t outputHz = max(_rateHz / _decimation, (uint32_t)1);
+  _windowLen = constrain(windowMs * outputHz / 1000, (uint32_t)1, (uint32_t)FORCE_WINDOW_MAX);
+  float dt = 1000.0f / outputHz;
+  _alpha = dt / (FORCE_FILTER_TAU_MS + dt);
+
+  taskENTER_CRITICAL(&_lock);
+  memset(_channels, 0, sizeof(_channels));
+  _stats.rateHz = _rateHz;
+  _stats.outputHz = outputHz;
+  _stats.dma = _dmaCapable;
+  taskEXIT_CRITICAL(&_lock);
+
+  _running = true;
+  BaseType_t result = xTaskCreatePinnedToCore(
+    sampleTask,
+    "ForceSampler",
+    3072,
+    this,
+    4,  // below the lidar task, above application tasks
+    &_task,
+    1);
+  if (result != pdPASS) {
+    _running = false;
+    _task = nullptr;
+    return false;
+  }
+
+  if (_dmaCapable ? startDma() : startTimer()) {
+    return true;
+  }
+  stop();
+  return false;
+}
+
+// The task tears the DMA handle down itself: it may be inside a read
+void ForceSampler::stop() {
+  if (!_running) {
+    return;
+  }
+  _running = false;
+  if (_timer) {
+    esp_timer_stop(_timer);
+  }
+  if (_task) {
+    xTaskNotifyGive(_task);
+  }
+  for (int i = 0; _task && i < 100; i++) {
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+}
+
+bool ForceSampler::startDma() {
+  uint32_t conversions = _rateHz * FORCE_CHANNELS * FORCE_FRAME_MS / 1000;
+  conversions = constrain(conversions, (uint32_t)FORCE_CHANNELS, (uint32_t)256);
+  _frameBytes = conversions * SOC_ADC_DIGI_RESULT_BYTES;
+  free(_frame);
+  _frame = (uint8_t *)malloc(_frameBytes);
+
+  adc_continuous_handle_cfg_t handleConfig = {};
+  handleConfig.max_store_buf_size = _frameBytes * 8;
+  handleConfig.conv_frame_size = _frameBytes;
+  if (!_frame || adc_continuous_new_handle(&handleConfig, &_adc) != ESP_OK) {
+    return false;
+  }
+
+  adc_digi_pattern_config_t pattern[FORCE_CHANNELS] = {};
+  for (int i = 0; i < FORCE_CHANNELS; i++) {
+    pattern[i].atten = ADC_ATTEN_DB_12;  // analogRead's default
+    pattern[i].channel = _adcChannels[i];
+    pattern[i].unit = ADC_UNIT_1;
+    pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
+  adc_continuous_config_t config = {};
+  config.pattern_num = FORCE_CHANNELS;
+  config.adc_pattern = pattern;
+  config.sample_freq_hz = _rateHz * FORCE_CHANNELS;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+
+  adc_continuous_evt_cbs_t callbacks = {};
+  callbacks.on_conv_done = onConvDone;
+  callbacks.on_pool_ovf = onPoolOverflow;
+  return adc_continuous_config(_adc, &config) == ESP_OK &&
+         adc_continuous_register_event_callbacks(_adc, &callbacks, this) == ESP_OK &&
+         adc_continuous_start(_adc) == ESP_OK;
+}
+
+bool ForceSampler::startTimer() {
+  if (!_timer) {
+    const esp_timer_create_args_t args = {
+      .callback = onTimer,
+      .arg = this,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "ForceSampler",
+      .skip_unhandled_events = true};
+    esp_timer_create(&args, &_timer);
+  }
+  return _timer && esp_timer_start_periodic(_timer, 1000000 / _rateHz) == ESP_OK;
+}
+
+bool IRAM_ATTR ForceSampler::onConvDone(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *arg) {
+  ForceSampler *sampler = static_cast<ForceSampler *>(arg);
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(sampler->_task, &woken);
+  return woken == pdTRUE;
+}
+
+bool IRAM_ATTR ForceSampler::onPoolOverflow(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *arg) {
+  static_cast<ForceSampler *>(arg)->_stats.overruns++;
+  return false;
+}
+
+void ForceSampler::onTimer(void *arg) {
+  ForceSampler *sampler = static_cast<ForceSampler *>(arg);
+  if (sampler->_task) {
+    xTaskNotifyGive(sampler->_task);
+  }
+}
+
+void ForceSampler::sampleTask(void *param) {
+  ForceSampler *sampler = static_cast<ForceSampler *>(param);
+  while (sampler->_running) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (!sampler->_running) {
+      break;
+    }
+    if (!sampler->_dmaCapable) {
+      for (uint8_t i = 0; i < FORCE_CHANNELS; i++) {
+        sampler->accumulate(i, analogRead(sampler->_pins[i]));
+      }
+      continue;
+    }
+
+    // Drain every completed frame; conversions carry their channel
+    uint32_t length = 0;
+    while (sampler->_adc && adc_continuous_read(sampler->_adc, sampler->_frame, sampler->_frameBytes, &length, 0) == ESP_OK) {
+      for (uint32_t offset = 0; offset + SOC_ADC_DIGI_RESULT_BYTES <= length; offset += SOC_ADC_DIGI_RESULT_BYTES) {
+        adc_digi_output_data_t *data = (adc_digi_output_data_t *)&sampler->_frame[offset];
+        for (uint8_t i = 0; i < FORCE_CHANNELS; i++) {
+          if (data->type2.channel == sampler->_adcChannels[i]) {
+            sampler->accumulate(i, data->type2.data);
+          }
+        }
+      }
+    }
+  }
+  if (sampler->_adc) {
+    adc_continuous_stop(sampler->_adc);
+    adc_continuous_deinit(sampler->_adc);
+    sampler->_adc = nullptr;
+  }
+  sampler->_task = nullptr;
+  vTaskDelete(NULL);
+}
+
+// Decimation: every `_decimation` conversions become one value
+void ForceSampler::accumulate(uint8_t channel, uint16_t raw) {
+  Channel &c = _channels[channel];
+  c.accum += raw;
+  if (++c.accumCount >= _decimation) {
+    publish(channel, (c.accum + _decimation / 2) / _decimation);
+    c.accum = 0;
+    c.accumCount = 0;
+  }
+}
+
+void ForceSampler::publish(uint8_t channel, uint16_t value) {
+  Channel &c = _channels[channel];
+  taskENTER_CRITICAL(&_lock);
+  c.filtered = c.count ? _alpha * value + (1 - _alpha) * c.filtered : value;
+  if (c.count == _windowLen) {
+    c.sum -= c.window[c.next];
+  } else {
+    c.count++;
+  }
+  c.window[c.next] = value;
+  c.sum += value;
+  c.next = (c.next + 1) % _windowLen;
+  c.latest = value;
+  _stats.outputs++;
+  taskEXIT_CRITICAL(&_lock);
+}
+
+uint16_t ForceSampler::latest(uint8_t channel) {
+  taskENTER_CRITICAL(&_lock);
+  uint16_t value = _channels[channel].latest;
+  taskEXIT_CRITICAL(&_lock);
+  return value;
+}
+
+float ForceSampler::windowMean(uint8_t channel) {
+  taskENTER_CRITICAL(&_lock);
+  const Channel &c = _channels[channel];
+  float value = c.count ? (float)c.sum / c.count : 0;
+  taskEXIT_CRITICAL(&_lock);
+  return value;
+}
+
+float ForceSampler::filtered(uint8_t channel) {
+  taskENTER_CRITICAL(&_lock);
+  float value = _channels[channel].filtered;
+  taskEXIT_CRITICAL(&_lock);
+  return value;
+}
+
+ForceSamplerStats ForceSampler::getStats() {
+  taskENTER_CRITICAL(&_lock);
+  ForceSamplerStats stats = _stats;
+  taskEXIT_CRITICAL(&_lock);
+  return stats;
+}
@@ -0,0 +1,87 @@
+/*
+ * ForceSampler.h - Background acquisition for both force sensors
+ * Samples the two pins continuously, decimates and filters in a task, and
+ * keeps the latest, windowed and filtered values for O(1) reads.
+ */
+
+#ifndef ForceSampler_h
+#define ForceSampler_h
+
+#include "Arduino.h"
+#include "esp_timer.h"
+#include "esp_adc/adc_continuous.h"
+
+#define FORCE_CHANNELS 2
+#define FORCE_RATE_MIN_HZ 1000
+#define FORCE_RATE_MAX_HZ 10000
+#define FORCE_ONESHOT_MAX_HZ 1000  // analogRead fallback, keeps the CPU cost low
+#define FORCE_WINDOW_MAX 256       // decimated values kept for the windowed mean
+#define FORCE_FILTER_TAU_MS 50     // low-pass time constant of the filtered value
+#define FORCE_FRAME_MS 2           // DMA frame length, the latency of a new value
+
+struct ForceSamplerStats {
+  uint32_t rateHz;    // conversions per pin per second actually running
+  uint32_t outputHz;  // after decimation
+  uint32_t outputs;   // decimated values produced, both channels
+  uint32_t overruns;  // DMA pool full, conversions lost
+  bool dma;           // false: timer-driven analogRead
+};
+
+class ForceSampler {
+  private:
+    struct Channel {
+      uint16_t latest;
+      float filtered;
+      uint16_t window[FORCE_WINDOW_MAX];
+      uint32_t sum;
+      uint16_t count;
+      uint16_t next;
+      uint32_t accum;       // acquisition task only
+      uint16_t accumCount;
+    };
+
+    uint8_t _pins[FORCE_CHANNELS];
+    adc_channel_t _adcChannels[FORCE_CHANNELS];
+    bool _dmaCapable;
+    uint32_t _rateHz;
+    uint16_t _decimation;
+    uint16_t _windowLen;
+    float _alpha;
+    volatile bool _running;
+    TaskHandle_t _task;
+    adc_continuous_handle_t _adc;
+    esp_timer_handle_t _timer;
+    uint8_t *_frame;
+    uint32_t _frameBytes;
+    Channel _channels[FORCE_CHANNELS];
+    portMUX_TYPE _lock;
+    ForceSamplerStats _stats;
+
+    bool startDma();
+    bool startTimer();
+    void accumulate(uint8_t channel, uint16_t raw);
+    void publish(uint8_t channel, uint16_t value);
+    static void sampleTask(void *param);
+    static bool IRAM_ATTR onConvDone(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *arg);
+    static bool IRAM_ATTR onPoolOverflow(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *arg);
+    static void onTimer(void *arg);
+
+  public:
+    ForceSampler();
+    ~ForceSampler();
+
+    // DMA is used when both pins are on ADC1, otherwise analogRead on a timer
+    void begin(uint8_t leftPin, uint8_t rightPin);
+    // rateHz per pin, 1..10 kHz; every `decimation` conversions are averaged
+    // into one value and the windowed mean covers windowMs of those
+    bool start(uint32_t rateHz, uint16_t decimation, uint16_t windowMs);
+    void stop();
+    bool isRunning() { return _running; }
+
+    uint16_t latest(uint8_t channel);
+    float windowMean(uint8_t channel);
+    float filtered(uint8_t channel);
+    ForceSamplerStats getStats();
+};
+
+#endif
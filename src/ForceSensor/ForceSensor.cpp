@@ -11,6 +11,8 @@ ForceSensor::ForceSensor(uint8_t pin, int samples, float filterAlpha) {
   _samples = samples;
   _filterAlpha = filterAlpha;
   _filteredValue = 0;
+  _sampler = nullptr;
+  _channel = 0;
 }
 
 // Initialize the sensor
@@ -26,13 +28,24 @@ void ForceSensor::begin() {
   _filteredValue = readAverage();
 }
 
-// Read raw value
+void ForceSensor::attach(ForceSampler *sampler, uint8_t channel) {
+  _sampler = sampler;
+  _channel = channel;
+}
+
+// Read raw value (latest decimated value when sampled in the background)
 int ForceSensor::read() {
+  if (_sampler && _sampler->isRunning()) {
+    return _sampler->latest(_channel);
+  }
   return analogRead(_pin);
 }
 
-// Read average of multiple samples
+// Read average of multiple samples (windowed mean when sampled in the background)
 float ForceSensor::readAverage() {
+  if (_sampler && _sampler->isRunning()) {
+    return _sampler->windowMean(_channel);
+  }
   float sum = 0;
   for (int i = 0; i < _samples; i++) {
     sum += read();
@@ -43,6 +56,9 @@ float ForceSensor::readAverage() {
 
 // Read with low-pass filter for stability
 float ForceSensor::readFiltered() {
+  if (_sampler && _sampler->isRunning()) {
+    return _sampler->filtered(_channel);
+  }
   float currentReading = readAverage();
   _filteredValue = _filterAlpha * currentReading + (1 - _filterAlpha) * _filteredValue;
   return _filteredValue;
@@ -8,6 +8,7 @@
 #define ForceSensor_h
 
 #include "Arduino.h"
+#include "ForceSampler.h"
 
 class ForceSensor {
   private:
@@ -15,6 +16,8 @@ class ForceSensor {
     int _samples;                // Number of samples for averaging
     float _filterAlpha;          // Low pass filter alpha (0-1)
     float _filteredValue;        // Filtered sensor value
+    ForceSampler *_sampler;      // Background engine, once attached
+    uint8_t _channel;            // This sensor's channel in it
     
   public:
     // Constructor
@@ -22,6 +25,8 @@ class ForceSensor {
     
     // Methods
     void begin();
+    // Reads become O(1) lookups of the sampler's values while it runs
+    void attach(ForceSampler *sampler, uint8_t channel);
     int read();
     float readAverage();
     float readFiltered();
@@ -21,6 +21,10 @@ void lua_register_forcesensor(lua_State *L)
     lua_register(L, "force_sensor_both_read_average", lua_wrapper_force_sensor_both_read_average);
     lua_register(L, "force_sensor_both_read_filtered", lua_wrapper_force_sensor_both_read_filtered);
 
+    // Background sampler
+    lua_register(L, "force_sensor_set_rate", lua_wrapper_force_sensor_set_rate);
+    lua_register(L, "force_sensor_stats", lua_wrapper_force_sensor_stats);
+
     LLOGI("Force Sensor Lua functions registered");
 }
 
@@ -121,4 +125,52 @@ static int lua_wrapper_force_sensor_both_read_filtered(lua_State *lua_state)
     lua_pushnumber(lua_state, leftValue);   // First return value (left)
     lua_pushnumber(lua_state, rightValue);  // Second return value (right)
     return 2; // Return 2 values
-}
\ No newline at end of file
+}
+
+// BACKGROUND SAMPLER
+// force_sensor_set_rate(rate_hz [, decimation [, window_ms]]) -> rate of decimated values in Hz,
+// or nil and a message. Restarts sampling; until it runs again reads fall back to analogRead.
+static int lua_wrapper_force_sensor_set_rate(lua_State *lua_state)
+{
+    lua_Integer rate = luaL_checkinteger(lua_state, 1);
+    lua_Integer decimation = luaL_optinteger(lua_state, 2, FORCE_DECIMATION);
+    lua_Integer windowMs = luaL_optinteger(lua_state, 3, FORCE_WINDOW_MS);
+    if (rate < FORCE_RATE_MIN_HZ || rate > FORCE_RATE_MAX_HZ)
+    {
+        return luaL_error(lua_state, "rate_hz must be %d..%d", FORCE_RATE_MIN_HZ, FORCE_RATE_MAX_HZ);
+    }
+    if (decimation < 1 || decimation > UINT16_MAX || windowMs < 1 || windowMs > UINT16_MAX)
+    {
+        return luaL_error(lua_state, "decimation and window_ms must be 1..%d", UINT16_MAX);
+    }
+
+    forceSampler.stop();
+    if (!forceSampler.start(rate, decimation, windowMs))
+    {
+        lua_pushnil(lua_state);
+        lua_pushstring(lua_state, "force sampler did not start");
+        return 2;
+    }
+    lua_pushinteger(lua_state, forceSampler.getStats().outputHz);
+    return 1;
+}
+
+// force_sensor_stats() -> {running, dma, rate_hz, output_hz, outputs, overruns}
+static int lua_wrapper_force_sensor_stats(lua_State *lua_state)
+{
+    ForceSamplerStats stats = forceSampler.getStats();
+    lua_createtable(lua_state, 0, 6);
+    lua_pushboolean(lua_state, forceSampler.isRunning());
+    lua_setfield(lua_state, -2, "running");
+    lua_pushboolean(lua_state, stats.dma);
+    lua_setfield(lua_state, -2, "dma");
+    lua_pushinteger(lua_state, stats.rateHz);
+    lua_setfield(lua_state, -2, "rate_hz");
+    lua_pushinteger(lua_state, stats.outputHz);
+    lua_setfield(lua_state, -2, "output_hz");
+    lua_pushinteger(lua_state, stats.outputs);
+    lua_setfield(lua_state, -2, "outputs");
+    lua_pushinteger(lua_state, stats.overruns);
+    lua_setfield(lua_state, -2, "overruns");
+    return 1;
+}
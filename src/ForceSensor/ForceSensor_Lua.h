@@ -24,4 +24,8 @@ static int lua_wrapper_force_sensor_both_read(lua_State *lua_state);
 static int lua_wrapper_force_sensor_both_read_average(lua_State *lua_state);
 static int lua_wrapper_force_sensor_both_read_filtered(lua_State *lua_state);
 
+// Background sampler
+static int lua_wrapper_force_sensor_set_rate(lua_State *lua_state);
+static int lua_wrapper_force_sensor_stats(lua_State *lua_state);
+
 #endif
\ No newline at end of file
@@ -3,94 +3,348 @@
 uint8_t Lidar::instanceCounter = 0;
 
 Lidar::Lidar()
-   
+
 {
     instanceId = ++instanceCounter;
+    sensor = &vl53;
+    _intPin = -1;
+    _profile = LIDAR_PROFILE_DEFAULT;
+    _periodMs = lidarProfiles[_profile].periodMs;
+    _periodUs = lidar_effective_period_us(lidarProfiles[_profile], _periodMs);
     _running = false;
-    _distance = 0;
-
-    // Initialize the mutex for this instance
-    mutex = xSemaphoreCreateMutex();
+    _task = nullptr;
+    _pollTimer = nullptr;
+    _irqTimeUs = 0;
+    _lastSampleUs = 0;
+    memset(&_latest, 0, sizeof(_latest));
+    memset(&_stats, 0, sizeof(_stats));
+    _latestLock = portMUX_INITIALIZER_UNLOCKED;
+    _filterConfig = lidarFilterDefaults;
+    _filter.configure(_filterConfig);
+    _filterRejects = _filterConfig.reject;
+    _filterPending = false;
+    _gateConfig = lidarGateDefaults;
+    _gate.configure(_gateConfig);
+    _gateUseFiltered = _gateConfig.useFiltered;
+    _gateHandler = _pendingHandler = nullptr;
+    _gateArg = _pendingArg = nullptr;
+    _gatePending = false;
 }
 
-bool Lidar::begin(TwoWire *_bus,int _sda,int _scl)
+bool Lidar::begin(TwoWire *_bus,int _sda,int _scl, int intPin)
 {
 
     // _bus->begin(_sda, _scl);
-    sensor.begin(0x29, true, _bus);
-    return (mutex != NULL); // Ensure mutex is successfully created
+    _intPin = intPin;
+    return vl53.begin(_bus);
 }
 
-bool Lidar::start()
+bool Lidar::begin(RangeSensor *rangeSensor, int intPin)
 {
-    if (!_running)
+    sensor = rangeSensor;
+    _intPin = intPin;
+    return sensor != nullptr;
+}
+
+bool Lidar::start(uint16_t periodMs)
+{
+    if (_running || _task)
     {
-        sensor.startRangeContinuous();
-        _running = true;
+        return false;
+    }
+    _periodMs = periodMs ? periodMs : lidarProfiles[_profile].periodMs;
+    _periodUs = lidar_effective_period_us(lidarProfiles[_profile], _periodMs);
+    if (!sensor->startContinuous(_periodMs))
+    {
+        return false;
+    }
+    _running = true;
 
-        // Use a unique task name for each instance
-        snprintf(taskName, sizeof(taskName), "LidarTask%d", instanceId);
-        
-        BaseType_t result = xTaskCreate(
-            readTask, // Task function
-            taskName, // Task name
-            3000,     // Stack size
-            this,     // Parameters
-            1,        // Priority
-            NULL      // Task handle
-        );
+    // Use a unique task name for each instance
+    snprintf(taskName, sizeof(taskName), "LidarTask%d", instanceId);
 
-        return (result == pdPASS);
+    BaseType_t result = xTaskCreatePinnedToCore(
+        readTask, // Task function
+        taskName, // Task name
+        3072,     // Stack size
+        this,     // Parameters
+        5,        // Above application tasks: timestamps are taken on wake
+        &_task,   // Task handle
+        1
+    );
+    if (result != pdPASS)
+    {
+        _running = false;
+        _task = nullptr;
+        sensor->stopContinuous();
+        return false;
     }
-    return false;
+
+    if (_intPin >= 0)
+    {
+        pinMode(_intPin, INPUT_PULLUP);
+        attachInterruptArg(_intPin, onDataReady, this, FALLING);
+        return true;
+    }
+
+    if (!_pollTimer)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = onPollTimer,
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = taskName,
+            .skip_unhandled_events = true};
+        esp_timer_create(&args, &_pollTimer);
+    }
+    return _pollTimer && esp_timer_start_periodic(_pollTimer, LIDAR_POLL_US) == ESP_OK;
 }
 
+// The task stops the sensor itself: it owns the bus while running
 void Lidar::stop()
 {
+    if (!_running)
+    {
+        return;
+    }
     _running = false;
+    if (_intPin >= 0)
+    {
+        detachInterrupt(_intPin);
+    }
+    else if (_pollTimer)
+    {
+        esp_timer_stop(_pollTimer);
+    }
+    if (_task)
+    {
+        xTaskNotifyGive(_task);
+    }
+}
+
+bool Lidar::setProfile(LidarProfile profile, uint16_t periodMs)
+{
+    if (profile >= LIDAR_PROFILE_COUNT)
+    {
+        return false;
+    }
+    bool wasRunning = _running;
+    stop();
+    // The task stops ranging on its way out; the bus is free once it is gone
+    for (int i = 0; _task && i < 100; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    if (_task || !sensor->configure(lidarProfiles[profile]))
+    {
+        return false;
+    }
+    _profile = profile;
+    _periodMs = periodMs ? periodMs : lidarProfiles[profile].periodMs;
+    _periodUs = lidar_effective_period_us(lidarProfiles[profile], _periodMs);
+    _stats.avgIntervalUs = 0;
+    _lastSampleUs = 0;
+    return !wasRunning || start(_periodMs);
+}
+
+// GPIO1 falls when a new sample is ready: stamp it and wake the task
+void IRAM_ATTR Lidar::onDataReady(void *arg)
+{
+    Lidar *lidar = static_cast<Lidar *>(arg);
+    lidar->_irqTimeUs = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(lidar->_task, &woken);
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void Lidar::onPollTimer(void *arg)
+{
+    Lidar *lidar = static_cast<Lidar *>(arg);
+    if (lidar->_task)
+    {
+        xTaskNotifyGive(lidar->_task);
+    }
 }
 
 void Lidar::readTask(void *pvParameters)
 {
     Lidar *lidar = static_cast<Lidar *>(pvParameters);
+    // GPIO1 stays low until the result is read, so a lost edge would stall
+    // the sensor; after two quiet periods fall back to one poll
+    TickType_t wait = lidar->_intPin >= 0 ? pdMS_TO_TICKS(std::max(lidar->_periodUs / 500, (uint32_t)100))
+                                          : portMAX_DELAY;
 
     while (lidar->_running)
     {
-        
-
-        // Lock the mutex before accessing shared variables
-        if (xSemaphoreTake(lidar->mutex, portMAX_DELAY) == pdTRUE)
+        bool woken = ulTaskNotifyTake(pdTRUE, wait) > 0;
+        if (!lidar->_running)
         {
-            int16_t distance = lidar->sensor.readRange();
-            lidar->_distance = distance;
-            // Here you could add code to read flux if applicable
-            xSemaphoreGive(lidar->mutex); // Release the mutex
+            break;
+        }
+        if (lidar->_intPin >= 0 && woken)
+        {
+            lidar->acquire(lidar->_irqTimeUs);
+        }
+        else if (lidar->_intPin < 0 &&
+                 esp_timer_get_time() - lidar->_lastSampleUs < lidar->_periodUs * 3 / 4)
+        {
+            continue; // too early for the next sample, spare the bus
+        }
+        else if (lidar->sensor->dataReady())
+        {
+            if (lidar->_intPin >= 0)
+            {
+                lidar->_stats.irqTimeouts++;
+            }
+            lidar->acquire(esp_timer_get_time());
         }
-
-        vTaskDelay(33); // Delay for next reading
     }
+    lidar->sensor->stopContinuous();
+    lidar->_task = nullptr;
     vTaskDelete(NULL); // Delete the task when done
 }
 
-bool Lidar::readDisFlux(int16_t &distance, int16_t &flux)
+void Lidar::acquire(int64_t timeUs)
+{
+    LidarSample sample;
+    if (!sensor->readSample(sample))
+    {
+        _stats.readErrors++;
+        return;
+    }
+    sample.timeUs = timeUs;
+    filterSample(sample);
+    detectCrossing(sample);
+    if (_lastSampleUs)
+    {
+        uint32_t interval = (uint32_t)(timeUs - _lastSampleUs);
+        _stats.avgIntervalUs = _stats.avgIntervalUs ? (_stats.avgIntervalUs * 7 + interval) / 8 : interval;
+    }
+    _lastSampleUs = timeUs;
+    _stats.samples++;
+    _ring.push(sample);
+
+    taskENTER_CRITICAL(&_latestLock);
+    _latest = sample;
+    taskEXIT_CRITICAL(&_latestLock);
+}
+
+void Lidar::filterSample(LidarSample &sample)
+{
+    if (_filterPending)
+    {
+        taskENTER_CRITICAL(&_latestLock);
+        LidarFilterConfig config = _filterConfig;
+        _filterPending = false;
+        taskEXIT_CRITICAL(&_latestLock);
+        _filter.configure(config);
+        _filterRejects = config.reject;
+    }
+
+    FilterValue value = {(float)sample.distance, true, false, sample.status, sample.timeUs};
+    _filter.process(value);
+    sample.filterFlags = (value.valid ? LIDAR_FILTER_VALID : 0) | (value.held ? LIDAR_FILTER_HELD : 0);
+    sample.filtered = value.valid ? (uint16_t)lroundf(value.value) : 0;
+}
+
+void Lidar::setFilter(const LidarFilterConfig &config)
+{
+    taskENTER_CRITICAL(&_latestLock);
+    _filterConfig = config;
+    _filterPending = true;
+    taskEXIT_CRITICAL(&_latestLock);
+}
+
+LidarFilterConfig Lidar::getFilter()
+{
+    taskENTER_CRITICAL(&_latestLock);
+    LidarFilterConfig config = _filterConfig;
+    taskEXIT_CRITICAL(&_latestLock);
+    return config;
+}
+
+// Input selection in lidar_gate_input
+void Lidar::detectCrossing(const LidarSample &sample)
 {
-    if (_running)
+    if (_gatePending)
+    {
+        taskENTER_CRITICAL(&_latestLock);
+        LidarGateConfig config = _gateConfig;
+        _gateHandler = _pendingHandler;
+        _gateArg = _pendingArg;
+        _gatePending = false;
+        taskEXIT_CRITICAL(&_latestLock);
+        _gate.configure(config);
+        _gateUseFiltered = config.useFiltered;
+    }
+
+    uint16_t distance;
+    LidarGateInput input = lidar_gate_input(sample, _gateUseFiltered, _filterRejects, distance);
+    if (input == LIDAR_GATE_SKIP)
+    {
+        return;
+    }
+    LidarCrossing crossing;
+    if (_gate.process(sample.timeUs, distance, input == LIDAR_GATE_DISTANCE, crossing))
     {
-        // Lock the mutex before accessing shared variables
-        if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE)
+        _stats.crossings++;
+        if (_gateHandler)
         {
-            distance = _distance;
-            flux = _flux;
-            xSemaphoreGive(mutex); // Release the mutex
+            _gateHandler(_gateArg, crossing);
         }
-        return true;
     }
-    return false;
+}
+
+void Lidar::setGate(const LidarGateConfig &config, LidarCrossingHandler handler, void *arg)
+{
+    taskENTER_CRITICAL(&_latestLock);
+    _gateConfig = config;
+    _pendingHandler = handler;
+    _pendingArg = arg;
+    _gatePending = true;
+    taskEXIT_CRITICAL(&_latestLock);
+}
+
+LidarGateConfig Lidar::getGate()
+{
+    taskENTER_CRITICAL(&_latestLock);
+    LidarGateConfig config = _gateConfig;
+    taskEXIT_CRITICAL(&_latestLock);
+    return config;
+}
+
+bool Lidar::readLatest(LidarSample &sample)
+{
+    taskENTER_CRITICAL(&_latestLock);
+    sample = _latest;
+    taskEXIT_CRITICAL(&_latestLock);
+    return _running;
+}
+
+bool Lidar::readDisFlux(int16_t &distance, int16_t &flux)
+{
+    LidarSample sample;
+    bool running = readLatest(sample);
+    distance = sample.distance;
+    flux = std::min(sample.signalRate, (uint16_t)INT16_MAX);
+    return running;
+}
+
+LidarStats Lidar::getStats()
+{
+    LidarStats stats = _stats;
+    stats.dropped = _ring.dropped();
+    return stats;
 }
 
 Lidar::~Lidar()
 {
-    if (mutex != NULL) {
-        vSemaphoreDelete(mutex);  // Delete the mutex when the object is destroyed
+    stop();
+    if (_pollTimer)
+    {
+        esp_timer_delete(_pollTimer);
     }
 }
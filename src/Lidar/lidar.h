@@ -2,35 +2,110 @@
 #define LIDAR_H
 #include <Arduino.h>
 #include <Wire.h>
+#include "esp_timer.h"
 
-#include <Adafruit_VL53L0X.h>  
+#include "rangesensor.h"
+#include "vl53l0xsensor.h"
+#include "samplering.h"
+#include "lidarfilter.h"
+#include "lidargate.h"
 
+// Samples kept per sensor until Lua drains them
+#ifndef LIDAR_RING_SIZE
+#define LIDAR_RING_SIZE 256
+#endif
+#define LIDAR_POLL_US 2000 // data-ready poll when GPIO1 is not wired
+
+struct LidarStats
+{
+    uint32_t samples;
+    uint32_t dropped;    // ring full, Lua not draining
+    uint32_t readErrors;
+    uint32_t irqTimeouts; // interrupt mode: data ready missed, recovered by polling
+    uint32_t avgIntervalUs; // measured time between samples, smoothed
+    uint32_t crossings;
+};
+
+// Called from the acquisition task; must not block
+typedef void (*LidarCrossingHandler)(void *arg, const LidarCrossing &crossing);
+
+// Acquisition engine: GPIO1 data ready (or a timer polling the sensor) wakes
+// a task that reads the result and pushes it, timestamped, into a ring
 class Lidar
 {
 public:
     Lidar();
     ~Lidar();
-    bool begin(TwoWire *bus,int _sda,int _scl);
-    bool start();
+    bool begin(TwoWire *bus,int _sda,int _scl, int intPin = -1);
+    // Any other RangeSensor, e.g. a simulated one
+    bool begin(RangeSensor *rangeSensor, int intPin = -1);
+    // periodMs 0 uses the profile's own period
+    bool start(uint16_t periodMs = 0);
     void stop();
+    bool isRunning() { return _running; }
+
+    // Stops ranging, applies the profile and restarts if it was running.
+    // The schedule is re-planned from the timing budget.
+    bool setProfile(LidarProfile profile, uint16_t periodMs = 0);
+    LidarProfile getProfile() { return _profile; }
+    uint16_t getPeriodMs() { return _periodMs; }
+    float getPlannedRateHz() { return lidar_effective_rate_hz(lidarProfiles[_profile], _periodMs); }
+
+    // Takes effect on the next sample and restarts the chain
+    void setFilter(const LidarFilterConfig &config);
+    LidarFilterConfig getFilter();
+    // Crossing detection on every sample; the handler comes with the config
+    // so both change on the same sample
+    void setGate(const LidarGateConfig &config, LidarCrossingHandler handler = nullptr, void *arg = nullptr);
+    LidarGateConfig getGate();
+    // Latest sample; flux is the signal rate in 1/128 MCPS
     bool readDisFlux(int16_t &distance, int16_t &flux);
+    bool readLatest(LidarSample &sample);
+
+    // Ring, single consumer
+    bool peek(LidarSample &sample) { return _ring.peek(sample); }
+    size_t readBatch(LidarSample *out, size_t max) { return _ring.pop(out, max); }
+    size_t available() { return _ring.size(); }
+    LidarStats getStats();
 
 private:
     // To track number of instances
     uint8_t instanceId; // Unique ID for this instance
     char taskName[16];
-    Adafruit_VL53L0X sensor = Adafruit_VL53L0X();
-    const double f_s = 260; // Hz
-    bool _initialized = false;
-    TwoWire *_bus;
-    uint8_t _sda;
-    uint8_t _scl;
-    bool _running;
-    int16_t _distance;
-    int16_t _flux;
+    Vl53l0xSensor vl53;
+    RangeSensor *sensor;
+    int _intPin;
+    LidarProfile _profile;
+    uint16_t _periodMs;
+    uint32_t _periodUs; // effective, what the schedule is planned on
+    volatile bool _running;
+    TaskHandle_t _task;
+    esp_timer_handle_t _pollTimer;
+    volatile int64_t _irqTimeUs;
+    int64_t _lastSampleUs;
+    LidarSample _latest;
+    portMUX_TYPE _latestLock;
+    SampleRing<LidarSample, LIDAR_RING_SIZE> _ring;
+    LidarFilterChain _filter;           // acquisition task only
+    LidarFilterConfig _filterConfig;
+    volatile bool _filterPending;
+    bool _filterRejects;                // acquisition task only: the chain drops failed statuses
+    CrossingDetector _gate;             // acquisition task only, as are the next three
+    bool _gateUseFiltered;
+    LidarCrossingHandler _gateHandler;
+    void *_gateArg;
+    LidarGateConfig _gateConfig;        // pending, under _latestLock
+    LidarCrossingHandler _pendingHandler;
+    void *_pendingArg;
+    volatile bool _gatePending;
+    LidarStats _stats;
     static uint8_t instanceCounter;
     static void readTask(void *pvParameters);
-    SemaphoreHandle_t mutex;
+    static void IRAM_ATTR onDataReady(void *arg);
+    static void onPollTimer(void *arg);
+    void acquire(int64_t timeUs);
+    void filterSample(LidarSample &sample);
+    void detectCrossing(const LidarSample &sample);
 };
 
-#endif
\ No newline at end of file
+#endif
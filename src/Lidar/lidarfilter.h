@@ -0,0 +1,277 @@
+#ifndef LIDARFILTER_H
+#define LIDARFILTER_H
+#include <stdint.h>
+#include <math.h>
+#include <tuple>
+#include <algorithm>
+
+// Filter chain run by the acquisition task on every sample. Stages are
+// plain structs composed at compile time, so the whole chain inlines; each
+// one is switched and tuned at run time through LidarFilterConfig.
+#ifndef LIDAR_MEDIAN_MAX
+#define LIDAR_MEDIAN_MAX 15
+#endif
+#define LIDAR_KALMAN_MAX_GAP_US 1000000 // longer gaps restart the filter
+
+// One sample on its way down the chain
+struct FilterValue
+{
+    float value;    // mm
+    bool valid;     // cleared by rejection, restored by hold
+    bool held;      // value repeated from an earlier sample
+    uint8_t status; // range status of the raw sample, 0 valid
+    int64_t timeUs;
+};
+
+enum LidarKalmanModel : uint8_t
+{
+    KALMAN_CONSTANT = 0, // random walk: target mostly still
+    KALMAN_VELOCITY,     // constant velocity: target moving smoothly
+};
+
+struct LidarFilterConfig
+{
+    bool reject;
+    uint16_t minMm;
+    uint16_t maxMm;
+    uint16_t maxJumpMm;     // 0: no jump limit
+    uint8_t jumpConfirm;    // a jump seen this many times in a row is real
+    uint8_t median;         // window, odd, up to LIDAR_MEDIAN_MAX; below 3 off
+    bool kalman;
+    LidarKalmanModel model;
+    float processNoise;     // q, mm^2/s for CONSTANT, (mm/s^2)^2 s for VELOCITY
+    float measurementNoise; // r, mm^2
+    uint16_t holdMs;        // 0 off
+};
+
+// Everything off: filtered equals raw
+inline const LidarFilterConfig lidarFilterDefaults = {false, 0, 8190, 0, 3, 0, false, KALMAN_CONSTANT, 1000.0f, 25.0f, 0};
+
+// Drops samples with a bad range status, outside [min, max], or jumping
+// further than maxJumpMm from the last accepted value
+struct OutlierReject
+{
+    bool enabled = false;
+    float minMm = 0, maxMm = 0, maxJumpMm = 0;
+    uint8_t jumpConfirm = 0;
+    float last = 0;
+    bool haveLast = false;
+    uint8_t jumps = 0;
+
+    void configure(const LidarFilterConfig &config)
+    {
+        enabled = config.reject;
+        minMm = config.minMm;
+        maxMm = config.maxMm;
+        maxJumpMm = config.maxJumpMm;
+        jumpConfirm = config.jumpConfirm;
+        reset();
+    }
+
+    void reset()
+    {
+        haveLast = false;
+        jumps = 0;
+    }
+
+    void process(FilterValue &v)
+    {
+        if (!enabled || !v.valid)
+        {
+            return;
+        }
+        if (v.status != 0 || v.value < minMm || v.value > maxMm)
+        {
+            v.valid = false;
+            return;
+        }
+        if (maxJumpMm > 0 && haveLast && fabsf(v.value - last) > maxJumpMm && ++jumps < jumpConfirm)
+        {
+            v.valid = false;
+            return;
+        }
+        last = v.value;
+        haveLast = true;
+        jumps = 0;
+    }
+};
+
+// Median of the last `window` valid values
+template <size_t N>
+struct SlidingMedian
+{
+    uint8_t window = 0;
+    float values[N];
+    uint8_t count = 0, next = 0;
+
+    void configure(const LidarFilterConfig &config)
+    {
+        uint8_t size = std::min<uint8_t>(config.median, N);
+        window = size >= 3 ? (size - 1) | 1 : 0; // odd, rounded down
+        reset();
+    }
+
+    void reset()
+    {
+        count = 0;
+        next = 0;
+    }
+
+    void process(FilterValue &v)
+    {
+        if (window == 0 || !v.valid)
+        {
+            return;
+        }
+        values[next] = v.value;
+        next = (next + 1) % window;
+        count = std::min<uint8_t>(count + 1, window);
+
+        float sorted[N];
+        std::copy(values, values + count, sorted);
+        std::nth_element(sorted, sorted + count / 2, sorted + count);
+        v.value = sorted[count / 2];
+    }
+};
+
+// Scalar Kalman filter on distance, with either process model
+struct Kalman1D
+{
+    bool enabled = false;
+    LidarKalmanModel model = KALMAN_CONSTANT;
+    float q = 0, r = 1;
+    bool initialized = false;
+    int64_t lastUs = 0;
+    float x = 0, v = 0;                   // distance mm, velocity mm/s
+    float p00 = 0, p01 = 0, p10 = 0, p11 = 0;
+
+    void configure(const LidarFilterConfig &config)
+    {
+        enabled = config.kalman;
+        model = config.model;
+        q = config.processNoise;
+        r = config.measurementNoise > 0 ? config.measurementNoise : 1;
+        reset();
+    }
+
+    void reset()
+    {
+        initialized = false;
+    }
+
+    void process(FilterValue &m)
+    {
+        if (!enabled || !m.valid)
+        {
+            return;
+        }
+        int64_t gap = m.timeUs - lastUs;
+        if (!initialized || gap <= 0 || gap > LIDAR_KALMAN_MAX_GAP_US)
+        {
+            x = m.value;
+            v = 0;
+            p00 = r;
+            p01 = p10 = 0;
+            p11 = model == KALMAN_VELOCITY ? 1e6f : 0; // velocity unknown
+            initialized = true;
+            lastUs = m.timeUs;
+            return;
+        }
+        float dt = gap * 1e-6f;
+        lastUs = m.timeUs;
+
+        // Predict
+        if (model == KALMAN_VELOCITY)
+        {
+            x += v * dt;
+            float n00 = p00 + dt * (p10 + p01) + dt * dt * p11 + q * dt * dt * dt / 3;
+            float n01 = p01 + dt * p11 + q * dt * dt / 2;
+            float n10 = p10 + dt * p11 + q * dt * dt / 2;
+            p11 += q * dt;
+            p00 = n00;
+            p01 = n01;
+            p10 = n10;
+        }
+        else
+        {
+            p00 += q * dt;
+        }
+
+        // Update with H = [1 0]
+        float s = p00 + r;
+        float k0 = p00 / s;
+        float k1 = p10 / s;
+        float y = m.value - x;
+        x += k0 * y;
+        v += k1 * y;
+        p11 -= k1 * p01;
+        p10 -= k1 * p00;
+        p01 *= 1 - k0;
+        p00 *= 1 - k0;
+
+        m.value = x;
+    }
+};
+
+// Repeats the last valid value for up to holdMs while samples are rejected
+struct HoldLastValid
+{
+    uint32_t holdUs = 0;
+    float last = 0;
+    int64_t lastUs = 0;
+    bool haveLast = false;
+
+    void configure(const LidarFilterConfig &config)
+    {
+        holdUs = config.holdMs * 1000UL;
+        reset();
+    }
+
+    void reset()
+    {
+        haveLast = false;
+    }
+
+    void process(FilterValue &v)
+    {
+        if (v.valid)
+        {
+            last = v.value;
+            lastUs = v.timeUs;
+            haveLast = true;
+        }
+        else if (holdUs > 0 && haveLast && v.timeUs - lastUs <= holdUs)
+        {
+            v.value = last;
+            v.valid = true;
+            v.held = true;
+        }
+    }
+};
+
+template <typename... Stages>
+class FilterChain
+{
+public:
+    void configure(const LidarFilterConfig &config)
+    {
+        std::apply([&](auto &...stage) { (stage.configure(config), ...); }, stages);
+    }
+
+    void reset()
+    {
+        std::apply([](auto &...stage) { (stage.reset(), ...); }, stages);
+    }
+
+    void process(FilterValue &v)
+    {
+        std::apply([&](auto &...stage) { (stage.process(v), ...); }, stages);
+    }
+
+private:
+    std::tuple<Stages...> stages;
+};
+
+using LidarFilterChain = FilterChain<OutlierReject, SlidingMedian<LIDAR_MEDIAN_MAX>, Kalman1D, HoldLastValid>;
+
+#endif
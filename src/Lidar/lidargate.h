@@ -0,0 +1,146 @@
+#ifndef LIDARGATE_H
+#define LIDARGATE_H
+#include <stdint.h>
+#include "rangesensor.h"
+
+// Beam-break detector for the speed gate: a sensor is blocked while the
+// distance is below the threshold and clear again once it rises above
+// threshold + hysteresis. Plain C++ so traces replay on a host.
+enum LidarEdge : uint8_t
+{
+    LIDAR_EDGE_BREAK = 0,
+    LIDAR_EDGE_RESTORE,
+};
+
+struct LidarGateConfig
+{
+    bool enabled;
+    uint16_t thresholdMm;
+    uint16_t hysteresisMm;
+    bool useFiltered; // filter chain output rather than the raw distance
+};
+
+inline const LidarGateConfig lidarGateDefaults = {false, 1000, 50, true};
+
+struct LidarCrossing
+{
+    int64_t timeUs;     // crossing, interpolated between the two samples
+    int64_t sampleUs;   // sample that confirmed it
+    uint16_t distance;  // mm at that sample, 0 when nothing was in range
+    LidarEdge edge;
+    bool interpolated;  // false: the previous sample gave no distance to interpolate from
+};
+
+// What one sample gives the detector
+enum LidarGateInput : uint8_t
+{
+    LIDAR_GATE_SKIP = 0,  // no usable distance, the state holds
+    LIDAR_GATE_DISTANCE,  // a distance in range
+    LIDAR_GATE_CLEAR,     // nothing within range
+};
+
+// The filtered value is only trusted for a failed status when the reject
+// stage ran: without it the chain passes the failed distance straight on.
+// Otherwise a valid status gives its distance, out of range is clear and any
+// other failure is skipped.
+inline LidarGateInput lidar_gate_input(const LidarSample &sample, bool useFiltered, bool filterRejects,
+                                       uint16_t &distance)
+{
+    bool statusValid = sample.status == LIDAR_STATUS_VALID;
+    if (useFiltered && (sample.filterFlags & LIDAR_FILTER_VALID) && (filterRejects || statusValid))
+    {
+        distance = sample.filtered;
+        return LIDAR_GATE_DISTANCE;
+    }
+    if (sample.status == LIDAR_STATUS_PHASE_FAIL)
+    {
+        distance = 0;
+        return LIDAR_GATE_CLEAR;
+    }
+    if (!useFiltered && statusValid)
+    {
+        distance = sample.distance;
+        return LIDAR_GATE_DISTANCE;
+    }
+    return LIDAR_GATE_SKIP;
+}
+
+class CrossingDetector
+{
+public:
+    void configure(const LidarGateConfig &config)
+    {
+        enabled = config.enabled;
+        threshold = config.thresholdMm;
+        restore = config.thresholdMm + config.hysteresisMm;
+        reset();
+    }
+
+    void reset()
+    {
+        known = false;
+        havePrev = false;
+    }
+
+    bool isBlocked() const { return known && blocked; }
+
+    // inRange false: nothing within range, which counts as clear.
+    // The first sample only establishes the state.
+    bool process(int64_t timeUs, uint16_t distance, bool inRange, LidarCrossing &crossing)
+    {
+        if (!enabled)
+        {
+            return false;
+        }
+        bool crossed = false;
+        if (!known)
+        {
+            blocked = inRange && distance < threshold;
+            known = true;
+        }
+        else if (!blocked && inRange && distance < threshold)
+        {
+            crossed = emit(LIDAR_EDGE_BREAK, threshold, timeUs, distance, crossing);
+        }
+        else if (blocked && (!inRange || distance >= restore))
+        {
+            crossed = emit(LIDAR_EDGE_RESTORE, restore, timeUs, inRange ? distance : 0, crossing);
+        }
+        havePrev = inRange;
+        prevUs = timeUs;
+        prevMm = distance;
+        return crossed;
+    }
+
+private:
+    bool enabled = false;
+    uint32_t threshold = 0, restore = 0;
+    bool known = false, blocked = false;
+    bool havePrev = false;
+    int64_t prevUs = 0;
+    uint16_t prevMm = 0;
+
+    // Linear in time between the previous sample and this one, at the level
+    // that was crossed
+    bool emit(LidarEdge edge, uint32_t level, int64_t timeUs, uint16_t distance, LidarCrossing &crossing)
+    {
+        blocked = edge == LIDAR_EDGE_BREAK;
+        crossing.edge = edge;
+        crossing.sampleUs = timeUs;
+        crossing.distance = distance;
+        crossing.timeUs = timeUs;
+        crossing.interpolated = false;
+        if (havePrev && distance != 0 && prevMm != distance)
+        {
+            float fraction = ((float)prevMm - level) / ((float)prevMm - distance);
+            if (fraction >= 0 && fraction <= 1)
+            {
+                crossing.timeUs = prevUs + (int64_t)((timeUs - prevUs) * fraction);
+                crossing.interpolated = true;
+            }
+        }
+        return true;
+    }
+};
+
+#endif
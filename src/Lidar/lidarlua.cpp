@@ -1,12 +1,8 @@
 #include "lidar.h"
+#include "lidarmerge.h"
 #include "Lidar/lidarlua.h"
 #include "Global/global.h"
  int max_dist=8190;
-void lua_register_lidar(lua_State *L)
-{
-    lua_register(L, "lidar_top_readDisFlux", lua_wrapper_lidar_top_readDisFlux);
-    lua_register(L, "lidar_bottom_readDisFlux", lua_wrapper_lidar_bottom_readDisFlux);
-}
 
 
 static int lua_wrapper_lidar_top_readDisFlux(lua_State *lua_state) {
@@ -39,3 +35,341 @@ static int lua_wrapper_lidar_bottom_readDisFlux(lua_State *lua_state) {
     return 3;
 }
 
+
+static Lidar *const lidars[] = {&lidarTop, &lidarBottom};
+static const char *const lidarNames[] = {"top", "bottom"};
+
+static void push_lidar_sample(lua_State *L, const LidarSample &sample, const char *name)
+{
+    lua_createtable(L, 0, 7);
+    lua_pushinteger(L, sample.timeUs);
+    lua_setfield(L, -2, "t");
+    lua_pushinteger(L, sample.distance);
+    lua_setfield(L, -2, "d");
+    if (sample.filterFlags & LIDAR_FILTER_VALID)
+    {
+        lua_pushinteger(L, sample.filtered);
+        lua_setfield(L, -2, "f");
+    }
+    lua_pushboolean(L, sample.filterFlags & LIDAR_FILTER_HELD);
+    lua_setfield(L, -2, "held");
+    lua_pushnumber(L, sample.signalRate / 128.0);
+    lua_setfield(L, -2, "rate");
+    lua_pushinteger(L, sample.status);
+    lua_setfield(L, -2, "status");
+    lua_pushstring(L, name);
+    lua_setfield(L, -2, "sensor");
+}
+
+// lidar.read_batch([n [, "top"|"bottom"]]) -> array of {t = us, d = raw mm,
+// f = filtered mm (nil when rejected), held, rate = MCPS, status = 0 when valid,
+// sensor = "top"|"bottom"}
+// Drains up to n samples, oldest first; both sensors are merged by time.
+static int lua_wrapper_lidar_read_batch(lua_State *L)
+{
+    lua_Integer n = luaL_optinteger(L, 1, LIDAR_RING_SIZE);
+    luaL_argcheck(L, n >= 0, 1, "count must not be negative");
+    const char *which = luaL_optstring(L, 2, nullptr);
+    bool use[2] = {!which || strcmp(which, "top") == 0, !which || strcmp(which, "bottom") == 0};
+    if (!use[0] && !use[1])
+    {
+        return luaL_error(L, "unknown lidar '%s'", which);
+    }
+
+    lua_createtable(L, (int)std::min(n, (lua_Integer)(lidars[0]->available() + lidars[1]->available())), 0);
+    lua_Integer count = 0;
+    lidar_merge_drain(lidars, use, (size_t)n, [&](int i, const LidarSample &sample) {
+        push_lidar_sample(L, sample, lidarNames[i]);
+        lua_rawseti(L, -2, ++count);
+    });
+    return 1;
+}
+
+static Lidar *check_lidar(lua_State *L, int arg)
+{
+    const char *name = luaL_checkstring(L, arg);
+    for (int i = 0; i < 2; i++)
+    {
+        if (strcmp(name, lidarNames[i]) == 0)
+        {
+            return lidars[i];
+        }
+    }
+    luaL_error(L, "unknown lidar '%s'", name);
+    return nullptr;
+}
+
+// lidar.set_profile("top", "default"|"high_speed"|"long_range"|"high_accuracy" [, period_ms])
+// -> planned sample rate in Hz, or nil and a message
+static int lua_wrapper_lidar_set_profile(lua_State *L)
+{
+    Lidar *lidar = check_lidar(L, 1);
+    const char *name = luaL_checkstring(L, 2);
+    lua_Integer period = luaL_optinteger(L, 3, 0);
+    LidarProfile profile;
+    if (!lidar_profile_find(name, profile))
+    {
+        return luaL_error(L, "unknown lidar profile '%s'", name);
+    }
+    if (period < 0 || period > UINT16_MAX)
+    {
+        return luaL_error(L, "period_ms must be 0..%d", UINT16_MAX);
+    }
+    if (!lidar->setProfile(profile, (uint16_t)period))
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, "sensor did not accept the profile");
+        return 2;
+    }
+    lua_pushnumber(L, lidar->getPlannedRateHz());
+    return 1;
+}
+
+// lidar.profile("top") -> {name, budget_us, period_ms, rate_hz = planned, measured_hz}
+static int lua_wrapper_lidar_profile(lua_State *L)
+{
+    Lidar *lidar = check_lidar(L, 1);
+    const LidarProfileConfig &config = lidarProfiles[lidar->getProfile()];
+    LidarStats stats = lidar->getStats();
+    lua_createtable(L, 0, 5);
+    lua_pushstring(L, config.name);
+    lua_setfield(L, -2, "name");
+    lua_pushinteger(L, config.timingBudgetUs);
+    lua_setfield(L, -2, "budget_us");
+    lua_pushinteger(L, lidar->getPeriodMs());
+    lua_setfield(L, -2, "period_ms");
+    lua_pushnumber(L, lidar->getPlannedRateHz());
+    lua_setfield(L, -2, "rate_hz");
+    lua_pushnumber(L, stats.avgIntervalUs ? 1000000.0 / stats.avgIntervalUs : 0);
+    lua_setfield(L, -2, "measured_hz");
+    return 1;
+}
+
+// lidar.read("top") -> latest sample, same fields as read_batch, or nil before
+// the first one; the ring is untouched
+static int lua_wrapper_lidar_read(lua_State *L)
+{
+    Lidar *lidar = check_lidar(L, 1);
+    LidarSample sample;
+    if (!lidar->readLatest(sample))
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+    push_lidar_sample(L, sample, lua_tostring(L, 1));
+    return 1;
+}
+
+static lua_Integer opt_field(lua_State *L, int table, const char *key, lua_Integer def)
+{
+    lua_getfield(L, table, key);
+    lua_Integer value = luaL_optinteger(L, -1, def);
+    lua_pop(L, 1);
+    return value;
+}
+
+// Checked before it is narrowed into the config field
+static lua_Integer opt_range_field(lua_State *L, int table, const char *key, lua_Integer def, lua_Integer max)
+{
+    lua_Integer value = opt_field(L, table, key, def);
+    if (value < 0 || value > max)
+    {
+        return luaL_error(L, "%s must be 0..%d", key, (int)max);
+    }
+    return value;
+}
+
+static lua_Number opt_number_field(lua_State *L, int table, const char *key, lua_Number def)
+{
+    lua_getfield(L, table, key);
+    lua_Number value = luaL_optnumber(L, -1, def);
+    lua_pop(L, 1);
+    return value;
+}
+
+// lidar.filter("top", {reject = {min = 30, max = 2000, max_jump = 300, confirm = 3},
+//                      median = 5, kalman = {model = "constant"|"velocity", q = 1000, r = 25},
+//                      hold_ms = 200})
+// Stages left out are off; lidar.filter("top") turns the whole chain off.
+static int lua_wrapper_lidar_filter(lua_State *L)
+{
+    Lidar *lidar = check_lidar(L, 1);
+    LidarFilterConfig config = lidarFilterDefaults;
+    if (!lua_isnoneornil(L, 2))
+    {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        if (lua_getfield(L, 2, "reject") == LUA_TTABLE)
+        {
+            int reject = lua_gettop(L);
+            config.reject = true;
+            config.minMm = opt_range_field(L, reject, "min", config.minMm, UINT16_MAX);
+            config.maxMm = opt_range_field(L, reject, "max", config.maxMm, UINT16_MAX);
+            config.maxJumpMm = opt_range_field(L, reject, "max_jump", config.maxJumpMm, UINT16_MAX);
+            config.jumpConfirm = opt_range_field(L, reject, "confirm", config.jumpConfirm, UINT8_MAX);
+        }
+        else
+        {
+            config.reject = lua_toboolean(L, -1);
+        }
+        lua_pop(L, 1);
+
+        config.median = opt_range_field(L, 2, "median", 0, LIDAR_MEDIAN_MAX);
+
+        if (lua_getfield(L, 2, "kalman") == LUA_TTABLE)
+        {
+            int kalman = lua_gettop(L);
+            config.kalman = true;
+            lua_getfield(L, kalman, "model");
+            const char *model = luaL_optstring(L, -1, "constant");
+            config.model = strcmp(model, "velocity") == 0 ? KALMAN_VELOCITY : KALMAN_CONSTANT;
+            lua_pop(L, 1);
+            config.processNoise = opt_number_field(L, kalman, "q", config.processNoise);
+            config.measurementNoise = opt_number_field(L, kalman, "r", config.measurementNoise);
+        }
+        else
+        {
+            config.kalman = lua_toboolean(L, -1);
+        }
+        lua_pop(L, 1);
+
+        config.holdMs = opt_range_field(L, 2, "hold_ms", 0, UINT16_MAX);
+    }
+    lidar->setFilter(config);
+    return 0;
+}
+
+// Crossings waiting for the Lua task, per sensor
+#define LIDAR_CROSSING_QUEUE 16
+static SampleRing<LidarCrossing, LIDAR_CROSSING_QUEUE> crossingQueues[2];
+
+static void push_crossing(lua_State *L, int index, const LidarCrossing &crossing)
+{
+    lua_pushstring(L, "LIDAR_CROSSING");
+    lua_pushstring(L, lidarNames[index]);
+    lua_pushstring(L, crossing.edge == LIDAR_EDGE_BREAK ? "break" : "restore");
+    lua_pushinteger(L, crossing.timeUs);
+    lua_pushinteger(L, crossing.distance);
+}
+
+// Runs in the Lua task from rtos.receive. With sys loaded every queued
+// crossing is published; without it rtos.receive returns the oldest one as
+// the same values.
+static int lidar_crossing_handler(lua_State *L, void *ptr)
+{
+    rtos_msg_t *msg = (rtos_msg_t *)lua_topointer(L, -1);
+    int index = msg->arg1;
+    LidarCrossing crossing;
+    if (lua_getglobal(L, "sys_pub") != LUA_TFUNCTION)
+    {
+        lua_pop(L, 1);
+        if (!crossingQueues[index].pop(&crossing, 1))
+        {
+            return 0;
+        }
+        push_crossing(L, index, crossing);
+        return 5;
+    }
+    while (crossingQueues[index].pop(&crossing, 1))
+    {
+        lua_pushvalue(L, -1);
+        push_crossing(L, index, crossing);
+        lua_call(L, 5, 0);
+    }
+    lua_pop(L, 1);
+    return 0;
+}
+
+// Acquisition task: queue the crossing and wake the Lua task. If the msgbus
+// is full the crossing goes out with the next message.
+static void post_crossing(void *arg, const LidarCrossing &crossing)
+{
+    int index = (int)(intptr_t)arg;
+    if (!crossingQueues[index].push(crossing))
+    {
+        return;
+    }
+    rtos_msg_t msg = {};
+    msg.handler = lidar_crossing_handler;
+    msg.arg1 = index;
+    luat_msgbus_put(&msg, 0);
+}
+
+// lidar.gate("top", {threshold = mm, hysteresis = 50, source = "filtered"|"raw"})
+// Publishes sys.subscribe("LIDAR_CROSSING", function(sensor, edge, t_us, d) end)
+// with edge "break" or "restore" and t_us interpolated between samples.
+// lidar.gate("top") turns detection off.
+static int lua_wrapper_lidar_gate(lua_State *L)
+{
+    Lidar *lidar = check_lidar(L, 1);
+    int index = lidar == lidars[0] ? 0 : 1;
+    LidarGateConfig config = lidarGateDefaults;
+    if (!lua_isnoneornil(L, 2))
+    {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_getfield(L, 2, "threshold");
+        lua_Integer threshold = luaL_checkinteger(L, -1);
+        lua_pop(L, 1);
+        lua_Integer hysteresis = opt_field(L, 2, "hysteresis", config.hysteresisMm);
+        if (threshold <= 0 || hysteresis < 0 || threshold + hysteresis > UINT16_MAX)
+        {
+            return luaL_error(L, "threshold and hysteresis out of range");
+        }
+        lua_getfield(L, 2, "source");
+        const char *source = luaL_optstring(L, -1, "filtered");
+        config.useFiltered = strcmp(source, "raw") != 0;
+        lua_pop(L, 1);
+        config.enabled = true;
+        config.thresholdMm = threshold;
+        config.hysteresisMm = hysteresis;
+    }
+    lidar->setGate(config, config.enabled ? post_crossing : nullptr, (void *)(intptr_t)index);
+    crossingQueues[index].clear();
+    return 0;
+}
+
+// lidar.stats() -> {top = {samples, dropped, errors, irq_timeouts, queued, crossings,
+//                         crossings_dropped}, bottom = {...}}
+static int lua_wrapper_lidar_stats(lua_State *L)
+{
+    lua_createtable(L, 0, 2);
+    for (int i = 0; i < 2; i++)
+    {
+        LidarStats stats = lidars[i]->getStats();
+        lua_createtable(L, 0, 7);
+        lua_pushinteger(L, stats.samples);
+        lua_setfield(L, -2, "samples");
+        lua_pushinteger(L, stats.dropped);
+        lua_setfield(L, -2, "dropped");
+        lua_pushinteger(L, stats.readErrors);
+        lua_setfield(L, -2, "errors");
+        lua_pushinteger(L, stats.irqTimeouts);
+        lua_setfield(L, -2, "irq_timeouts");
+        lua_pushinteger(L, lidars[i]->available());
+        lua_setfield(L, -2, "queued");
+        lua_pushinteger(L, stats.crossings);
+        lua_setfield(L, -2, "crossings");
+        lua_pushinteger(L, crossingQueues[i].dropped());
+        lua_setfield(L, -2, "crossings_dropped");
+        lua_setfield(L, -2, lidarNames[i]);
+    }
+    return 1;
+}
+
+void lua_register_lidar(lua_State *L)
+{
+    lua_register(L, "lidar_top_readDisFlux", lua_wrapper_lidar_top_readDisFlux);
+    lua_register(L, "lidar_bottom_readDisFlux", lua_wrapper_lidar_bottom_readDisFlux);
+
+    const luaL_Reg lidarLib[] = {
+        {"read_batch", lua_wrapper_lidar_read_batch},
+        {"stats", lua_wrapper_lidar_stats},
+        {"set_profile", lua_wrapper_lidar_set_profile},
+        {"filter", lua_wrapper_lidar_filter},
+        {"read", lua_wrapper_lidar_read},
+        {"gate", lua_wrapper_lidar_gate},
+        {"profile", lua_wrapper_lidar_profile},
+        {NULL, NULL}};
+
+    luaL_newlib(L, lidarLib);
+    lua_setglobal(L, "lidar");
+}
@@ -0,0 +1,32 @@
+#ifndef LIDARMERGE_H
+#define LIDARMERGE_H
+#include <stddef.h>
+#include "rangesensor.h"
+
+// Drains up to max samples from two time-ordered sources into one stream,
+// oldest first; on equal times source 0 goes first. Sources provide
+// peek(LidarSample &) and readBatch(LidarSample *, size_t), as Lidar does,
+// and emit(index, sample) receives each sample. What is not taken stays
+// queued in its source.
+template <typename Source, typename Emit>
+size_t lidar_merge_drain(Source *const sources[2], const bool use[2], size_t max, Emit &&emit)
+{
+    LidarSample next[2];
+    bool have[2];
+    for (int i = 0; i < 2; i++)
+    {
+        have[i] = use[i] && sources[i]->peek(next[i]);
+    }
+    size_t count = 0;
+    while (count < max && (have[0] || have[1]))
+    {
+        int i = !have[0] || (have[1] && next[1].timeUs < next[0].timeUs) ? 1 : 0;
+        sources[i]->readBatch(&next[i], 1);
+        emit(i, next[i]);
+        count++;
+        have[i] = sources[i]->peek(next[i]);
+    }
+    return count;
+}
+
+#endif
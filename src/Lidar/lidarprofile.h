@@ -0,0 +1,65 @@
+#ifndef LIDARPROFILE_H
+#define LIDARPROFILE_H
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+// VL53L0X ranging profiles, values from ST's ranging profile examples.
+// Plain C++ with no driver dependency, so the schedule math builds anywhere.
+enum LidarProfile : uint8_t
+{
+    LIDAR_PROFILE_DEFAULT = 0,
+    LIDAR_PROFILE_HIGH_SPEED,
+    LIDAR_PROFILE_LONG_RANGE,
+    LIDAR_PROFILE_HIGH_ACCURACY,
+    LIDAR_PROFILE_COUNT
+};
+
+struct LidarProfileConfig
+{
+    const char *name;
+    uint32_t timingBudgetUs;
+    uint8_t preRangeVcsel;   // VCSEL pulse period in PCLKs, even, 12..18
+    uint8_t finalRangeVcsel; // even, 8..14
+    float signalLimitMcps;   // minimum return signal rate
+    float sigmaLimitMm;      // maximum estimated sigma
+    uint16_t periodMs;       // inter-measurement period the profile plans for
+};
+
+inline const LidarProfileConfig lidarProfiles[LIDAR_PROFILE_COUNT] = {
+    {"default", 33000, 14, 10, 0.25f, 18.0f, 33},
+    {"high_speed", 20000, 14, 10, 0.25f, 32.0f, 20},
+    {"long_range", 33000, 18, 14, 0.10f, 60.0f, 33},
+    {"high_accuracy", 200000, 14, 10, 0.25f, 18.0f, 200},
+};
+
+inline bool lidar_profile_find(const char *name, LidarProfile &profile)
+{
+    for (uint8_t i = 0; i < LIDAR_PROFILE_COUNT; i++)
+    {
+        if (strcmp(name, lidarProfiles[i].name) == 0)
+        {
+            profile = (LidarProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// In timed mode a measurement never starts before the previous one has used
+// its whole budget, so a period shorter than the budget runs back to back.
+// Deliberately max(period, budget): the pre-range and final-range step
+// timeouts (and so the VCSEL periods) are not modelled. The driver re-applies
+// the budget after a VCSEL change and sizes the final-range step to fill it,
+// so a measurement takes the budget whatever the VCSEL settings.
+inline uint32_t lidar_effective_period_us(const LidarProfileConfig &config, uint16_t periodMs)
+{
+    return std::max((uint32_t)periodMs * 1000, config.timingBudgetUs);
+}
+
+inline float lidar_effective_rate_hz(const LidarProfileConfig &config, uint16_t periodMs)
+{
+    return 1000000.0f / lidar_effective_period_us(config, periodMs);
+}
+
+#endif
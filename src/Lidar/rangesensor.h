@@ -0,0 +1,48 @@
+#ifndef RANGESENSOR_H
+#define RANGESENSOR_H
+#include <stdint.h>
+#include "lidarprofile.h"
+
+// Range status, same codes as the ST API's RangeStatus
+enum LidarStatus : uint8_t
+{
+    LIDAR_STATUS_VALID = 0,
+    LIDAR_STATUS_SIGMA_FAIL = 1,
+    LIDAR_STATUS_SIGNAL_FAIL = 2,
+    LIDAR_STATUS_MIN_RANGE = 3,
+    LIDAR_STATUS_PHASE_FAIL = 4,    // out of range
+    LIDAR_STATUS_HARDWARE_FAIL = 5,
+    LIDAR_STATUS_NONE = 255,        // no update
+};
+
+#define LIDAR_FILTER_VALID 0x01 // filtered holds a value
+#define LIDAR_FILTER_HELD 0x02  // filtered repeats an earlier sample
+
+// One ranging result as the acquisition engine records it
+struct LidarSample
+{
+    int64_t timeUs;      // esp_timer_get_time() at data ready
+    uint16_t distance;   // mm
+    uint16_t signalRate; // return signal rate, MCPS in 9.7 fixed point
+    uint8_t status;      // LidarStatus
+    uint8_t filterFlags; // LIDAR_FILTER_*, set by the engine
+    uint16_t filtered;   // mm, output of the filter chain
+};
+
+// What the acquisition engine needs from a ranging device. The VL53L0X
+// implements it over I2C; a simulated sensor can stand in for it.
+class RangeSensor
+{
+public:
+    virtual ~RangeSensor() {}
+    // Only called while ranging is stopped
+    virtual bool configure(const LidarProfileConfig &config) = 0;
+    virtual bool startContinuous(uint16_t periodMs) = 0;
+    virtual void stopContinuous() = 0;
+    // Only polled when no data-ready interrupt line is wired
+    virtual bool dataReady() = 0;
+    // Latest result, re-arming data ready; the engine fills in timeUs
+    virtual bool readSample(LidarSample &sample) = 0;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+
+// Lock-free ring for one producer task and one consumer task. When full the
+// new item is dropped and counted: only the consumer may move the tail.
+template <typename T, size_t N>
+class SampleRing
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+    // Producer
+    bool push(const T &item)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= N)
+        {
+            _dropped++;
+            return false;
+        }
+        _items[head & (N - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer
+    bool peek(T &item)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail)
+        {
+            return false;
+        }
+        item = _items[tail & (N - 1)];
+        return true;
+    }
+
+    size_t pop(T *out, size_t max)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        size_t count = std::min((size_t)(_head.load(std::memory_order_acquire) - tail), max);
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = _items[(tail + i) & (N - 1)];
+        }
+        _tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    void clear()
+    {
+        _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    size_t size() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    T _items[N];
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+    volatile uint32_t _dropped = 0;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#include "vl53l0xsensor.h"
+
+#define REG_SYSTEM_INTERRUPT_CLEAR 0x0B
+#define REG_RESULT_INTERRUPT_STATUS 0x13
+#define REG_RESULT_RANGE_STATUS 0x14
+#define RESULT_BLOCK_SIZE 12
+
+// Device range status to the API's RangeStatus, without the sigma and
+// signal limit checks the ST API adds on top
+static uint8_t range_status(uint8_t deviceStatus)
+{
+    switch (deviceStatus)
+    {
+    case 11:
+        return LIDAR_STATUS_VALID;
+    case 1:
+    case 2:
+    case 3:
+        return LIDAR_STATUS_HARDWARE_FAIL;
+    case 6:
+    case 9:
+        return LIDAR_STATUS_PHASE_FAIL;
+    case 8:
+    case 10:
+        return LIDAR_STATUS_MIN_RANGE;
+    case 4:
+        return LIDAR_STATUS_SIGNAL_FAIL;
+    default:
+        return LIDAR_STATUS_NONE;
+    }
+}
+
+bool Vl53l0xSensor::begin(TwoWire *bus, uint8_t address)
+{
+    _bus = bus;
+    _address = address;
+    return sensor.begin(address, true, bus);
+}
+
+// Same order as the driver's own configSensor(): limits, budget, then VCSEL
+// periods, which recompute the step timeouts within the budget
+bool Vl53l0xSensor::configure(const LidarProfileConfig &config)
+{
+    return sensor.setLimitCheckEnable(VL53L0X_CHECKENABLE_SIGMA_FINAL_RANGE, 1) &&
+           sensor.setLimitCheckEnable(VL53L0X_CHECKENABLE_SIGNAL_RATE_FINAL_RANGE, 1) &&
+           sensor.setLimitCheckValue(VL53L0X_CHECKENABLE_SIGNAL_RATE_FINAL_RANGE,
+                                     (FixPoint1616_t)(config.signalLimitMcps * 65536)) &&
+           sensor.setLimitCheckValue(VL53L0X_CHECKENABLE_SIGMA_FINAL_RANGE,
+                                     (FixPoint1616_t)(config.sigmaLimitMm * 65536)) &&
+           sensor.setMeasurementTimingBudgetMicroSeconds(config.timingBudgetUs) &&
+           sensor.setVcselPulsePeriod(VL53L0X_VCSEL_PERIOD_PRE_RANGE, config.preRangeVcsel) &&
+           sensor.setVcselPulsePeriod(VL53L0X_VCSEL_PERIOD_FINAL_RANGE, config.finalRangeVcsel);
+}
+
+bool Vl53l0xSensor::startContinuous(uint16_t periodMs)
+{
+    VL53L0X_Error status = sensor.setGpioConfig(VL53L0X_DEVICEMODE_CONTINUOUS_TIMED_RANGING,
+                                                VL53L0X_GPIOFUNCTIONALITY_NEW_MEASURE_READY,
+                                                VL53L0X_INTERRUPTPOLARITY_LOW);
+    sensor.startRangeContinuous(periodMs);
+    return status == VL53L0X_ERROR_NONE;
+}
+
+void Vl53l0xSensor::stopContinuous()
+{
+    sensor.stopRangeContinuous();
+}
+
+bool Vl53l0xSensor::dataReady()
+{
+    uint8_t status;
+    return readRegisters(REG_RESULT_INTERRUPT_STATUS, &status, 1) && (status & 0x07) != 0;
+}
+
+bool Vl53l0xSensor::readSample(LidarSample &sample)
+{
+    // Registers are big-endian: [0] status, [6..7] signal rate, [10..11] range
+    uint8_t result[RESULT_BLOCK_SIZE];
+    if (!readRegisters(REG_RESULT_RANGE_STATUS, result, sizeof(result)))
+    {
+        return false;
+    }
+    sample.status = range_status((result[0] & 0x78) >> 3);
+    sample.signalRate = (result[6] << 8) | result[7];
+    sample.distance = (result[10] << 8) | result[11];
+    return writeRegister(REG_SYSTEM_INTERRUPT_CLEAR, 0x01);
+}
+
+bool Vl53l0xSensor::readRegisters(uint8_t reg, uint8_t *data, size_t length)
+{
+    _bus->beginTransmission(_address);
+    _bus->write(reg);
+    if (_bus->endTransmission(false) != 0 || _bus->requestFrom(_address, (uint8_t)length) != length)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = _bus->read();
+    }
+    return true;
+}
+
+bool Vl53l0xSensor::writeRegister(uint8_t reg, uint8_t value)
+{
+    _bus->beginTransmission(_address);
+    _bus->write(reg);
+    _bus->write(value);
+    return _bus->endTransmission() == 0;
+}
@@ -0,0 +1,32 @@
+#ifndef VL53L0XSENSOR_H
+#define VL53L0XSENSOR_H
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_VL53L0X.h>
+#include "rangesensor.h"
+
+// VL53L0X in continuous timed mode with GPIO1 signalling a new sample.
+// The Adafruit driver sets the sensor up; results are read as one burst of
+// the result registers, which also gives signal rate and range status.
+class Vl53l0xSensor : public RangeSensor
+{
+public:
+    bool begin(TwoWire *bus, uint8_t address = VL53L0X_I2C_ADDR);
+    bool configure(const LidarProfileConfig &config) override;
+    bool startContinuous(uint16_t periodMs) override;
+    void stopContinuous() override;
+    bool dataReady() override;
+    bool readSample(LidarSample &sample) override;
+
+    // Full driver, for settings the interface does not cover
+    Adafruit_VL53L0X &device() { return sensor; }
+
+private:
+    Adafruit_VL53L0X sensor = Adafruit_VL53L0X();
+    TwoWire *_bus = nullptr;
+    uint8_t _address = VL53L0X_I2C_ADDR;
+    bool readRegisters(uint8_t reg, uint8_t *data, size_t length);
+    bool writeRegister(uint8_t reg, uint8_t value);
+};
+
+#endif
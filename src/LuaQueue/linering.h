@@ -0,0 +1,227 @@
+#ifndef LINERING_H
+#define LINERING_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+
+// Lines pushed over BLE (\x02 prefix) are assembled straight into a
+// preallocated ring. Each record is [u16 header][bytes]; lines longer than
+// LQUEUE_CHUNK_MAX are chained as several records with LQUEUE_CHUNK_CONT set.
+// The reader takes chunks out as soon as they are committed, so a line can be
+// longer than the ring. No Arduino dependencies, so it is tested on the host.
+#ifndef LQUEUE_RING_SIZE
+#define LQUEUE_RING_SIZE 8192   // power of two
+#endif
+#define LQUEUE_CHUNK_MAX 1024
+#define LQUEUE_CHUNK_CONT 0x8000
+
+// Backpressure: pause the peer above the high mark, resume below the low mark
+#define LQUEUE_HIGH_WATER (LQUEUE_RING_SIZE * 3 / 4)
+#define LQUEUE_LOW_WATER (LQUEUE_RING_SIZE / 4)
+
+struct LQueueStats {
+    uint32_t lines;
+    uint32_t droppedBytes;
+    uint32_t truncatedLines;
+    uint32_t pauses;
+    uint32_t highWater;
+};
+
+// Single writer (BLE receive path) and single reader (Lua task). writeIdx only
+// advances when a record is complete, so the reader never sees partial data.
+class LineRing {
+public:
+    LQueueStats stats = {};
+
+    // Called from whichever side flips the wanted pause state; the owner
+    // passes it on to the one task that tells the peer
+    std::function<void()> onPauseChange;
+
+    // Writer side: payload bytes, each '\n' ends a line
+    void write(const uint8_t *data, size_t length) {
+        const uint8_t *end = data + length;
+        while (data < end) {
+            const uint8_t *nl = (const uint8_t *)memchr(data, '\n', end - data);
+            append(data, (nl ? nl : end) - data);
+            if (!nl) {
+                break;
+            }
+            if (discarding) {
+                discarding = false;
+            } else {
+                commitRecord(false);
+            }
+            data = nl + 1;
+        }
+    }
+
+    // Reader side: move the committed chunks of the head line out of the
+    // ring, freeing space while the rest of the line is still arriving.
+    // True once the head line is whole.
+    bool pull() {
+        while (!headComplete && readIdx.load(std::memory_order_relaxed) != writeIdx.load(std::memory_order_acquire)) {
+            uint16_t length;
+            bool more = nextChunk(&length);
+            size_t at = head.size();
+            head.resize(at + length);
+            ringGet(readIdx.load(std::memory_order_relaxed) + HEADER_SIZE, (uint8_t *)&head[at], length);
+            finishChunk(length);
+            headComplete = !more;
+        }
+        return headComplete;
+    }
+
+    // Reader side: hand over the next whole line
+    bool take(std::string &line) {
+        if (!pull()) {
+            return false;
+        }
+        line.swap(head);
+        head.clear();
+        if (head.capacity() > LQUEUE_RING_SIZE) {
+            head.shrink_to_fit(); // one huge line should not pin its buffer
+        }
+        headComplete = false;
+        completeLines--;
+        return true;
+    }
+
+    // Reader side: drop the lines counted so far. Every counted line is
+    // committed in full, so this never waits; a line still being received
+    // survives, including chunks of it already pulled.
+    void clear() {
+        uint32_t lines = completeLines.load();
+        std::string line;
+        for (uint32_t i = 0; i < lines; i++) {
+            take(line);
+        }
+    }
+
+    // Whole lines not yet taken; any task
+    uint32_t count() const {
+        return completeLines;
+    }
+
+    bool pauseWanted() const {
+        return paused;
+    }
+
+private:
+    static const uint32_t RING_MASK = LQUEUE_RING_SIZE - 1;
+    static const uint32_t HEADER_SIZE = 2;
+
+    uint8_t ring[LQUEUE_RING_SIZE];
+    std::atomic<uint32_t> readIdx{0};
+    std::atomic<uint32_t> writeIdx{0};
+    std::atomic<uint32_t> completeLines{0};
+    std::atomic<bool> paused{false};
+
+    // Writer-side assembly state
+    uint32_t recStart = 0;   // header position of the record being filled
+    uint16_t recLen = 0;
+    bool chained = false;    // earlier chunks of this line are committed
+    bool discarding = false; // line truncated, skip to the next '\n'
+
+    // Reader-side head line
+    std::string head;
+    bool headComplete = false;
+
+    void ringPut(uint32_t pos, const uint8_t *data, size_t length) {
+        size_t offset = pos & RING_MASK;
+        size_t first = std::min(length, (size_t)LQUEUE_RING_SIZE - offset);
+        memcpy(ring + offset, data, first);
+        memcpy(ring, data + first, length - first);
+    }
+
+    void ringGet(uint32_t pos, uint8_t *out, size_t length) const {
+        size_t offset = pos & RING_MASK;
+        size_t first = std::min(length, (size_t)LQUEUE_RING_SIZE - offset);
+        memcpy(out, ring + offset, first);
+        memcpy(out + first, ring, length - first);
+    }
+
+    void setPaused(bool state) {
+        if (paused.exchange(state) != state) {
+            if (state) {
+                stats.pauses++;
+            }
+            if (onPauseChange) {
+                onPauseChange();
+            }
+        }
+    }
+
+    void commitRecord(bool more) {
+        uint16_t header = recLen | (more ? LQUEUE_CHUNK_CONT : 0);
+        uint8_t raw[HEADER_SIZE] = {(uint8_t)(header & 0xFF), (uint8_t)(header >> 8)};
+        ringPut(recStart, raw, HEADER_SIZE);
+        recStart += HEADER_SIZE + recLen;
+        recLen = 0;
+        writeIdx.store(recStart, std::memory_order_release);
+
+        chained = more;
+        if (!more) {
+            completeLines++;
+            stats.lines++;
+        }
+    }
+
+    void append(const uint8_t *data, size_t length) {
+        while (length > 0 && !discarding) {
+            if (recLen == LQUEUE_CHUNK_MAX) {
+                commitRecord(true);
+            }
+            // Keep room for the next record's header so a commit never overwrites
+            uint32_t used = recStart + HEADER_SIZE + recLen - readIdx.load(std::memory_order_acquire);
+            size_t space = LQUEUE_RING_SIZE - used;
+            space = space > HEADER_SIZE ? space - HEADER_SIZE : 0;
+            size_t take = std::min(std::min(length, space), (size_t)(LQUEUE_CHUNK_MAX - recLen));
+            if (take == 0) {
+                // Only when the peer ignores the pause: close what we have and drop the rest
+                if (recLen > 0 || chained) {
+                    commitRecord(false);
+                }
+                stats.truncatedLines++;
+                discarding = true;
+                break;
+            }
+            ringPut(recStart + HEADER_SIZE + recLen, data, take);
+            recLen += take;
+            data += take;
+            length -= take;
+
+            if (used + take > stats.highWater) {
+                stats.highWater = used + take;
+            }
+            if (used + take >= LQUEUE_HIGH_WATER) {
+                setPaused(true);
+            }
+        }
+        if (discarding) {
+            stats.droppedBytes += length;
+        }
+    }
+
+    // Read the next record header; true while more chunks of the line follow
+    bool nextChunk(uint16_t *length) const {
+        uint8_t raw[HEADER_SIZE];
+        ringGet(readIdx.load(std::memory_order_relaxed), raw, HEADER_SIZE);
+        uint16_t header = raw[0] | (raw[1] << 8);
+        *length = header & ~LQUEUE_CHUNK_CONT;
+        return header & LQUEUE_CHUNK_CONT;
+    }
+
+    void finishChunk(uint16_t length) {
+        uint32_t r = readIdx.load(std::memory_order_relaxed) + HEADER_SIZE + length;
+        readIdx.store(r, std::memory_order_release);
+        if (writeIdx.load(std::memory_order_acquire) - r <= LQUEUE_LOW_WATER) {
+            setPaused(false);
+        }
+    }
+};
+
+#endif
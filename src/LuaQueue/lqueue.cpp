@@ -1,57 +1,151 @@
 #include "lqueue.h"
 
-// Define the queue handle
-QueueHandle_t stringQueue;
-String buffer_queue = "";
+static LineRing lineRing;
+static std::string readLine; // reader side, reused across reads
+static SemaphoreHandle_t lineSignal = NULL;
+static std::function<void(bool)> backpressureCallback;
+static std::function<void()> wakeCallback;
+static bool sentPaused = false; // sending task only
+
 void initQueue() {
-    stringQueue = xQueueCreate(10, 500);
+    if (lineSignal == NULL) {
+        lineSignal = xSemaphoreCreateBinary();
+        // The writer and the reader both flip the wanted state, so neither
+        // tells the peer itself
+        lineRing.onPauseChange = [] {
+            if (wakeCallback) {
+                wakeCallback();
+            } else {
+                serviceQueueBackpressure();
+            }
+        };
+    }
+}
+
+void setQueueBackpressureCallback(std::function<void(bool paused)> callback) {
+    backpressureCallback = callback;
+}
+
+void setQueueWakeCallback(std::function<void()> callback) {
+    wakeCallback = callback;
+}
+
+// On the one task that talks to the peer: it hears pause and resume in the
+// order they were wanted, and a flip and back in between sends nothing
+void serviceQueueBackpressure() {
+    bool wanted = lineRing.pauseWanted();
+    if (wanted != sentPaused) {
+        sentPaused = wanted;
+        if (backpressureCallback) {
+            backpressureCallback(wanted);
+        }
+    }
+}
+
+// Raw BLE payload; the first byte is the \x02 queue marker
+void addDataToQueue(const char *data, size_t length) {
+    if (lineSignal == NULL || length < 1) {
+        return;
+    }
+    lineRing.write((const uint8_t *)data + 1, length - 1);
+    // Also for a chunk of an unfinished line: the reader takes it out early
+    xSemaphoreGive(lineSignal);
 }
 
 void addStringToQueue(String str) {
-    // Try to send to queue with 10ms timeout
-
-    str.remove(0, 1);  // Remove first char from str
-   buffer_queue += str;     // Add remaining string to buffer
-   
-   while (buffer_queue.indexOf('\n') != -1) {
-       int newlineIndex = buffer_queue.indexOf('\n');
-       String completeLine = buffer_queue.substring(0, newlineIndex);
-       
-       // Try to send to queue with 10ms timeout
-       xQueueSend(stringQueue, completeLine.c_str(), pdMS_TO_TICKS(10));
-       
-       // Remove processed portion from buffer
-       buffer_queue = buffer_queue.substring(newlineIndex + 1);
-   }
+    addDataToQueue(str.c_str(), str.length());
 }
-String readStringFromQueue() {
-    if (stringQueue == NULL) {
-        return "";
+
+// Wait for a complete line in readLine; stop requests end the wait early.
+// Chunks of a longer line are pulled while waiting, so the ring never fills
+// up with a line the reader is waiting for.
+static bool wait_line(int32_t timeoutMs) {
+    uint32_t start = millis();
+    while (!lineRing.take(readLine)) {
+        int32_t remaining = timeoutMs < 0 ? 10 : timeoutMs - (int32_t)(millis() - start);
+        if (remaining <= 0 || lua_wrapper_stop_requested()) {
+            return false;
+        }
+        xSemaphoreTake(lineSignal, pdMS_TO_TICKS(min(remaining, (int32_t)10)));
     }
+    return true;
+}
 
-    char buffer[500];  // Match the size used in queue creation
-    if (xQueueReceive(stringQueue, &buffer, pdMS_TO_TICKS(10)) == pdPASS) {
-        return String(buffer);
+String readStringFromQueue() {
+    String line;
+    if (!lineRing.take(readLine)) {
+        return line;
     }
-    return "";  // Return empty string if no data or error
+    line.reserve(readLine.size());
+    for (char c : readLine) {
+        line += c;
+    }
+    return line;
 }
+
 int getQueueCount() {
-    if (stringQueue == NULL) {
-        return 0;
-    }
-    return uxQueueMessagesWaiting(stringQueue);
+    return lineRing.count();
 }
+
+// Reader side only: drops the lines counted so far; a line still being
+// received survives
 void emptyQueue() {
-    if (stringQueue == NULL) {
-        return;
-    }
-    
-    // Read and discard all messages from queue
-    char buffer[500];
-    while (xQueueReceive(stringQueue, &buffer, 0) == pdPASS) {
-        // Keep receiving until queue is empty
+    lineRing.clear();
+}
+
+LQueueStats getQueueStats() {
+    return lineRing.stats;
+}
+
+// queue.read([timeoutMs]) -> line or nil; timeout 0 polls, negative waits forever
+static int l_queue_read(lua_State *L) {
+    int32_t timeoutMs = (int32_t)luaL_optinteger(L, 1, 0);
+    if (!wait_line(timeoutMs)) {
+        lua_wrapper_check_stop(L);
+        lua_pushnil(L);
+        return 1;
     }
-    
-    // Alternative method using xQueueReset
-    // xQueueReset(stringQueue);  // This is faster but less graceful
-}
\ No newline at end of file
+    lua_pushlstring(L, readLine.data(), readLine.size());
+    return 1;
+}
+
+// Pulls what has arrived first, so scripts that poll count() before read()
+// keep a long line flowing too
+static int l_queue_count(lua_State *L) {
+    lineRing.pull();
+    lua_pushinteger(L, getQueueCount());
+    return 1;
+}
+
+static int l_queue_clear(lua_State *L) {
+    emptyQueue();
+    return 0;
+}
+
+static int l_queue_stats(lua_State *L) {
+    LQueueStats stats = getQueueStats();
+    lua_newtable(L);
+    lua_pushinteger(L, stats.lines);
+    lua_setfield(L, -2, "lines");
+    lua_pushinteger(L, stats.droppedBytes);
+    lua_setfield(L, -2, "dropped_bytes");
+    lua_pushinteger(L, stats.truncatedLines);
+    lua_setfield(L, -2, "truncated");
+    lua_pushinteger(L, stats.pauses);
+    lua_setfield(L, -2, "pauses");
+    lua_pushinteger(L, stats.highWater);
+    lua_setfield(L, -2, "high_water");
+    return 1;
+}
+
+void lua_register_queue(lua_State *L) {
+    const luaL_Reg queueLib[] = {
+        {"read", l_queue_read},
+        {"count", l_queue_count},
+        {"clear", l_queue_clear},
+        {"stats", l_queue_stats},
+        {NULL, NULL}};
+
+    luaL_newlib(L, queueLib);
+    lua_setglobal(L, "queue");
+}
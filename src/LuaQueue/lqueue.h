@@ -4,15 +4,22 @@
 #include <queue>
 #include <Arduino.h>
 #include "Global/global.h"
-
-// Declare the queue handle as extern
-extern QueueHandle_t stringQueue;
+#include "linering.h"
 
 // Declare the functions
 void initQueue();
 void addStringToQueue(String str);
+void addDataToQueue(const char *data, size_t length);
+// The backpressure callback tells the peer and is only called from
+// serviceQueueBackpressure; the wake callback must get that run on the one
+// task that sends to the peer
+void setQueueBackpressureCallback(std::function<void(bool paused)> callback);
+void setQueueWakeCallback(std::function<void()> callback);
+void serviceQueueBackpressure();
 String readStringFromQueue();
 int getQueueCount();
 void emptyQueue();
+LQueueStats getQueueStats();
+void lua_register_queue(lua_State *L);
 
-#endif
\ No newline at end of file
+#endif
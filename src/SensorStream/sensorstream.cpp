@@ -0,0 +1,208 @@
+#include "sensorstream.h"
+#include "Global/global.h"
+#include "esp_timer.h"
+
+static const char *const channelNames[STREAM_CHANNEL_COUNT] = {
+    "lidar_top", "lidar_bottom", "force_left", "force_right", "button"};
+
+static esp_timer_handle_t sampleTimer = nullptr;
+static TaskHandle_t samplerTask = nullptr;
+static volatile bool running = false;
+static volatile bool flushRequested = false;
+
+static uint8_t frame[STREAM_MAX_FRAME];
+static size_t frameLength = 0;
+static uint8_t frameSamples = 0;
+static uint8_t frameSeq = 0;
+static SensorStreamStats streamStats = {};
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+static int16_t read_channel(uint8_t channel)
+{
+    int16_t distance = 0, flux = 0;
+    switch (channel)
+    {
+    case STREAM_CHANNEL_LIDAR_TOP:
+        lidarTop.readDisFlux(distance, flux);
+        return distance;
+    case STREAM_CHANNEL_LIDAR_BOTTOM:
+        lidarBottom.readDisFlux(distance, flux);
+        return distance;
+    case STREAM_CHANNEL_FORCE_LEFT:
+        return forceSensorLeft.read();
+    case STREAM_CHANNEL_FORCE_RIGHT:
+        return forceSensorRight.read();
+    case STREAM_CHANNEL_BUTTON:
+    {
+        UserButton::ButtonState state = userButton.getButtonState();
+        return (state.isPressed ? 1 : 0) | (state.isLongPress ? 2 : 0);
+    }
+    default:
+        return 0;
+    }
+}
+
+static void flush_frame()
+{
+    if (frameSamples == 0)
+    {
+        return;
+    }
+    frame[0] = STREAM_FRAME_MAGIC;
+    frame[1] = frameSeq++;
+    frame[2] = streamStats.channelMask;
+    frame[3] = frameSamples;
+    if (bleController.notifyStream(frame, frameLength))
+    {
+        streamStats.frames++;
+    }
+    else
+    {
+        streamStats.droppedFrames++;
+    }
+    frameLength = STREAM_HEADER_SIZE;
+    frameSamples = 0;
+}
+
+static void take_sample()
+{
+    uint8_t *p = frame + frameLength;
+    put_u32(p, (uint32_t)esp_timer_get_time());
+    p += STREAM_TIMESTAMP_SIZE;
+    for (uint8_t channel = 0; channel < STREAM_CHANNEL_COUNT; channel++)
+    {
+        if (streamStats.channelMask & (1 << channel))
+        {
+            int16_t value = read_channel(channel);
+            *p++ = value & 0xFF;
+            *p++ = (uint16_t)value >> 8;
+        }
+    }
+    frameLength = p - frame;
+    streamStats.samples++;
+    if (++frameSamples >= streamStats.batch)
+    {
+        flush_frame();
+    }
+}
+
+static void sampler_task(void *param)
+{
+    for (;;)
+    {
+        uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (running && ticks > 0)
+        {
+            streamStats.overruns += ticks - 1;
+            take_sample();
+        }
+        if (flushRequested)
+        {
+            // Cleared only once the frame is out: sensor_stream_start waits
+            // on it before resetting the frame and the stats
+            flush_frame();
+            flushRequested = false;
+        }
+    }
+}
+
+// esp_timer task context: only wake the sampler
+static void sample_timer_cb(void *arg)
+{
+    xTaskNotifyGive(samplerTask);
+}
+
+bool sensor_stream_start(uint8_t channelMask, uint16_t rateHz, uint8_t batch)
+{
+    channelMask &= (1 << STREAM_CHANNEL_COUNT) - 1;
+    if (channelMask == 0 || rateHz == 0 || rateHz > STREAM_MAX_RATE_HZ)
+    {
+        return false;
+    }
+    sensor_stream_stop();
+    while (flushRequested)
+    {
+        vTaskDelay(pdMS_TO_TICKS(1)); // let the old stream's last frame go out
+    }
+
+    if (!samplerTask &&
+        xTaskCreatePinnedToCore(sampler_task, "SensorStream", 3072, nullptr,
+                                tskIDLE_PRIORITY + 3, &samplerTask, 1) != pdPASS)
+    {
+        samplerTask = nullptr;
+        return false;
+    }
+    if (!sampleTimer)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = sample_timer_cb,
+            .arg = nullptr,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "stream",
+            .skip_unhandled_events = true};
+        if (esp_timer_create(&args, &sampleTimer) != ESP_OK)
+        {
+            return false;
+        }
+    }
+
+    // Fill one notification at the smallest MTU among connected centrals
+    uint8_t channels = __builtin_popcount(channelMask);
+    size_t sampleSize = STREAM_TIMESTAMP_SIZE + channels * sizeof(int16_t);
+    size_t payload = min((size_t)STREAM_MAX_FRAME, (size_t)(bleController.getMinMtu() - 3));
+    size_t fit = (payload - STREAM_HEADER_SIZE) / sampleSize;
+    if (fit == 0)
+    {
+        return false;
+    }
+
+    memset(&streamStats, 0, sizeof(streamStats));
+    streamStats.channelMask = channelMask;
+    streamStats.rateHz = rateHz;
+    streamStats.batch = min(batch == 0 ? fit : (size_t)batch, min(fit, (size_t)255));
+    frameLength = STREAM_HEADER_SIZE;
+    frameSamples = 0;
+    running = true;
+
+    if (esp_timer_start_periodic(sampleTimer, 1000000UL / rateHz) != ESP_OK)
+    {
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+// Stop sampling; the sampler sends whatever is left in the current frame
+void sensor_stream_stop()
+{
+    if (!running)
+    {
+        return;
+    }
+    esp_timer_stop(sampleTimer);
+    running = false;
+    flushRequested = true;
+    xTaskNotifyGive(samplerTask);
+}
+
+bool sensor_stream_running()
+{
+    return running;
+}
+
+void sensor_stream_get_stats(SensorStreamStats *stats)
+{
+    *stats = streamStats;
+}
+
+const char *sensor_stream_channel_name(uint8_t channel)
+{
+    return channel < STREAM_CHANNEL_COUNT ? channelNames[channel] : nullptr;
+}
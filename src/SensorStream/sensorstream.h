@@ -0,0 +1,44 @@
+#ifndef SENSORSTREAM_H
+#define SENSORSTREAM_H
+#include <Arduino.h>
+
+// Binary telemetry on the BLE stream characteristic. A timer paces a sampler
+// task that reads the selected channels and batches samples into frames:
+//
+//   [0xA5][seq][channel mask][sample count] then per sample
+//   [timestamp us u32 LE][int16 LE for each channel set in the mask, low bit first]
+#define STREAM_FRAME_MAGIC 0xA5
+#define STREAM_HEADER_SIZE 4
+#define STREAM_TIMESTAMP_SIZE 4
+#define STREAM_MAX_FRAME 509   // ATT MTU 512 - 3
+#define STREAM_MAX_RATE_HZ 2000
+
+enum SensorStreamChannel : uint8_t
+{
+    STREAM_CHANNEL_LIDAR_TOP = 0,   // mm
+    STREAM_CHANNEL_LIDAR_BOTTOM,    // mm
+    STREAM_CHANNEL_FORCE_LEFT,      // raw ADC
+    STREAM_CHANNEL_FORCE_RIGHT,     // raw ADC
+    STREAM_CHANNEL_BUTTON,          // bit 0 pressed, bit 1 long press
+    STREAM_CHANNEL_COUNT
+};
+
+struct SensorStreamStats
+{
+    uint32_t samples;
+    uint32_t frames;
+    uint32_t droppedFrames; // notification refused (no link, no buffers)
+    uint32_t overruns;      // timer ticks missed by the sampler
+    uint16_t rateHz;
+    uint8_t channelMask;
+    uint8_t batch;          // samples per frame
+};
+
+// batch 0 packs as many samples as fit one notification at the smallest MTU
+bool sensor_stream_start(uint8_t channelMask, uint16_t rateHz, uint8_t batch);
+void sensor_stream_stop();
+bool sensor_stream_running();
+void sensor_stream_get_stats(SensorStreamStats *stats);
+const char *sensor_stream_channel_name(uint8_t channel);
+
+#endif
@@ -0,0 +1,92 @@
+#include "SensorStream/sensorstreamlua.h"
+
+// stream.start{rate = 500, channels = {"lidar_top", "force_left"}, batch = 0}
+// -> true, or false and a message
+static int lua_wrapper_stream_start(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_Integer rate = (lua_getfield(L, 1, "rate"), luaL_optinteger(L, -1, 100));
+    lua_Integer batch = (lua_getfield(L, 1, "batch"), luaL_optinteger(L, -1, 0));
+    lua_pop(L, 2);
+
+    uint8_t mask = 0;
+    if (lua_getfield(L, 1, "channels") == LUA_TTABLE)
+    {
+        lua_Integer n = luaL_len(L, -1);
+        for (lua_Integer i = 1; i <= n; i++)
+        {
+            lua_geti(L, -1, i);
+            const char *name = luaL_checkstring(L, -1);
+            uint8_t channel = 0;
+            while (channel < STREAM_CHANNEL_COUNT && strcmp(name, sensor_stream_channel_name(channel)) != 0)
+            {
+                channel++;
+            }
+            if (channel == STREAM_CHANNEL_COUNT)
+            {
+                return luaL_error(L, "unknown stream channel '%s'", name);
+            }
+            mask |= 1 << channel;
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+
+    if (rate < 1 || rate > STREAM_MAX_RATE_HZ || batch < 0 || batch > 255)
+    {
+        return luaL_error(L, "rate must be 1..%d and batch 0..255", STREAM_MAX_RATE_HZ);
+    }
+    if (!sensor_stream_start(mask, (uint16_t)rate, (uint8_t)batch))
+    {
+        lua_pushboolean(L, false);
+        lua_pushstring(L, mask == 0 ? "no channels" : "stream start failed");
+        return 2;
+    }
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+static int lua_wrapper_stream_stop(lua_State *L)
+{
+    sensor_stream_stop();
+    return 0;
+}
+
+static int lua_wrapper_stream_running(lua_State *L)
+{
+    lua_pushboolean(L, sensor_stream_running());
+    return 1;
+}
+
+static int lua_wrapper_stream_stats(lua_State *L)
+{
+    SensorStreamStats stats;
+    sensor_stream_get_stats(&stats);
+    lua_newtable(L);
+    lua_pushinteger(L, stats.samples);
+    lua_setfield(L, -2, "samples");
+    lua_pushinteger(L, stats.frames);
+    lua_setfield(L, -2, "frames");
+    lua_pushinteger(L, stats.droppedFrames);
+    lua_setfield(L, -2, "dropped_frames");
+    lua_pushinteger(L, stats.overruns);
+    lua_setfield(L, -2, "overruns");
+    lua_pushinteger(L, stats.rateHz);
+    lua_setfield(L, -2, "rate");
+    lua_pushinteger(L, stats.batch);
+    lua_setfield(L, -2, "batch");
+    return 1;
+}
+
+void lua_register_sensorstream(lua_State *L)
+{
+    const luaL_Reg streamLib[] = {
+        {"start", lua_wrapper_stream_start},
+        {"stop", lua_wrapper_stream_stop},
+        {"running", lua_wrapper_stream_running},
+        {"stats", lua_wrapper_stream_stats},
+        {NULL, NULL}};
+
+    luaL_newlib(L, streamLib);
+    lua_setglobal(L, "stream");
+}
@@ -0,0 +1,9 @@
+#ifndef SENSORSTREAMLUA_H
+#define SENSORSTREAMLUA_H
+
+#include "Global/global.h"
+#include "sensorstream.h"
+
+void lua_register_sensorstream(lua_State *L);
+
+#endif
@@ -129,7 +129,8 @@ int lua_wrapper_button_wait_click(lua_State *L)
             lua_pushboolean(L, false);
             return 1;
         }
-        delay(1);
+        if (!lua_wrapper_sleep(1))
+            lua_wrapper_check_stop(L);
     }
 
     g_buttonInstance->clearEvents();
@@ -153,7 +154,8 @@ int lua_wrapper_button_wait_double_click(lua_State *L)
             lua_pushboolean(L, false);
             return 1;
         }
-        delay(1);
+        if (!lua_wrapper_sleep(1))
+            lua_wrapper_check_stop(L);
     }
 
     g_buttonInstance->clearEvents();
@@ -177,7 +179,8 @@ int lua_wrapper_button_wait_long_press(lua_State *L)
             lua_pushboolean(L, false);
             return 1;
         }
-        delay(1);
+        if (!lua_wrapper_sleep(1))
+            lua_wrapper_check_stop(L);
     }
 
     g_buttonInstance->clearEvents();
@@ -201,7 +204,8 @@ int lua_wrapper_button_wait_multi_click(lua_State *L)
             lua_pushboolean(L, false);
             return 1;
         }
-        delay(1);
+        if (!lua_wrapper_sleep(1))
+            lua_wrapper_check_stop(L);
     }
 
     g_buttonInstance->clearEvents();
@@ -1,4 +1,5 @@
 #include "ble_handlers.h"
+#include "luaprofiler.h"
 extern "C"
 {
 #define LUAT_LOG_TAG "STORAGE_CTRL"
@@ -7,9 +8,20 @@ extern "C"
 
 void initializeBLEHandlers()
 {
-
-
-
+    // {"msgtyp":"profile","cmd":"start|stop|reset|get","period":10,"top":16}
+    bleController.registerMessageCallback("profile", [](JsonDocument &doc)
+                                          {
+        const char *cmd = doc["cmd"] | "get";
+        if (strcmp(cmd, "start") == 0) {
+            lua_profiler_start(doc["period"] | LUA_PROFILER_DEFAULT_PERIOD);
+        } else if (strcmp(cmd, "stop") == 0) {
+            lua_profiler_stop();
+        } else if (strcmp(cmd, "reset") == 0) {
+            lua_profiler_reset();
+        }
+        static char report[1536];
+        lua_profiler_report(report, sizeof(report), doc["top"] | 16);
+        bleController.sendMessage(String(report)); });
 }
 
 /*********************************BLE & OTA HANDLERS *******************************************/
@@ -58,12 +70,3 @@ void onOtaError(const char *error)
     bleController.sendMessage(responce);
 }
 
-
-
-
-
-void processBLEMessages()
-{
-    bleController.processJsonMessages();
-    bleController.processTextMessages();
-}
@@ -7,7 +7,6 @@
 #include "Global/global.h"
 
 void initializeBLEHandlers();
-void processBLEMessages();
 void onBLEConnect();
 void onBLEDisconnect();
 void onOtaStart();
@@ -4,6 +4,7 @@ void initializeDevice()
 {
 
     LittleFSFile::initFS();
+    ManifestFile::recover();
     intializeStorage();
     initializeBLEController();
     buzzer_init_c();
@@ -28,13 +29,25 @@ void initializeBLEController(String deviceName)
     bleController.begin();
     bleController.setOnConnectCallback(handleBleConnect);
     bleController.setOnDisconnectCallback(handleBleDisconnect);
-    bleController.setTextMessageCallback(lua_loop);
+    bleController.setTextExecuteCallback(lua_loop);
     bleController.setTextAbortCallback(luaClose);
     bleController.switchToTextMode();
     bleController.setOtaCallbacks(onOtaStart, onOtaProgress, onOtaSuccess, onOtaError);
-    bleController.setTextQueueCallback(addStringToQueue);
+    bleController.setTextQueueDataCallback(addDataToQueue);
     initializeBLEHandlers();
     initQueue();
+    // {"msgtyp":"queue","paused":...} so the peer holds queue data while Lua
+    // catches up; a message of its own, since print output may carry any byte.
+    // Sent only from the BLE receive side, however the queue got there.
+    setQueueBackpressureCallback([](bool paused)
+                                 {
+        JsonDocument doc;
+        doc["msgtyp"] = "queue";
+        doc["paused"] = paused;
+        bleController.sendMessage(doc); });
+    setQueueWakeCallback([]()
+                         { bleController.requestPoll(); });
+    bleController.setPollCallback(serviceQueueBackpressure);
     LLOGI("BLE Controller initialized");
 }
 
@@ -81,7 +94,7 @@ void initializeLidar()
     Wire1.setPins(LIDAR_TOP_SDA, LIDAR_TOP_SCL);
     Wire.setPins(LIDAR_BOTTOM_SDA, LIDAR_BOTTOM_SCL);
 
-    lidarTop.begin(&Wire1,LIDAR_TOP_SDA,LIDAR_TOP_SCL);
+    lidarTop.begin(&Wire1,LIDAR_TOP_SDA,LIDAR_TOP_SCL,LIDAR_TOP_INT);
 
     if (lidarTop.start()) {
                 LLOGI("Top LiDAR continuous mode started");
@@ -95,7 +108,7 @@ void initializeLidar()
      delay(50);
 
 
-    lidarBottom.begin(&Wire,LIDAR_BOTTOM_SDA,LIDAR_BOTTOM_SCL);
+    lidarBottom.begin(&Wire,LIDAR_BOTTOM_SDA,LIDAR_BOTTOM_SCL,LIDAR_BOTTOM_INT);
 
       if (lidarBottom.start()) {
                 successbottom = true;
@@ -131,6 +144,19 @@ void initializeForceSensor()
     // Initialize right force sensor
     forceSensorRight.begin();
     LLOGI("Right Force Sensor initialized");
+
+    // From here on both sensors are sampled in the background
+    forceSampler.begin(FORCE_SENSOR_LEFT_PIN, FORCE_SENSOR_RIGHT_PIN);
+    forceSensorLeft.attach(&forceSampler, 0);
+    forceSensorRight.attach(&forceSampler, 1);
+    if (forceSampler.start(FORCE_SAMPLE_RATE_HZ, FORCE_DECIMATION, FORCE_WINDOW_MS))
+    {
+        LLOGI("Force sampler running, %s", forceSampler.getStats().dma ? "DMA" : "timer");
+    }
+    else
+    {
+        LLOGE("Force sampler failed to start, reading on demand");
+    }
     
     // Optional: Add a confirmation beep for successful initialization
     // buzzer.beepAsync(300, 100, 1);
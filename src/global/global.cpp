@@ -11,4 +11,5 @@ Lidar lidarTop;
 
 ForceSensor forceSensorLeft(FORCE_SENSOR_LEFT_PIN);
 ForceSensor forceSensorRight(FORCE_SENSOR_RIGHT_PIN);
+ForceSampler forceSampler;
 
@@ -30,6 +30,9 @@
 #include "ForceSensor/ForceSensor.h"
 #include "ForceSensor/ForceSensor_Lua.h"
 
+#include "SensorStream/sensorstream.h"
+#include "SensorStream/sensorstreamlua.h"
+
 #define USE_HSPI_PORT
 
 #include <SPI.h>
@@ -47,6 +50,7 @@ extern Lidar lidarBottom;
 extern Lidar lidarTop;
 extern ForceSensor forceSensorLeft;
 extern ForceSensor forceSensorRight;
+extern ForceSampler forceSampler;
 
 
 #endif // GLOBAL_H
\ No newline at end of file
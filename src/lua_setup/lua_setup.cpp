@@ -1,5 +1,6 @@
 #include "lua_setup.h"
 #include "require_lua.h"
+#include "luaoutput.h"
 
 // Global state
 bool bleConnected = false;
@@ -15,7 +16,9 @@ static struct
 // Forward declarations
 static void registerCustomFunctions(lua_State *L);
 static void outputHandler(const char *output);
+static void outputSink(const char *data, size_t length);
 static void errorHandler(const char *error);
+static void diagnosticsHandler(JsonDocument &doc);
 
 void lua_setup()
 {
@@ -25,8 +28,19 @@ void lua_setup()
     lua_wrapper_set_output_cb(outputHandler);
     lua_wrapper_set_error_cb(errorHandler);
     lua_wrapper_set_register_cb(registerCustomFunctions);
+    lua_wrapper_set_exec_start_cb([]() { bleController.recordExecStart(); });
+    bleController.setDiagnosticsCallback(diagnosticsHandler);
     lua_wrapper_set_main_module(luaConfig.mainModule);
     lua_wrapper_set_stop_module("stop");
+    lua_wrapper_set_warm_spare(true); // keep a ready state so a clean stop is a swap
+
+    // print() is batched off the Lua task; one batch fills a notification at
+    // the smallest MTU among the connected centrals
+    if (!lua_output_init(outputSink))
+    {
+        Serial.println("Output task failed, print() stays synchronous");
+    }
+    bleController.setOnMtuChangeCallback([](uint16_t mtu) { lua_output_set_mtu(mtu); });
 
     // Initialize Lua wrapper with 16KB stack
     if (!lua_wrapper_init(16384, 1))
@@ -46,7 +60,7 @@ void lua_setup()
     Serial.println("System ready");
 }
 
-void lua_loop(String script)
+void lua_loop(const char *script, size_t length)
 {
     Serial.println("*****************LUA SCRIPT EXECUTE*****************");
     lua_wrapper_print_memory_usage();
@@ -83,9 +97,26 @@ void lua_loop(String script)
         }
     }
 
-    // Execute the new script
+    // Execute the new script: copy straight into a pool slot, no String in between
+    char *buffer;
+    size_t capacity;
+    ScriptHandle handle = lua_wrapper_acquire_buffer(&buffer, &capacity);
+    bool queued = false;
+    if (handle != SCRIPT_HANDLE_INVALID)
+    {
+        if (length < capacity)
+        {
+            memcpy(buffer, script, length);
+            queued = lua_wrapper_submit_buffer(handle, length, false, false); // no persistent, no auto-restart
+        }
+        else
+        {
+            Serial.printf("Script too large: %u bytes (max %u)\n", (unsigned)length, (unsigned)capacity - 1);
+            lua_wrapper_release_buffer(handle);
+        }
+    }
 
-    if (!lua_wrapper_exec_string(script.c_str(), false, false)) // no persistent, no auto-restart
+    if (!queued)
     {
         Serial.println("Lua execution failed");
         Serial.print("Error: ");
@@ -133,6 +164,7 @@ void luaClose(String stopScript)
 void handleBleConnect()
 {
     bleConnected = true;
+    lua_output_reset_stats();
     Serial.println("BLE Connected");
     buzzer_play_music_c("A2B2");
 
@@ -148,9 +180,17 @@ void handleBleConnect()
 
 void handleBleDisconnect()
 {
-    bleConnected = false;
+    // Other centrals may still be connected
+    bleConnected = bleController.deviceConnected;
     Serial.println("BLE Disconnected");
     buzzer_play_music_c("A2B2");
+    if (bleConnected)
+    {
+        return;
+    }
+
+    // Nobody left to receive telemetry
+    sensor_stream_stop();
 
     // Stop any running BLE script
     // if (lua_wrapper_is_running())
@@ -172,12 +212,19 @@ void handleBleDisconnect()
 // Callbacks
 static void outputHandler(const char *output)
 {
-    Serial.println(output);
+    lua_output_write(output, strlen(output));
+    lua_output_write("\n", 1);
+}
+
+// Runs on the output task with a coalesced batch of print() output
+static void outputSink(const char *data, size_t length)
+{
+    Serial.write((const uint8_t *)data, length);
 
     // Send to BLE if connected
     if (bleConnected && bleController.deviceConnected)
     {
-        bleController.sendTextOutput(output);
+        bleController.sendRawText(data, length);
     }
 }
 
@@ -201,6 +248,82 @@ static void errorHandler(const char *error)
     }
 }
 
+// Lua side of the "diag" report: script queue, line queue and print pipeline
+static void diagnosticsHandler(JsonDocument &doc)
+{
+    JsonObject lua = doc["lua"].to<JsonObject>();
+
+    LuaQueueStats commands;
+    lua_wrapper_get_queue_stats(&commands);
+    JsonObject scripts = lua["scripts"].to<JsonObject>();
+    scripts["submitted"] = commands.submitted;
+    scripts["completed"] = commands.completed;
+    scripts["rejected"] = commands.rejected;
+    scripts["slots_free"] = commands.slotsFree;
+    scripts["last_pickup_us"] = commands.lastLatencyUs;
+    scripts["max_pickup_us"] = commands.maxLatencyUs;
+
+    LQueueStats lines = getQueueStats();
+    JsonObject queue = lua["queue"].to<JsonObject>();
+    queue["depth"] = getQueueCount();
+    queue["lines"] = lines.lines;
+    queue["high_water"] = lines.highWater;
+    queue["dropped_bytes"] = lines.droppedBytes;
+    queue["pauses"] = lines.pauses;
+
+    LuaOutputStats output;
+    lua_output_get_stats(&output);
+    JsonObject print = lua["output"].to<JsonObject>();
+    print["written"] = output.written;
+    print["sent"] = output.sent;
+    print["dropped"] = output.dropped;
+    print["high_water"] = output.highWater;
+}
+
+// JSON report -> nested Lua tables
+static void push_json(lua_State *L, JsonVariantConst value)
+{
+    if (value.is<JsonObjectConst>())
+    {
+        lua_newtable(L);
+        for (JsonPairConst kv : value.as<JsonObjectConst>())
+        {
+            push_json(L, kv.value());
+            lua_setfield(L, -2, kv.key().c_str());
+        }
+    }
+    else if (value.is<JsonArrayConst>())
+    {
+        lua_newtable(L);
+        lua_Integer i = 1;
+        for (JsonVariantConst item : value.as<JsonArrayConst>())
+        {
+            push_json(L, item);
+            lua_rawseti(L, -2, i++);
+        }
+    }
+    else if (value.is<bool>())
+    {
+        lua_pushboolean(L, value.as<bool>());
+    }
+    else if (value.is<long long>())
+    {
+        lua_pushinteger(L, value.as<long long>());
+    }
+    else if (value.is<double>())
+    {
+        lua_pushnumber(L, value.as<double>());
+    }
+    else if (value.is<const char *>())
+    {
+        lua_pushstring(L, value.as<const char *>());
+    }
+    else
+    {
+        lua_pushnil(L);
+    }
+}
+
 // Custom Lua functions
 static int lua_ble_print(lua_State *L)
 {
@@ -218,6 +341,74 @@ static int lua_exit(lua_State *L)
     return 0;
 }
 
+// ble.link() -> {profile, auto, txphy, rxphy, mtu, interval_ms, latency,
+// timeout_ms, throughput = {idle = {tx, rx}, bulk = {tx, rx}}}
+static int lua_ble_link(lua_State *L)
+{
+    BLELinkInfo info = bleController.getLinkInfo();
+    lua_newtable(L);
+    lua_pushstring(L, BLEController::linkProfileName(info.profile));
+    lua_setfield(L, -2, "profile");
+    lua_pushboolean(L, info.autoProfile);
+    lua_setfield(L, -2, "auto");
+    lua_pushinteger(L, info.txPhy);
+    lua_setfield(L, -2, "txphy");
+    lua_pushinteger(L, info.rxPhy);
+    lua_setfield(L, -2, "rxphy");
+    lua_pushinteger(L, info.mtu);
+    lua_setfield(L, -2, "mtu");
+    lua_pushnumber(L, info.interval * 1.25);
+    lua_setfield(L, -2, "interval_ms");
+    lua_pushinteger(L, info.latency);
+    lua_setfield(L, -2, "latency");
+    lua_pushinteger(L, info.timeout * 10);
+    lua_setfield(L, -2, "timeout_ms");
+
+    lua_newtable(L);
+    for (uint8_t p = 0; p < LINK_PROFILE_COUNT; p++)
+    {
+        lua_newtable(L);
+        lua_pushinteger(L, info.txThroughput[p]);
+        lua_setfield(L, -2, "tx");
+        lua_pushinteger(L, info.rxThroughput[p]);
+        lua_setfield(L, -2, "rx");
+        lua_setfield(L, -2, BLEController::linkProfileName((BLELinkProfile)p));
+    }
+    lua_setfield(L, -2, "throughput");
+    return 1;
+}
+
+// ble.stats() -> same fields as the "diag" message
+static int lua_ble_stats(lua_State *L)
+{
+    JsonDocument doc;
+    bleController.diagnosticsToJson(doc);
+    push_json(L, doc.as<JsonVariantConst>());
+    return 1;
+}
+
+static int lua_ble_stats_reset(lua_State *L)
+{
+    bleController.resetDiagnostics();
+    return 0;
+}
+
+// ble.profile("bulk" | "idle" | "auto")
+static int lua_ble_profile(lua_State *L)
+{
+    static const char *const names[] = {"idle", "bulk", "auto", NULL};
+    int choice = luaL_checkoption(L, 1, NULL, names);
+    if (choice == 2)
+    {
+        bleController.setLinkAuto(true);
+    }
+    else
+    {
+        bleController.setLinkProfile((BLELinkProfile)choice);
+    }
+    return 0;
+}
+
 static void registerCustomFunctions(lua_State *L)
 {
     // Register custom SPIFFS require function first
@@ -235,13 +426,28 @@ static void registerCustomFunctions(lua_State *L)
     // Register LiDAR functions
     lua_register_lidar(L);
 
+    // Register BLE line queue
+    lua_register_queue(L);
+
     // Register Force Sensor functions
     lua_register_forcesensor(L);
 
+    // Register binary sensor streaming
+    lua_register_sensorstream(L);
+
     // Register BLE functions
     lua_register(L, "ble_print", lua_ble_print);
     lua_register(L, "exit", lua_exit);
 
+    const luaL_Reg bleLib[] = {
+        {"link", lua_ble_link},
+        {"profile", lua_ble_profile},
+        {"stats", lua_ble_stats},
+        {"stats_reset", lua_ble_stats_reset},
+        {NULL, NULL}};
+    luaL_newlib(L, bleLib);
+    lua_setglobal(L, "ble");
+
     // Create Device table
     lua_newtable(L);
 
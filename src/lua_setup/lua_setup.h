@@ -12,7 +12,7 @@ extern bool bleConnected;
 
 // Setup and main functions
 void lua_setup();
-void lua_loop(String script);
+void lua_loop(const char *script, size_t length);
 void luaClose(String stopScript);
 
 // BLE handlers
@@ -4,43 +4,226 @@
 
 #define LITTLEFS LittleFS
 
+#ifndef REQUIRE_READ_BLOCK_SIZE
+#define REQUIRE_READ_BLOCK_SIZE 512
+#endif
 
-// Read file line by line and execute in Lua
-static int load_file_line_by_line(lua_State *L, const char *filepath) {
+// 0 = silent, 1 = module load/errors, 2 = per-file details and source echo
+static uint8_t requireVerbosity = 1;
+#define REQUIRE_LOG(level, ...)             \
+    do {                                    \
+        if (requireVerbosity >= (level)) {  \
+            Serial.printf(__VA_ARGS__);     \
+        }                                   \
+    } while (0)
+
+// Metrics of the last source load, for benchmarking
+static struct {
+    size_t bytes;
+    uint32_t timeUs;
+    uint32_t sysHeapPeak;   // transient system heap used while loading
+    size_t vmHeapDelta;     // Lua heap retained by the compiled chunk
+} lastLoad;
+
+// Compiled-chunk cache: "/name.luac" sidecar holding a header that keys the
+// dump to the source file (size, mtime, FNV-1a hash) followed by lua_dump output.
+#define LUAC_CACHE_MAGIC 0x3143424C // "LBC1"
+
+struct LuacHeader {
+    uint32_t magic;
+    uint32_t srcSize;
+    uint32_t srcMtime;
+    uint32_t srcHash;
+    uint8_t stripped;
+    uint8_t reserved[3];
+};
+
+static struct {
+    bool enabled = true;
+    bool strip = false;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t writes = 0;
+    uint32_t errors = 0;
+} cacheState;
+
+struct FileReaderState {
+    File *file;
+    bool echo;
+    size_t bytes;
+    uint32_t minFreeHeap;
+    char block[REQUIRE_READ_BLOCK_SIZE];
+};
+
+static uint32_t fnv1a_update(uint32_t hash, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t hash_file(File &file) {
+    uint8_t block[256];
+    uint32_t hash = 2166136261u;
+    file.seek(0);
+    while (file.available()) {
+        size_t n = file.read(block, sizeof(block));
+        if (n == 0) {
+            break;
+        }
+        hash = fnv1a_update(hash, block, n);
+    }
+    return hash;
+}
+
+static const char *file_reader(lua_State *L, void *ud, size_t *size) {
+    FileReaderState *state = static_cast<FileReaderState *>(ud);
+    *size = state->file->read((uint8_t *)state->block, sizeof(state->block));
+    if (*size == 0) {
+        return NULL;
+    }
+    state->bytes += *size;
+    if (state->echo) {
+        Serial.write((const uint8_t *)state->block, *size);
+    }
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < state->minFreeHeap) {
+        state->minFreeHeap = freeHeap;
+    }
+    return state->block;
+}
+
+static int file_writer(lua_State *L, const void *p, size_t size, void *ud) {
+    File *file = static_cast<File *>(ud);
+    return file->write((const uint8_t *)p, size) == size ? 0 : 1;
+}
+
+static void cache_path(char *out, size_t outSize, const char *filepath) {
+    snprintf(out, outSize, "%sc", filepath); // "/name.lua" -> "/name.luac"
+}
+
+// Try the sidecar first; returns LUA_OK with the chunk on the stack on a hit
+static int load_from_cache(lua_State *L, const char *filepath) {
+    char luacPath[72];
+    cache_path(luacPath, sizeof(luacPath), filepath);
+    if (!LITTLEFS.exists(luacPath)) {
+        return LUA_ERRFILE;
+    }
+
+    File source = LITTLEFS.open(filepath, "r");
+    File cache = LITTLEFS.open(luacPath, "r");
+    if (!source || !cache) {
+        return LUA_ERRFILE;
+    }
+
+    LuacHeader header;
+    int result = LUA_ERRFILE;
+    if (cache.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+        header.magic == LUAC_CACHE_MAGIC &&
+        header.stripped == (cacheState.strip ? 1 : 0) &&
+        header.srcSize == source.size() &&
+        header.srcMtime == (uint32_t)source.getLastWrite() &&
+        header.srcHash == hash_file(source)) {
+        FileReaderState state;
+        state.file = &cache;
+        state.echo = false;
+        state.bytes = 0;
+        state.minFreeHeap = 0;
+        result = lua_load(L, file_reader, &state, filepath, "b");
+        if (result != LUA_OK) {
+            lua_pop(L, 1); // stale or corrupt dump, fall back to source
+            cacheState.errors++;
+        }
+    }
+
+    source.close();
+    cache.close();
+    return result;
+}
+
+// Dump the compiled chunk on top of the stack next to its source
+static void write_cache(lua_State *L, const char *filepath) {
+    char luacPath[72];
+    cache_path(luacPath, sizeof(luacPath), filepath);
+
+    File source = LITTLEFS.open(filepath, "r");
+    if (!source) {
+        return;
+    }
+    LuacHeader header = {};
+    header.srcSize = source.size();
+    header.srcMtime = (uint32_t)source.getLastWrite();
+    header.srcHash = hash_file(source);
+    header.stripped = cacheState.strip ? 1 : 0;
+    source.close();
+
+    File cache = LITTLEFS.open(luacPath, "w");
+    if (!cache) {
+        cacheState.errors++;
+        return;
+    }
+
+    // Magic is written last so a half-written file never validates
+    cache.write((const uint8_t *)&header, sizeof(header));
+    bool ok = lua_dump(L, file_writer, &cache, cacheState.strip) == 0;
+    if (ok) {
+        header.magic = LUAC_CACHE_MAGIC;
+        cache.seek(0);
+        ok = cache.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+    }
+    cache.close();
+
+    if (ok) {
+        cacheState.writes++;
+    } else {
+        LITTLEFS.remove(luacPath);
+        cacheState.errors++;
+    }
+}
+
+// Stream the source into the parser one block at a time; peak RAM is the
+// block buffer no matter how large the module is
+static int load_file_streaming(lua_State *L, const char *filepath) {
     File file = LITTLEFS.open(filepath, "r");
     if (!file) {
-        Serial.printf("Failed to open file: %s\n", filepath);
+        REQUIRE_LOG(1, "Failed to open file: %s\n", filepath);
         return LUA_ERRFILE;
     }
-    
-    Serial.printf("Reading file line by line: %s\n", filepath);
-    
-    String luaCode = "";
-    String line;
-    int lineNumber = 0;
-    
-    // Read file line by line
-    while (file.available()) {
-        line = file.readStringUntil('\n');
-        lineNumber++;
-        
-        // Add line to complete code
-        luaCode += line + "\n";
-        
-        Serial.printf("Line %d: %s\n", lineNumber, line.c_str());
-    }
-    
+
+    REQUIRE_LOG(2, "Streaming file: %s\n", filepath);
+
+    FileReaderState state;
+    state.file = &file;
+    state.echo = requireVerbosity >= 2;
+    state.bytes = 0;
+
+    int64_t start = esp_timer_get_time();
+    uint32_t freeBefore = ESP.getFreeHeap();
+    state.minFreeHeap = freeBefore;
+    size_t vmTotal, vmBefore, vmMax, vmAfter;
+    lua_wrapper_meminfo(&vmTotal, &vmBefore, &vmMax);
+
+    int result = lua_load(L, file_reader, &state, filepath, "t");
     file.close();
-    Serial.printf("Read %d lines from %s\n", lineNumber, filepath);
-    
-    // Load the complete code into Lua
-    int result = luaL_loadbuffer(L, luaCode.c_str(), luaCode.length(), filepath);
+
+    lua_wrapper_meminfo(&vmTotal, &vmAfter, &vmMax);
+    lastLoad.bytes = state.bytes;
+    lastLoad.timeUs = (uint32_t)(esp_timer_get_time() - start);
+    lastLoad.sysHeapPeak = freeBefore - state.minFreeHeap;
+    lastLoad.vmHeapDelta = vmAfter > vmBefore ? vmAfter - vmBefore : 0;
+
     if (result != LUA_OK) {
-        Serial.printf("Lua load error: %s\n", lua_tostring(L, -1));
+        REQUIRE_LOG(1, "Lua load error: %s\n", lua_tostring(L, -1));
         return result;
     }
-    
-    Serial.printf("Successfully loaded code from %s\n", filepath);
+
+    if (cacheState.enabled) {
+        write_cache(L, filepath);
+    }
+
+    REQUIRE_LOG(2, "Loaded %u bytes from %s in %u us\n",
+                (unsigned)lastLoad.bytes, filepath, (unsigned)lastLoad.timeUs);
     return LUA_OK;
 }
 
@@ -60,14 +243,14 @@ int lua_custom_require(lua_State *L) {
     
     if (lua_toboolean(L, -1)) {
         // Package is already loaded
-        Serial.printf("Module '%s' already loaded\n", name);
+        REQUIRE_LOG(2, "Module '%s' already loaded\n", name);
         return 1;
     }
     
     // Module not loaded yet, remove the nil value
     lua_pop(L, 1);
     
-    Serial.printf("Loading module directly: %s\n", name);
+    REQUIRE_LOG(1, "Loading module: %s\n", name);
     
     // Construct file path (assume .lua extension and root path)
     char filepath[64];
@@ -75,19 +258,32 @@ int lua_custom_require(lua_State *L) {
     
     // Check if file exists
     if (!spiffs_file_exists(filepath)) {
-        Serial.printf("File not found: %s\n", filepath);
+        REQUIRE_LOG(1, "File not found: %s\n", filepath);
         return luaL_error(L, "module '%s' not found at path '%s'", name, filepath);
     }
     
-    // Load file line by line
-    int loadResult = load_file_line_by_line(L, filepath);
+    // Use the compiled chunk when it still matches the source
+    int loadResult = LUA_ERRFILE;
+    if (cacheState.enabled) {
+        loadResult = load_from_cache(L, filepath);
+        if (loadResult == LUA_OK) {
+            cacheState.hits++;
+        } else {
+            cacheState.misses++;
+        }
+    }
+
+    // Compile from source
+    if (loadResult != LUA_OK) {
+        loadResult = load_file_streaming(L, filepath);
+    }
     if (loadResult != LUA_OK) {
         return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s",
                           name, filepath, lua_tostring(L, -1));
     }
     
     // Execute the loaded code
-    Serial.printf("Executing module: %s\n", name);
+    REQUIRE_LOG(2, "Executing module: %s\n", name);
     lua_pushstring(L, filepath);  // Pass filepath as argument
     
     int execResult = lua_pcall(L, 1, 1, 0);  // Call with 1 arg, expect 1 result
@@ -109,20 +305,115 @@ int lua_custom_require(lua_State *L) {
         lua_setfield(L, 2, name);  // LOADED[name] = true
     }
     
-    Serial.printf("Module '%s' loaded and executed successfully\n", name);
+    REQUIRE_LOG(1, "Module '%s' loaded and executed successfully\n", name);
     return 1;
 }
 
+// require_cache.stats() -> {hits, misses, writes, errors, enabled, strip}
+static int lua_require_cache_stats(lua_State *L) {
+    lua_newtable(L);
+    lua_pushinteger(L, cacheState.hits);
+    lua_setfield(L, -2, "hits");
+    lua_pushinteger(L, cacheState.misses);
+    lua_setfield(L, -2, "misses");
+    lua_pushinteger(L, cacheState.writes);
+    lua_setfield(L, -2, "writes");
+    lua_pushinteger(L, cacheState.errors);
+    lua_setfield(L, -2, "errors");
+    lua_pushboolean(L, cacheState.enabled);
+    lua_setfield(L, -2, "enabled");
+    lua_pushboolean(L, cacheState.strip);
+    lua_setfield(L, -2, "strip");
+    return 1;
+}
+
+static int lua_require_cache_enable(lua_State *L) {
+    cacheState.enabled = lua_toboolean(L, 1);
+    return 0;
+}
+
+// Changing strip invalidates existing sidecars (header records the mode)
+static int lua_require_cache_strip(lua_State *L) {
+    cacheState.strip = lua_toboolean(L, 1);
+    return 0;
+}
+
+static int lua_require_cache_reset(lua_State *L) {
+    cacheState.hits = 0;
+    cacheState.misses = 0;
+    cacheState.writes = 0;
+    cacheState.errors = 0;
+    return 0;
+}
+
+// Remove every .luac sidecar from the filesystem root
+static int lua_require_cache_clear(lua_State *L) {
+    int removed = 0;
+    File root = LITTLEFS.open("/");
+    File file = root.openNextFile();
+    while (file) {
+        String path = String("/") + file.name();
+        bool isCache = path.endsWith(".luac");
+        file.close();
+        if (isCache && LITTLEFS.remove(path)) {
+            removed++;
+        }
+        file = root.openNextFile();
+    }
+    lua_pushinteger(L, removed);
+    return 1;
+}
+
+// require_cache.verbosity(level): 0 silent, 1 load summary, 2 echo source
+static int lua_require_verbosity(lua_State *L) {
+    requireVerbosity = (uint8_t)luaL_checkinteger(L, 1);
+    return 0;
+}
+
+// require_cache.last_load() -> {bytes, us, sys_heap_peak, vm_heap}
+static int lua_require_last_load(lua_State *L) {
+    lua_newtable(L);
+    lua_pushinteger(L, lastLoad.bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushinteger(L, lastLoad.timeUs);
+    lua_setfield(L, -2, "us");
+    lua_pushinteger(L, lastLoad.sysHeapPeak);
+    lua_setfield(L, -2, "sys_heap_peak");
+    lua_pushinteger(L, lastLoad.vmHeapDelta);
+    lua_setfield(L, -2, "vm_heap");
+    return 1;
+}
+
+void require_set_verbosity(uint8_t level) {
+    requireVerbosity = level;
+}
+
+void require_cache_set_strip(bool strip) {
+    cacheState.strip = strip;
+}
+
 void register_custom_require(lua_State *L) {
     // Register our custom require function
     lua_pushcfunction(L, lua_custom_require);
     lua_setglobal(L, "requiree");
     
-    Serial.println("Custom LITTLEFS require function registered");
+    REQUIRE_LOG(2, "Custom LITTLEFS require function registered\n");
     
     // Ensure LOADED table exists
     luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
     lua_pop(L, 1);  // Remove the table from stack
     
-    Serial.println("LOADED table initialized");
+    REQUIRE_LOG(2, "LOADED table initialized\n");
+
+    const luaL_Reg cacheLib[] = {
+        {"stats", lua_require_cache_stats},
+        {"enable", lua_require_cache_enable},
+        {"strip", lua_require_cache_strip},
+        {"reset", lua_require_cache_reset},
+        {"clear", lua_require_cache_clear},
+        {"verbosity", lua_require_verbosity},
+        {"last_load", lua_require_last_load},
+        {NULL, NULL}};
+    luaL_newlib(L, cacheLib);
+    lua_setglobal(L, "require_cache");
 } 
\ No newline at end of file
@@ -7,12 +7,18 @@
 extern "C" {
 #endif
 
-// Custom require function for SPIFFS (reads line by line)
+// Custom require function for LITTLEFS (streams the source in fixed blocks)
 int lua_custom_require(lua_State *L);
 
 // Register the custom require function
 void register_custom_require(lua_State *L);
 
+// Serial logging level: 0 silent, 1 load summary (default), 2 echo source
+void require_set_verbosity(uint8_t level);
+
+// Strip debug info from cached bytecode (smaller .luac, no line numbers in errors)
+void require_cache_set_strip(bool strip);
+
 // Helper function to check if file exists in SPIFFS
 bool spiffs_file_exists(const char* filepath);
 
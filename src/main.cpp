@@ -1,6 +1,8 @@
 #include <Arduino.h>
 #include "Global/global.h"
 
+static bool bleWorkerRunning = false;
+
 
 
 
@@ -12,18 +14,28 @@ void setup()
     
     initializeDevice();
     lua_setup();
+    // Until the worker runs, writes are handled on the NimBLE host task and
+    // their messages wait in the controller's queues for a poller
+    bleWorkerRunning = bleController.startWorker();
+    if (!bleWorkerRunning)
+    {
+        Serial.println("BLE worker failed to start, polling from loop()");
+    }
     
     Serial.println("Setup complete new firmware 22222");
 }
 
 void loop()
 {
-    // Handle serial commands
-    processBLEMessages();
-    bleController.processOTAData();
-    
-    // Charger status updates are now handled by the RTOS task
-    // No need for manual updates in the main loop
-
+    // BLE traffic is handled by the controller's worker task and everything
+    // else runs in its own RTOS task, so the loop task is not needed
+    if (bleWorkerRunning)
+    {
+        vTaskDelete(NULL);
+    }
 
+    // No worker: poll as before it existed
+    bleController.processJsonMessages();
+    bleController.processTextMessages();
+    bleController.processOTAData();
 }
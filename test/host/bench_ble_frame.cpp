@@ -0,0 +1,45 @@
+// Frame path benchmark: sealing frames and reassembling them from BLE-sized
+// writes, per payload size, in MB/s of payload. Not a ctest test; run it by
+// hand. The MessagePack encode/decode around it is ArduinoJson's and is not
+// part of the host build.
+#include "bleframe.h"
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#define BENCH_WRITE_SIZE 509 // one write at the 512 byte MTU
+#define BENCH_BYTES (8 * 1024 * 1024)
+
+int main()
+{
+    printf("payload   frames/s      MB/s   (seal + reassemble, %d byte writes)\n", BENCH_WRITE_SIZE);
+    for (size_t payload : {16, 64, 244, 1024, 4096})
+    {
+        std::vector<uint8_t> frame(BLE_FRAME_HEADER_SIZE + payload + BLE_FRAME_CRC_SIZE);
+        for (size_t i = 0; i < payload; i++)
+        {
+            frame[BLE_FRAME_HEADER_SIZE + i] = (uint8_t)(i * 31);
+        }
+        size_t frames = BENCH_BYTES / payload, received = 0;
+        std::string buffer;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < frames; n++)
+        {
+            size_t total = seal_frame(frame.data(), FRAME_TYPE_MSG, (uint8_t)n, (uint16_t)payload);
+            for (size_t offset = 0; offset < total; offset += BENCH_WRITE_SIZE)
+            {
+                std::string write((const char *)frame.data() + offset, std::min((size_t)BENCH_WRITE_SIZE, total - offset));
+                ble_frame_receive(buffer, write, [&](const BLEFrame &f) { received += f.length; },
+                                  [](uint8_t seq) {});
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (received != frames * payload)
+        {
+            fprintf(stderr, "lost frames at payload %zu\n", payload);
+            return 1;
+        }
+        printf("%7zu %10.0f %9.1f\n", payload, frames / seconds, received / seconds / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Compressed transfer benchmark: for each file of a script bundle (the Lua
+// scripts under test/ by default) the raw deflate size a sender gets at each
+// level with the device's 4 KB window, and the transfer time that works out
+// to at a given link throughput. Not a ctest test; run it by hand:
+//   bench_inflate_transfer [rx bytes/s] [files...]
+// Take the throughput from ble.link().throughput.bulk.rx on the device.
+// Inflate time is measured with the host decoder, so it only shows that
+// decoding is not what bounds a transfer, not what the ROM tinfl takes.
+#include "inflatewindow.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#define BENCH_CHUNK 509       // file chunk payload at the 512 byte MTU
+#define BENCH_DEFAULT_RX 20000 // bytes/s; placeholder, pass the measured figure
+
+static std::string deflate_raw(const std::string &data, int level)
+{
+    z_stream zs = {};
+    deflateInit2(&zs, level, Z_DEFLATED, -12, 8, Z_DEFAULT_STRATEGY);
+    std::string stream(deflateBound(&zs, data.size()), 0);
+    zs.next_in = (Bytef *)data.data();
+    zs.avail_in = data.size();
+    zs.next_out = (Bytef *)&stream[0];
+    zs.avail_out = stream.size();
+    deflate(&zs, Z_FINISH);
+    stream.resize(stream.size() - zs.avail_out);
+    deflateEnd(&zs);
+    return stream;
+}
+
+static double inflate_us(const std::string &stream, size_t expected)
+{
+    InflateWindow state = {};
+    inflate_begin(state);
+    size_t received = 0;
+    auto sink = [&](const uint8_t *data, size_t length) {
+        received += length;
+        return received == expected ? INFLATE_SINK_FULL : INFLATE_SINK_OK;
+    };
+    auto start = std::chrono::steady_clock::now();
+    InflateResult result = INFLATE_MORE;
+    for (size_t i = 0; i < stream.size() && result == INFLATE_MORE; i += BENCH_CHUNK)
+    {
+        size_t n = std::min((size_t)BENCH_CHUNK, stream.size() - i);
+        result = inflate_feed(state, (const uint8_t *)stream.data() + i, n, sink);
+    }
+    auto end = std::chrono::steady_clock::now();
+    inflate_end(state);
+    if (result != INFLATE_DONE)
+    {
+        fprintf(stderr, "inflate failed (%d)\n", result);
+        exit(1);
+    }
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    double rx = argc > 1 ? atof(argv[1]) : BENCH_DEFAULT_RX;
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; i++)
+    {
+        paths.push_back(argv[i]);
+    }
+    if (paths.empty())
+    {
+        for (const auto &entry : std::filesystem::directory_iterator(BENCH_SCRIPT_DIR))
+        {
+            if (entry.path().extension() == ".lua")
+            {
+                paths.push_back(entry.path().string());
+            }
+        }
+    }
+
+    std::vector<std::string> files;
+    size_t rawBytes = 0;
+    for (const std::string &path : paths)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        files.push_back(contents.str());
+        rawBytes += files.back().size();
+    }
+    printf("%zu files, %zu bytes, link %.0f bytes/s\n", files.size(), rawBytes, rx);
+    printf("level   bytes   ratio   transfer ms   inflate ms (host)\n");
+    printf("  raw %7zu   1.000   %11.0f\n", rawBytes, rawBytes * 1000.0 / rx);
+    for (int level : {1, 6, 9})
+    {
+        size_t bytes = 0;
+        double us = 0;
+        for (const std::string &file : files)
+        {
+            std::string stream = deflate_raw(file, level);
+            bytes += stream.size();
+            us += inflate_us(stream, file.size());
+        }
+        printf("%5d %7zu   %.3f   %11.0f   %.2f\n", level, bytes, (double)bytes / rawBytes, bytes * 1000.0 / rx,
+               us / 1000.0);
+    }
+    return 0;
+}
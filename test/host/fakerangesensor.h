@@ -0,0 +1,60 @@
+// Scripted RangeSensor for host tests: queued results come out one per
+// dataReady/readSample, as if the device had just finished a measurement.
+#ifndef FAKERANGESENSOR_H
+#define FAKERANGESENSOR_H
+#include "rangesensor.h"
+#include <deque>
+
+class FakeRangeSensor : public RangeSensor
+{
+public:
+    bool configure(const LidarProfileConfig &profile) override
+    {
+        if (running)
+        {
+            return false; // the engine only reconfigures a stopped sensor
+        }
+        config = profile;
+        configured++;
+        return true;
+    }
+
+    bool startContinuous(uint16_t period) override
+    {
+        running = true;
+        periodMs = period;
+        return true;
+    }
+
+    void stopContinuous() override { running = false; }
+
+    bool dataReady() override { return running && !results.empty(); }
+
+    bool readSample(LidarSample &sample) override
+    {
+        if (results.empty())
+        {
+            return false;
+        }
+        sample = results.front();
+        results.pop_front();
+        return true;
+    }
+
+    void queue(uint16_t distance, uint8_t status = LIDAR_STATUS_VALID, uint16_t signalRate = 128 * 10)
+    {
+        LidarSample sample = {};
+        sample.distance = distance;
+        sample.signalRate = signalRate;
+        sample.status = status;
+        results.push_back(sample);
+    }
+
+    std::deque<LidarSample> results;
+    LidarProfileConfig config = {};
+    int configured = 0;
+    bool running = false;
+    uint16_t periodMs = 0;
+};
+
+#endif
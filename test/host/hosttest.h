@@ -0,0 +1,52 @@
+// Minimal checks for the host tests: no framework to fetch, ctest runs the
+// executables and a non-zero exit marks the test failed.
+#ifndef HOSTTEST_H
+#define HOSTTEST_H
+
+#include <stdio.h>
+
+static int hostTestFailures = 0;
+
+#define CHECK(cond)                                                       \
+    do                                                                    \
+    {                                                                     \
+        if (!(cond))                                                      \
+        {                                                                 \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            hostTestFailures++;                                           \
+        }                                                                 \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                        \
+    do                                                                    \
+    {                                                                     \
+        long long a_ = (long long)(actual), e_ = (long long)(expected);   \
+        if (a_ != e_)                                                     \
+        {                                                                 \
+            fprintf(stderr, "%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+            hostTestFailures++;                                           \
+        }                                                                 \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                           \
+    do                                                                    \
+    {                                                                     \
+        double a_ = (actual), e_ = (expected);                            \
+        if (a_ < e_ - (tolerance) || a_ > e_ + (tolerance))               \
+        {                                                                 \
+            fprintf(stderr, "%s:%d: %s == %g, expected %g\n", __FILE__, __LINE__, #actual, a_, e_); \
+            hostTestFailures++;                                           \
+        }                                                                 \
+    } while (0)
+
+#define RUN_TEST(fn)              \
+    do                            \
+    {                             \
+        int before_ = hostTestFailures; \
+        fn();                     \
+        printf("%s %s\n", hostTestFailures == before_ ? "PASS" : "FAIL", #fn); \
+    } while (0)
+
+#define HOST_TEST_RESULT() (hostTestFailures == 0 ? 0 : 1)
+
+#endif
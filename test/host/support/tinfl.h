@@ -0,0 +1,383 @@
+// Stand-in for the ROM tinfl: a raw deflate decoder with the same call
+// protocol, statuses and wrapping output buffer, so the tests run real zlib
+// streams. Back-references are read from the caller's window, as tinfl does.
+// Input is taken whole; an item cut off by the end of a chunk is kept in the
+// decompressor and decoded again from its start when more arrives.
+#ifndef HOST_TINFL_H
+#define HOST_TINFL_H
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum
+{
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+// Longest item decoded in one go is a dynamic block header, under 300 bytes
+#define TINFL_HOST_PENDING 512
+
+enum
+{
+    TINFL_HOST_HEADER,
+    TINFL_HOST_STORED,
+    TINFL_HOST_CODES,
+    TINFL_HOST_DONE,
+    TINFL_HOST_FAILED,
+};
+
+// Canonical Huffman code: codes per length and symbols in code order
+struct tinfl_host_huffman
+{
+    uint16_t count[16];
+    uint16_t symbol[288];
+};
+
+struct tinfl_decompressor
+{
+    int stage;
+    bool final;
+    uint32_t stored;     // bytes left in a stored block
+    uint32_t matchLen;   // back-reference cut off by a full output buffer
+    uint32_t matchDist;
+    uint64_t totalOut;
+    tinfl_host_huffman lengths;
+    tinfl_host_huffman distances;
+    uint8_t pending[TINFL_HOST_PENDING];
+    size_t pendingLen;
+    uint32_t bitPos;     // into pending[0], or the input when none is pending
+};
+
+#define tinfl_init(r) memset((r), 0, sizeof(tinfl_decompressor))
+
+// LSB-first bit reader over the pending bytes followed by the new input
+struct tinfl_host_bits
+{
+    const uint8_t *pending;
+    size_t pendingLen;
+    const uint8_t *in;
+    size_t inLen;
+    uint64_t pos;
+    bool exhausted;
+
+    uint32_t get(unsigned n)
+    {
+        if (pos + n > 8 * (uint64_t)(pendingLen + inLen))
+        {
+            exhausted = true;
+            return 0;
+        }
+        uint32_t value = 0;
+        for (unsigned i = 0; i < n; i++, pos++)
+        {
+            size_t index = pos / 8;
+            uint8_t byte = index < pendingLen ? pending[index] : in[index - pendingLen];
+            value |= (uint32_t)((byte >> (pos % 8)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+// False for an over-subscribed code; incomplete codes fail when an unused
+// code turns up
+inline bool tinfl_host_build(tinfl_host_huffman &h, const uint8_t *lengths, int n)
+{
+    memset(h.count, 0, sizeof(h.count));
+    for (int i = 0; i < n; i++)
+    {
+        h.count[lengths[i]]++;
+    }
+    int left = 1;
+    for (int len = 1; len < 16; len++)
+    {
+        left = (left << 1) - h.count[len];
+        if (left < 0)
+        {
+            return false;
+        }
+    }
+    uint16_t offset[16];
+    offset[1] = 0;
+    for (int len = 1; len < 15; len++)
+    {
+        offset[len + 1] = offset[len] + h.count[len];
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (lengths[i])
+        {
+            h.symbol[offset[lengths[i]]++] = i;
+        }
+    }
+    return true;
+}
+
+inline int tinfl_host_decode(tinfl_host_bits &bits, const tinfl_host_huffman &h)
+{
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++)
+    {
+        code |= bits.get(1);
+        if (bits.exhausted)
+        {
+            return -1;
+        }
+        int count = h.count[len];
+        if (code - count < first)
+        {
+            return h.symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+// Block header; false on a malformed one (or when the bits ran out)
+inline bool tinfl_host_header(tinfl_decompressor *r, tinfl_host_bits &bits)
+{
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    r->final = bits.get(1);
+    uint32_t type = bits.get(2);
+    uint8_t lengths[320];
+    if (type == 0)
+    {
+        bits.pos = (bits.pos + 7) & ~(uint64_t)7;
+        uint32_t len = bits.get(16);
+        uint32_t nlen = bits.get(16);
+        r->stored = len;
+        r->stage = TINFL_HOST_STORED;
+        return (len ^ 0xFFFF) == nlen;
+    }
+    if (type == 1)
+    {
+        memset(lengths, 8, 144);
+        memset(lengths + 144, 9, 112);
+        memset(lengths + 256, 7, 24);
+        memset(lengths + 280, 8, 8);
+        memset(lengths + 288, 5, 30);
+        tinfl_host_build(r->lengths, lengths, 288);
+        tinfl_host_build(r->distances, lengths + 288, 30);
+        r->stage = TINFL_HOST_CODES;
+        return true;
+    }
+    if (type != 2)
+    {
+        return false;
+    }
+
+    int nlen = bits.get(5) + 257;
+    int ndist = bits.get(5) + 1;
+    int ncode = bits.get(4) + 4;
+    if (nlen > 286 || ndist > 30)
+    {
+        return false;
+    }
+    memset(lengths, 0, 19);
+    for (int i = 0; i < ncode; i++)
+    {
+        lengths[order[i]] = bits.get(3);
+    }
+    tinfl_host_huffman codeLengths;
+    if (!tinfl_host_build(codeLengths, lengths, 19))
+    {
+        return false;
+    }
+    for (int i = 0; i < nlen + ndist;)
+    {
+        int symbol = tinfl_host_decode(bits, codeLengths);
+        if (symbol < 0)
+        {
+            return false;
+        }
+        if (symbol < 16)
+        {
+            lengths[i++] = symbol;
+            continue;
+        }
+        int repeat, value = 0;
+        if (symbol == 16)
+        {
+            if (i == 0)
+            {
+                return false;
+            }
+            value = lengths[i - 1];
+            repeat = 3 + bits.get(2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + bits.get(3);
+        }
+        else
+        {
+            repeat = 11 + bits.get(7);
+        }
+        if (i + repeat > nlen + ndist)
+        {
+            return false;
+        }
+        memset(lengths + i, value, repeat);
+        i += repeat;
+    }
+    if (lengths[256] == 0)
+    {
+        return false;
+    }
+    r->stage = TINFL_HOST_CODES;
+    return tinfl_host_build(r->lengths, lengths, nlen) && tinfl_host_build(r->distances, lengths + nlen, ndist);
+}
+
+inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                                     uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                                     uint32_t decomp_flags)
+{
+    static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                          193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                          6145, 8193, 12289, 16385, 24577};
+    static const uint8_t distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                          6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    size_t inSize = *pIn_buf_size, outSize = *pOut_buf_size, out = 0;
+    size_t outPos = pOut_buf_next - pOut_buf_start;
+    size_t mask = outPos + outSize - 1; // the whole buffer is the window
+    tinfl_host_bits bits = {r->pending, r->pendingLen, pIn_buf_next, inSize, r->bitPos, false};
+    tinfl_status status;
+    for (;;)
+    {
+        if (r->stage == TINFL_HOST_DONE || r->stage == TINFL_HOST_FAILED)
+        {
+            status = r->stage == TINFL_HOST_DONE ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+            break;
+        }
+        for (; r->matchLen > 0 && out < outSize; r->matchLen--, out++)
+        {
+            pOut_buf_next[out] = pOut_buf_start[(outPos + out - r->matchDist) & mask];
+        }
+        if (r->matchLen > 0)
+        {
+            status = TINFL_STATUS_HAS_MORE_OUTPUT;
+            break;
+        }
+
+        uint64_t itemStart = bits.pos;
+        int itemStage = r->stage;
+        if (r->stage == TINFL_HOST_HEADER)
+        {
+            if (!tinfl_host_header(r, bits) && !bits.exhausted)
+            {
+                r->stage = TINFL_HOST_FAILED;
+            }
+        }
+        else if (r->stage == TINFL_HOST_STORED)
+        {
+            if (r->stored == 0)
+            {
+                r->stage = r->final ? TINFL_HOST_DONE : TINFL_HOST_HEADER;
+                continue;
+            }
+            if (out == outSize)
+            {
+                status = TINFL_STATUS_HAS_MORE_OUTPUT;
+                break;
+            }
+            uint8_t byte = bits.get(8);
+            if (!bits.exhausted)
+            {
+                pOut_buf_next[out++] = byte;
+                r->stored--;
+            }
+        }
+        else
+        {
+            if (out == outSize)
+            {
+                status = TINFL_STATUS_HAS_MORE_OUTPUT;
+                break;
+            }
+            int symbol = tinfl_host_decode(bits, r->lengths);
+            if (symbol >= 0 && symbol < 256)
+            {
+                pOut_buf_next[out++] = symbol;
+            }
+            else if (symbol == 256)
+            {
+                r->stage = r->final ? TINFL_HOST_DONE : TINFL_HOST_HEADER;
+            }
+            else if (symbol > 256 && symbol < 286)
+            {
+                uint32_t length = lengthBase[symbol - 257] + bits.get(lengthExtra[symbol - 257]);
+                int distSymbol = tinfl_host_decode(bits, r->distances);
+                uint32_t dist = distSymbol >= 0 && distSymbol < 30
+                                    ? distBase[distSymbol] + bits.get(distExtra[distSymbol]) : 0;
+                if (!bits.exhausted)
+                {
+                    if (dist == 0 || dist > r->totalOut + out || dist > mask + 1)
+                    {
+                        r->stage = TINFL_HOST_FAILED;
+                    }
+                    r->matchLen = length;
+                    r->matchDist = dist;
+                }
+            }
+            else if (!bits.exhausted)
+            {
+                r->stage = TINFL_HOST_FAILED;
+            }
+        }
+        if (bits.exhausted)
+        {
+            bits.pos = itemStart;
+            r->stage = itemStage;
+            status = TINFL_STATUS_NEEDS_MORE_INPUT;
+            break;
+        }
+    }
+
+    // Keep the unread bytes that were pending; of the new input, report up to
+    // the byte being read as consumed, or all of it with the rest pending
+    size_t index = bits.pos / 8, consumed = 0;
+    r->bitPos = bits.pos % 8;
+    if (index < r->pendingLen)
+    {
+        memmove(r->pending, r->pending + index, r->pendingLen - index);
+        r->pendingLen -= index;
+    }
+    else
+    {
+        consumed = index - r->pendingLen;
+        r->pendingLen = 0;
+    }
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT)
+    {
+        if (r->pendingLen + inSize - consumed > TINFL_HOST_PENDING || !(decomp_flags & TINFL_FLAG_HAS_MORE_INPUT))
+        {
+            r->stage = TINFL_HOST_FAILED;
+            status = TINFL_STATUS_FAILED;
+        }
+        else
+        {
+            memcpy(r->pending + r->pendingLen, pIn_buf_next + consumed, inSize - consumed);
+            r->pendingLen += inSize - consumed;
+            consumed = inSize;
+        }
+    }
+    r->totalOut += out;
+    *pIn_buf_size = consumed;
+    *pOut_buf_size = out;
+    return status;
+}
+
+#endif
@@ -0,0 +1,236 @@
+// Wire framing: CRC reference value, seal/parse round trip, resync after
+// corruption, frames split across BLE writes, and how each connection's
+// writes are routed between frames and JSON lines.
+#include "hosttest.h"
+#include "bleframe.h"
+#include <string.h>
+#include <vector>
+
+static std::string make_frame(uint8_t type, uint8_t seq, const std::string &payload)
+{
+    std::vector<uint8_t> frame(BLE_FRAME_HEADER_SIZE + payload.size() + BLE_FRAME_CRC_SIZE);
+    memcpy(frame.data() + BLE_FRAME_HEADER_SIZE, payload.data(), payload.size());
+    size_t total = seal_frame(frame.data(), type, seq, (uint16_t)payload.size());
+    return std::string((const char *)frame.data(), total);
+}
+
+static void test_crc_reference()
+{
+    CHECK_EQ(crc16_ccitt((const uint8_t *)"123456789", 9), 0x29B1);
+    CHECK_EQ(crc16_ccitt(nullptr, 0), 0xFFFF);
+}
+
+static void test_seal_layout()
+{
+    std::string frame = make_frame(FRAME_TYPE_MSG, 7, "abc");
+    CHECK_EQ(frame.size(), BLE_FRAME_HEADER_SIZE + 3 + BLE_FRAME_CRC_SIZE);
+    const uint8_t *data = (const uint8_t *)frame.data();
+    CHECK_EQ(data[0], BLE_FRAME_SYNC);
+    CHECK_EQ(data[1], FRAME_TYPE_MSG);
+    CHECK_EQ(data[2], 7);
+    CHECK_EQ(data[3] | (data[4] << 8), 3);
+    uint16_t crc = crc16_ccitt(data + 1, BLE_FRAME_HEADER_SIZE - 1 + 3);
+    CHECK_EQ(data[8], crc & 0xFF);
+    CHECK_EQ(data[9], crc >> 8);
+}
+
+static void test_round_trip()
+{
+    std::string buffer = make_frame(FRAME_TYPE_MSG, 1, "first") + make_frame(FRAME_TYPE_TEXT, 2, "");
+    BLEFrame frame;
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_COMPLETE);
+    CHECK_EQ(frame.type, FRAME_TYPE_MSG);
+    CHECK_EQ(frame.seq, 1);
+    CHECK(std::string((const char *)frame.payload, frame.length) == "first");
+    buffer.erase(0, frame.total);
+
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_COMPLETE);
+    CHECK_EQ(frame.type, FRAME_TYPE_TEXT);
+    CHECK_EQ(frame.length, 0);
+    buffer.erase(0, frame.total);
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_INCOMPLETE);
+    CHECK(buffer.empty());
+}
+
+// Feed the stream a few bytes at a time, as BLE writes would arrive
+static std::vector<std::string> receive(const std::string &stream, size_t writeSize, int *crcErrors)
+{
+    std::vector<std::string> payloads;
+    std::string buffer;
+    for (size_t offset = 0; offset < stream.size(); offset += writeSize)
+    {
+        ble_frame_receive(buffer, stream.substr(offset, writeSize), [&](const BLEFrame &frame) {
+            payloads.emplace_back((const char *)frame.payload, frame.length);
+        }, [&](uint8_t seq) { (*crcErrors)++; });
+    }
+    return payloads;
+}
+
+static void test_split_delivery()
+{
+    std::string stream;
+    for (int i = 0; i < 20; i++)
+    {
+        stream += make_frame(FRAME_TYPE_MSG, i, std::string(i * 13, 'a' + i));
+    }
+    for (size_t writeSize : {1, 2, 7, 20, 244, 4096})
+    {
+        int crcErrors = 0;
+        std::vector<std::string> payloads = receive(stream, writeSize, &crcErrors);
+        CHECK_EQ(crcErrors, 0);
+        CHECK_EQ(payloads.size(), 20);
+        for (size_t i = 0; i < payloads.size(); i++)
+        {
+            CHECK(payloads[i] == std::string(i * 13, 'a' + i));
+        }
+    }
+}
+
+static void test_corruption_and_resync()
+{
+    std::string good1 = make_frame(FRAME_TYPE_MSG, 1, "one");
+    std::string bad = make_frame(FRAME_TYPE_MSG, 2, "two");
+    bad[BLE_FRAME_HEADER_SIZE + 1] ^= 0x40; // flip a payload bit
+    std::string good2 = make_frame(FRAME_TYPE_MSG, 3, "three");
+    std::string stream = "garbage" + good1 + bad + "\x01\x02" + good2;
+
+    std::string buffer = stream;
+    BLEFrame frame;
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_COMPLETE);
+    CHECK_EQ(frame.seq, 1);
+    buffer.erase(0, frame.total);
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_BAD_CRC);
+    CHECK_EQ(frame.seq, 2); // what the NACK carries
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_COMPLETE);
+    CHECK_EQ(frame.seq, 3);
+
+    for (size_t writeSize : {1, 5, 64})
+    {
+        int crcErrors = 0;
+        std::vector<std::string> payloads = receive(stream, writeSize, &crcErrors);
+        CHECK_EQ(crcErrors, 1);
+        CHECK_EQ(payloads.size(), 2);
+        CHECK(payloads.size() == 2 && payloads[0] == "one" && payloads[1] == "three");
+    }
+}
+
+static void test_oversized_length_resyncs()
+{
+    std::string bogus("\xB5\x01\x00\xFF\xFF", 5); // length 65535 > max payload
+    std::string buffer = bogus + make_frame(FRAME_TYPE_MSG, 9, "ok");
+    BLEFrame frame;
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_BAD_LENGTH);
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_COMPLETE);
+    CHECK_EQ(frame.seq, 9);
+}
+
+static void test_truncated_frame_waits()
+{
+    std::string full = make_frame(FRAME_TYPE_MSG, 4, "payload");
+    std::string buffer = full.substr(0, 3);
+    BLEFrame frame;
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_INCOMPLETE);
+    CHECK_EQ(buffer.size(), 3); // header not complete, nothing dropped
+    buffer += full.substr(3, full.size() - 4);
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_INCOMPLETE);
+    buffer += full.substr(full.size() - 1);
+    CHECK_EQ(ble_frame_next(buffer, frame), FRAME_COMPLETE);
+}
+
+// One connection's receive side as BLEController::handleReceivedMessage
+// runs it outside text mode
+struct Connection
+{
+    std::string frameBuffer;
+    std::string jsonLine;
+    std::vector<std::string> lines;
+    std::vector<std::string> payloads;
+    std::vector<uint8_t> nacks;
+
+    void write(const std::string &message)
+    {
+        if (ble_frame_routed(frameBuffer, jsonLine, message))
+        {
+            ble_frame_receive(frameBuffer, message, [&](const BLEFrame &frame) {
+                payloads.emplace_back((const char *)frame.payload, frame.length);
+            }, [&](uint8_t seq) { nacks.push_back(seq); });
+            return;
+        }
+        jsonLine += message;
+        if (jsonLine.find('\n') != std::string::npos)
+        {
+            lines.push_back(jsonLine);
+            jsonLine.clear();
+        }
+    }
+};
+
+// {"msgtyp":"wire","format":"msgpack","n":2741}: the uint16 holds a newline
+// and a sync byte, neither of which may end or split the frame
+static const std::string wireMsgPack("\x83\xA6msgtyp\xA4wire\xA6" "format\xA7msgpack\xA1n\xCD\x0A\xB5", 33);
+
+static void test_msgpack_payload_round_trip()
+{
+    std::string stream = make_frame(FRAME_TYPE_MSG, 5, wireMsgPack) + make_frame(FRAME_TYPE_MSG, 6, wireMsgPack);
+    for (size_t writeSize : {1, 3, 20, 244})
+    {
+        Connection connection;
+        for (size_t offset = 0; offset < stream.size(); offset += writeSize)
+        {
+            connection.write(stream.substr(offset, writeSize));
+        }
+        CHECK_EQ(connection.payloads.size(), 2);
+        CHECK(connection.payloads.size() == 2 && connection.payloads[1] == wireMsgPack);
+        CHECK(connection.lines.empty());
+        CHECK(connection.frameBuffer.empty());
+    }
+}
+
+// Either format is accepted whatever the connection selected, and each
+// connection reassembles on its own
+static void test_connection_routing()
+{
+    Connection json, pack;
+    std::string frame = make_frame(FRAME_TYPE_MSG, 1, wireMsgPack);
+    std::string line = "{\"msgtyp\":\"lua\",\"code\":\"print('5\xC2\xB5s')\"}\n";
+    size_t split = line.find('\xB5'); // the next write starts with the sync byte
+
+    json.write(line.substr(0, split));
+    pack.write(frame.substr(0, 4));
+    json.write(line.substr(split));
+    pack.write(frame.substr(4));
+    CHECK_EQ(json.lines.size(), 1);
+    CHECK(json.lines.size() == 1 && json.lines[0] == line);
+    CHECK(json.payloads.empty());
+    CHECK_EQ(pack.payloads.size(), 1);
+
+    // A frame after the line, then a line after the frame, on one connection
+    json.write(frame);
+    json.write(line);
+    CHECK_EQ(json.payloads.size(), 1);
+    CHECK_EQ(json.lines.size(), 2);
+
+    // A corrupted frame is NACKed by seq and the connection carries on. Its
+    // payload has no sync byte: the scan would resync on one and wait for
+    // whatever length follows it.
+    std::string bad = make_frame(FRAME_TYPE_MSG, 9, "\x81\xA6msgtyp\xA4ping");
+    bad[BLE_FRAME_HEADER_SIZE + 3] ^= 0x01;
+    pack.write(bad + frame);
+    CHECK_EQ(pack.nacks.size(), 1);
+    CHECK(pack.nacks.size() == 1 && pack.nacks[0] == 9);
+    CHECK_EQ(pack.payloads.size(), 2);
+}
+
+int main()
+{
+    RUN_TEST(test_crc_reference);
+    RUN_TEST(test_seal_layout);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_split_delivery);
+    RUN_TEST(test_corruption_and_resync);
+    RUN_TEST(test_oversized_length_resyncs);
+    RUN_TEST(test_truncated_frame_waits);
+    RUN_TEST(test_msgpack_payload_round_trip);
+    RUN_TEST(test_connection_routing);
+    return HOST_TEST_RESULT();
+}
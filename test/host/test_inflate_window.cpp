@@ -0,0 +1,250 @@
+// Inflate window: raw deflate from host zlib (wbits -12, as the README asks
+// of senders) reaches the sink in order through the circular window, with
+// back-references across its wrap, and a transfer completes only when both
+// the sink is full and the stream has ended.
+#include "hosttest.h"
+#include "inflatewindow.h"
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// Raw deflate; with flush = Z_SYNC_FLUSH everything is decodable but the
+// final block is left for the caller to finish
+static std::string deflate_raw(const std::string &data, int level = 6, int strategy = Z_DEFAULT_STRATEGY,
+                               int flush = Z_FINISH, z_stream *keep = nullptr)
+{
+    z_stream local = {};
+    z_stream &zs = keep ? *keep : local;
+    deflateInit2(&zs, level, Z_DEFLATED, -12, 8, strategy);
+    std::string stream(deflateBound(&zs, data.size()) + 16, 0);
+    zs.next_in = (Bytef *)data.data();
+    zs.avail_in = data.size();
+    zs.next_out = (Bytef *)&stream[0];
+    zs.avail_out = stream.size();
+    deflate(&zs, flush);
+    stream.resize(stream.size() - zs.avail_out);
+    if (!keep)
+    {
+        deflateEnd(&zs);
+    }
+    return stream;
+}
+
+static std::string deflate_finish(z_stream &zs)
+{
+    std::string tail(64, 0);
+    zs.next_in = nullptr;
+    zs.avail_in = 0;
+    zs.next_out = (Bytef *)&tail[0];
+    zs.avail_out = tail.size();
+    deflate(&zs, Z_FINISH);
+    tail.resize(tail.size() - zs.avail_out);
+    deflateEnd(&zs);
+    return tail;
+}
+
+// Lines of script-like text that come back a few KB later, so matches
+// reach across the window's wrap
+static std::string script_text(size_t length)
+{
+    std::string data;
+    uint32_t seed = 12345;
+    std::vector<std::string> lines;
+    while (data.size() < length)
+    {
+        seed = seed * 1103515245 + 12345;
+        if (lines.size() < 80 || seed % 3 == 0)
+        {
+            char line[64];
+            snprintf(line, sizeof(line), "local v%u = sensor.read(%u) * %u\n", seed % 997, seed % 13, seed % 101);
+            lines.push_back(line);
+            data += line;
+        }
+        else
+        {
+            data += lines[lines.size() - 60 - seed % 20]; // 60..80 lines, about 2-3 KB back
+        }
+    }
+    data.resize(length);
+    return data;
+}
+
+static std::string pattern(size_t length)
+{
+    std::string data(length, 0);
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = (char)('a' + (i * 7) % 26);
+    }
+    return data;
+}
+
+// The target file: full once it has `expected` bytes, refuses anything more
+struct Target
+{
+    size_t expected;
+    std::string received;
+    bool spanOutsideWindow = false;
+    const uint8_t *window = nullptr;
+
+    explicit Target(size_t expected) : expected(expected) {}
+
+    InflateSinkStatus operator()(const uint8_t *data, size_t length)
+    {
+        if (window && (data < window || data + length > window + OTA_INFLATE_WINDOW_SIZE))
+        {
+            spanOutsideWindow = true;
+        }
+        if (received.size() + length > expected)
+        {
+            return INFLATE_SINK_ERROR;
+        }
+        received.append((const char *)data, length);
+        return received.size() == expected ? INFLATE_SINK_FULL : INFLATE_SINK_OK;
+    }
+};
+
+static InflateResult feed(InflateWindow &state, Target &target, const std::string &stream, size_t chunkSize)
+{
+    InflateResult result = INFLATE_MORE;
+    for (size_t i = 0; i < stream.size() && result == INFLATE_MORE; i += chunkSize)
+    {
+        std::string chunk = stream.substr(i, chunkSize);
+        result = inflate_feed(state, (const uint8_t *)chunk.data(), chunk.size(), target);
+    }
+    return result;
+}
+
+static void test_completion_waits_for_end_of_stream()
+{
+    std::string data = pattern(200);
+    InflateWindow state = {};
+    CHECK(inflate_begin(state));
+    Target target{data.size()};
+
+    // Every decoded byte arrives with the first chunk, the final block with
+    // the second
+    z_stream zs = {};
+    std::string body = deflate_raw(data, 6, Z_DEFAULT_STRATEGY, Z_SYNC_FLUSH, &zs);
+    std::string tail = deflate_finish(zs);
+    CHECK_EQ(inflate_feed(state, (const uint8_t *)body.data(), body.size(), target), INFLATE_MORE);
+    CHECK(target.received == data);
+    CHECK(state.sinkFull);
+    CHECK_EQ(inflate_feed(state, (const uint8_t *)tail.data(), tail.size(), target), INFLATE_DONE);
+    inflate_end(state);
+}
+
+static void test_end_in_same_chunk()
+{
+    std::string data = pattern(100);
+    std::string stream = deflate_raw(data);
+    InflateWindow state = {};
+    CHECK(inflate_begin(state));
+    Target target{data.size()};
+    CHECK_EQ(inflate_feed(state, (const uint8_t *)stream.data(), stream.size(), target), INFLATE_DONE);
+    CHECK(target.received == data);
+    inflate_end(state);
+}
+
+static void check_round_trip(const std::string &data, const std::string &stream)
+{
+    for (size_t chunkSize : {1, 7, 244, 509, 5000})
+    {
+        InflateWindow state = {};
+        CHECK(inflate_begin(state));
+        Target target{data.size()};
+        target.window = state.window;
+        CHECK_EQ(feed(state, target, stream, chunkSize), INFLATE_DONE);
+        CHECK(target.received == data);
+        CHECK(!target.spanOutsideWindow);
+        inflate_end(state);
+    }
+}
+
+// Dynamic, fixed and stored blocks, chunked like BLE writes of any size
+static void test_window_wrap_any_chunking()
+{
+    std::string data = script_text(5 * OTA_INFLATE_WINDOW_SIZE + 123);
+    for (int level : {1, 6, 9})
+    {
+        std::string stream = deflate_raw(data, level);
+        CHECK(stream.size() < data.size() / 3); // most of it is back-references
+        check_round_trip(data, stream);
+    }
+    check_round_trip(data, deflate_raw(data, 6, Z_FIXED));
+    check_round_trip(data, deflate_raw(data, 0));
+}
+
+// Matches whose source was written one window earlier, just before the wrap
+static void test_back_reference_across_wrap()
+{
+    std::string block = script_text(1000);
+    std::string data = pattern(OTA_INFLATE_WINDOW_SIZE - 600) + block + pattern(2900) + block + block;
+    std::string stream = deflate_raw(data, 9);
+    CHECK(stream.size() < data.size() / 2);
+    check_round_trip(data, stream);
+}
+
+static void test_stream_ends_short()
+{
+    InflateWindow state = {};
+    CHECK(inflate_begin(state));
+    Target target{500};
+    CHECK_EQ(feed(state, target, deflate_raw(pattern(300)), 64), INFLATE_SHORT);
+    inflate_end(state);
+}
+
+static void test_corrupt_stream()
+{
+    InflateWindow state = {};
+    CHECK(inflate_begin(state));
+    Target target{100};
+    // Stored block whose length check does not match
+    std::string stream = deflate_raw(pattern(50), 0);
+    stream[3] ^= 0x01;
+    CHECK_EQ(feed(state, target, stream, 16), INFLATE_CORRUPT);
+    inflate_end(state);
+
+    CHECK(inflate_begin(state));
+    Target reserved{100};
+    CHECK_EQ(feed(state, reserved, std::string("\x07", 1), 16), INFLATE_CORRUPT); // block type 3
+    inflate_end(state);
+}
+
+static void test_sink_error_stops()
+{
+    InflateWindow state = {};
+    CHECK(inflate_begin(state));
+    Target target{100}; // stream decodes to more than the target takes
+    CHECK_EQ(feed(state, target, deflate_raw(pattern(300)), 64), INFLATE_SINK_FAILED);
+    inflate_end(state);
+}
+
+static void test_begin_resets_state()
+{
+    InflateWindow state = {};
+    CHECK(inflate_begin(state));
+    Target first{10};
+    CHECK_EQ(feed(state, first, deflate_raw(pattern(10)), 3), INFLATE_DONE);
+    CHECK(inflate_begin(state));
+    CHECK(!state.sinkFull);
+    CHECK_EQ(state.windowPos, 0);
+    Target second{20};
+    CHECK_EQ(feed(state, second, deflate_raw(pattern(20)), 3), INFLATE_DONE);
+    CHECK(second.received == pattern(20));
+    inflate_end(state);
+    CHECK(state.decompressor == nullptr && state.window == nullptr);
+}
+
+int main()
+{
+    RUN_TEST(test_completion_waits_for_end_of_stream);
+    RUN_TEST(test_end_in_same_chunk);
+    RUN_TEST(test_window_wrap_any_chunking);
+    RUN_TEST(test_back_reference_across_wrap);
+    RUN_TEST(test_stream_ends_short);
+    RUN_TEST(test_corrupt_stream);
+    RUN_TEST(test_sink_error_stops);
+    RUN_TEST(test_begin_resets_state);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,301 @@
+// Lidar filter chain run over short synthetic traces: each stage on its own,
+// then the whole chain as the acquisition task runs it.
+#include "hosttest.h"
+#include "lidarfilter.h"
+#include <vector>
+
+struct TracePoint
+{
+    int64_t timeUs;
+    float distance;
+    uint8_t status;
+};
+
+// Same entry as Lidar::filterSample
+static std::vector<FilterValue> run(LidarFilterChain &chain, const std::vector<TracePoint> &trace)
+{
+    std::vector<FilterValue> out;
+    for (const TracePoint &point : trace)
+    {
+        FilterValue value = {point.distance, true, false, point.status, point.timeUs};
+        chain.process(value);
+        out.push_back(value);
+    }
+    return out;
+}
+
+// Evenly spaced valid samples, 20 ms apart
+static std::vector<TracePoint> trace_of(const std::vector<float> &distances, int64_t periodUs = 20000)
+{
+    std::vector<TracePoint> trace;
+    for (size_t i = 0; i < distances.size(); i++)
+    {
+        trace.push_back({(int64_t)i * periodUs, distances[i], 0});
+    }
+    return trace;
+}
+
+// Deterministic +-noise, so every run sees the same synthetic trace
+static float noise(int i, float amplitude)
+{
+    static const float pattern[8] = {0.3f, -0.8f, 0.5f, 1.0f, -0.4f, -1.0f, 0.7f, -0.3f};
+    return pattern[i % 8] * amplitude;
+}
+
+static void test_defaults_pass_through()
+{
+    LidarFilterChain chain;
+    chain.configure(lidarFilterDefaults);
+    std::vector<TracePoint> trace = {{0, 812, 0}, {20000, 8190, 4}, {40000, 13, 2}, {60000, 640, 0}};
+    std::vector<FilterValue> out = run(chain, trace);
+    for (size_t i = 0; i < trace.size(); i++)
+    {
+        CHECK(out[i].valid && !out[i].held);
+        CHECK_NEAR(out[i].value, trace[i].distance, 0);
+    }
+}
+
+static void test_median_removes_spike()
+{
+    LidarFilterConfig config = lidarFilterDefaults;
+    config.median = 5;
+    LidarFilterChain chain;
+    chain.configure(config);
+    std::vector<FilterValue> out = run(chain, trace_of({100, 102, 500, 101, 103, 99, 98, 97}));
+    const float expected[] = {100, 102, 102, 102, 102, 102, 101, 99};
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        CHECK_NEAR(out[i].value, expected[i], 0);
+    }
+}
+
+static void test_median_window_size()
+{
+    SlidingMedian<LIDAR_MEDIAN_MAX> median;
+    LidarFilterConfig config = lidarFilterDefaults;
+    const uint8_t requested[] = {0, 2, 3, 4, 5, 14, 40};
+    const uint8_t window[] = {0, 0, 3, 3, 5, 13, 15}; // odd, rounded down, capped
+    for (size_t i = 0; i < sizeof(requested); i++)
+    {
+        config.median = requested[i];
+        median.configure(config);
+        CHECK_EQ(median.window, window[i]);
+    }
+}
+
+static void test_reject_range_and_status()
+{
+    LidarFilterConfig config = lidarFilterDefaults;
+    config.reject = true;
+    config.minMm = 30;
+    config.maxMm = 2000;
+    LidarFilterChain chain;
+    chain.configure(config);
+    std::vector<TracePoint> trace = {{0, 500, 0}, {20000, 10, 0}, {40000, 2500, 0}, {60000, 600, 4}, {80000, 610, 0}};
+    std::vector<FilterValue> out = run(chain, trace);
+    CHECK(out[0].valid);
+    CHECK(!out[1].valid); // below min
+    CHECK(!out[2].valid); // above max
+    CHECK(!out[3].valid); // bad range status
+    CHECK(out[4].valid);
+}
+
+static void test_reject_jump_confirm()
+{
+    LidarFilterConfig config = lidarFilterDefaults;
+    config.reject = true;
+    config.maxJumpMm = 200;
+    config.jumpConfirm = 3;
+    LidarFilterChain chain;
+    chain.configure(config);
+    // A lone spike is dropped; a jump that persists is accepted on its third sample
+    std::vector<FilterValue> out = run(chain, trace_of({500, 1500, 505, 1500, 1510, 1505, 1500, 500}));
+    const bool valid[] = {true, false, true, false, false, true, true, false};
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        CHECK_EQ(out[i].valid, valid[i]);
+    }
+}
+
+// With no process noise the constant model is the running mean
+static void test_kalman_constant_is_running_mean()
+{
+    LidarFilterConfig config = lidarFilterDefaults;
+    config.kalman = true;
+    config.model = KALMAN_CONSTANT;
+    config.processNoise = 0;
+    config.measurementNoise = 25;
+    LidarFilterChain chain;
+    chain.configure(config);
+
+    std::vector<float> distances;
+    for (int i = 0; i < 40; i++)
+    {
+        distances.push_back(1000 + noise(i, 10));
+    }
+    std::vector<FilterValue> out = run(chain, trace_of(distances));
+    double sum = 0;
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        sum += distances[i];
+        CHECK_NEAR(out[i].value, sum / (i + 1), 0.01);
+    }
+}
+
+static void test_kalman_constant_smooths_and_follows_step()
+{
+    LidarFilterConfig config = lidarFilterDefaults;
+    config.kalman = true;
+    config.model = KALMAN_CONSTANT;
+    config.processNoise = 1000;
+    config.measurementNoise = 25;
+    LidarFilterChain chain;
+    chain.configure(config);
+
+    std::vector<float> distances;
+    for (int i = 0; i < 100; i++)
+    {
+        distances.push_back((i < 50 ? 1000 : 1200) + noise(i, 8));
+    }
+    std::vector<FilterValue> out = run(chain, trace_of(distances));
+    CHECK_NEAR(out[0].value, distances[0], 0); // first sample initialises
+
+    // Settled: less spread than the input around the true value
+    double inError = 0, outError = 0;
+    for (int i = 20; i < 50; i++)
+    {
+        inError += fabs(distances[i] - 1000);
+        outError += fabs(out[i].value - 1000);
+    }
+    CHECK(outError < inError * 0.6);
+
+    // The step is followed: part way after one sample, settled after 30
+    CHECK(out[50].value > 1000 + 20 && out[50].value < 1200);
+    CHECK_NEAR(out[80].value, 1200, 8);
+}
+
+static void test_kalman_velocity_tracks_ramp()
+{
+    LidarFilterConfig config = lidarFilterDefaults;
+    config.kalman = true;
+    config.processNoise = 100;
+    config.measurementNoise = 25;
+
+    // Target approaching at 1 m/s, sampled every 20 ms
+    std::vector<float> distances;
+    for (int i = 0; i < 60; i++)
+    {
+        distances.push_back(2000 - 20 * i + noise(i, 3));
+    }
+    config.model = KALMAN_VELOCITY;
+    LidarFilterChain velocity;
+    velocity.configure(config);
+    std::vector<FilterValue> tracked = run(velocity, trace_of(distances));
+    config.model = KALMAN_CONSTANT;
+    LidarFilterChain constant;
+    constant.configure(config);
+    std::vector<FilterValue> lagged = run(constant, trace_of(distances));
+
+    float truth = 2000 - 20 * 59;
+    CHECK_NEAR(tracked.back().value, truth, 5);
+    CHECK(fabsf(lagged.back().value - truth) > 2 * fabsf(tracked.back().value - truth));
+    CHECK(lagged.back().value > truth); // the random walk trails behind the approach
+}
+
+static void test_kalman_restarts_after_gap()
+{
+    LidarFilterConfig config = lidarFilterDefaults;
+    config.kalman = true;
+    LidarFilterChain chain;
+    chain.configure(config);
+    std::vector<TracePoint> trace = {{0, 1000, 0}, {20000, 1010, 0}, {40000, 990, 0},
+                                     {40000 + LIDAR_KALMAN_MAX_GAP_US + 1, 3000, 0}};
+    std::vector<FilterValue> out = run(chain, trace);
+    CHECK_NEAR(out[3].value, 3000, 0);
+}
+
+static void test_hold_last_valid()
+{
+    LidarFilterConfig config = lidarFilterDefaults;
+    config.reject = true;
+    config.holdMs = 50;
+    LidarFilterChain chain;
+    chain.configure(config);
+    // Dropout from 20 ms: held up to 50 ms after the last valid sample
+    std::vector<TracePoint> trace = {{0, 800, 0}, {20000, 8190, 4}, {40000, 8190, 4}, {50000, 8190, 4},
+                                     {60000, 8190, 4}, {80000, 820, 0}, {100000, 8190, 2}};
+    std::vector<FilterValue> out = run(chain, trace);
+    CHECK(out[0].valid && !out[0].held);
+    for (int i = 1; i <= 3; i++)
+    {
+        CHECK(out[i].valid && out[i].held);
+        CHECK_NEAR(out[i].value, 800, 0);
+    }
+    CHECK(!out[4].valid && !out[4].held);
+    CHECK(out[5].valid && !out[5].held);
+    CHECK(out[6].held);
+    CHECK_NEAR(out[6].value, 820, 0);
+}
+
+// Reject, median, Kalman and hold together, as configured from Lua
+static void test_full_chain_trace()
+{
+    LidarFilterConfig config = {true, 30, 2000, 300, 3, 3, true, KALMAN_CONSTANT, 2000.0f, 25.0f, 100};
+    LidarFilterChain chain;
+    chain.configure(config);
+    std::vector<TracePoint> trace;
+    for (int i = 0; i < 50; i++)
+    {
+        float distance = 1000 + noise(i, 6);
+        uint8_t status = 0;
+        if (i == 10 || i == 30)
+        {
+            distance = 1900; // lone spikes, inside [min, max]
+        }
+        if (i >= 20 && i < 24)
+        {
+            distance = 8190; // dropout
+            status = 4;
+        }
+        trace.push_back({(int64_t)i * 20000, distance, status});
+    }
+    std::vector<FilterValue> out = run(chain, trace);
+    for (int i = 0; i < 50; i++)
+    {
+        // Rejected spikes and the dropout are covered by the held value
+        bool held = i == 10 || i == 30 || (i >= 20 && i < 24);
+        CHECK(out[i].valid);
+        CHECK_NEAR(out[i].value, 1000, 10);
+        CHECK_EQ(out[i].held, held);
+    }
+}
+
+static void test_configure_resets_state()
+{
+    LidarFilterConfig config = lidarFilterDefaults;
+    config.median = 3;
+    config.kalman = true;
+    LidarFilterChain chain;
+    chain.configure(config);
+    run(chain, trace_of({100, 100, 100}));
+    chain.configure(config);
+    std::vector<FilterValue> out = run(chain, trace_of({700}));
+    CHECK_NEAR(out[0].value, 700, 0); // nothing left over from before
+}
+
+int main()
+{
+    RUN_TEST(test_defaults_pass_through);
+    RUN_TEST(test_median_removes_spike);
+    RUN_TEST(test_median_window_size);
+    RUN_TEST(test_reject_range_and_status);
+    RUN_TEST(test_reject_jump_confirm);
+    RUN_TEST(test_kalman_constant_is_running_mean);
+    RUN_TEST(test_kalman_constant_smooths_and_follows_step);
+    RUN_TEST(test_kalman_velocity_tracks_ramp);
+    RUN_TEST(test_kalman_restarts_after_gap);
+    RUN_TEST(test_hold_last_valid);
+    RUN_TEST(test_full_chain_trace);
+    RUN_TEST(test_configure_resets_state);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,251 @@
+// Speed gate crossing detector run over synthetic top and bottom sensor
+// traces: break/restore edges, interpolated crossing times, and the samples
+// that only prime or cannot be interpolated from.
+#include "hosttest.h"
+#include "lidargate.h"
+#include "lidarfilter.h"
+#include <math.h>
+#include <vector>
+
+struct GateSample
+{
+    int64_t timeUs;
+    uint16_t distance;
+    bool inRange;
+};
+
+// One detector per sensor, fed as Lidar::detectCrossing does
+static std::vector<LidarCrossing> replay(CrossingDetector &gate, const std::vector<GateSample> &trace)
+{
+    std::vector<LidarCrossing> crossings;
+    for (const GateSample &sample : trace)
+    {
+        LidarCrossing crossing;
+        if (gate.process(sample.timeUs, sample.distance, sample.inRange, crossing))
+        {
+            crossings.push_back(crossing);
+        }
+    }
+    return crossings;
+}
+
+// Distances sampled periodUs apart from startUs; 0 means nothing in range
+static std::vector<GateSample> trace_at(int64_t startUs, int64_t periodUs, const std::vector<uint16_t> &distances)
+{
+    std::vector<GateSample> trace;
+    for (size_t i = 0; i < distances.size(); i++)
+    {
+        trace.push_back({startUs + (int64_t)i * periodUs, distances[i], distances[i] != 0});
+    }
+    return trace;
+}
+
+// Whole samples as Lidar::acquire handles them: filter chain, then the gate
+// input and the detector
+static std::vector<LidarCrossing> replay_samples(const std::vector<LidarSample> &samples,
+                                                 const LidarFilterConfig &filterConfig, bool useFiltered)
+{
+    LidarFilterChain chain;
+    chain.configure(filterConfig);
+    CrossingDetector gate;
+    LidarGateConfig config = lidarGateDefaults;
+    config.enabled = true;
+    config.useFiltered = useFiltered;
+    gate.configure(config);
+
+    std::vector<LidarCrossing> crossings;
+    for (LidarSample sample : samples)
+    {
+        FilterValue value = {(float)sample.distance, true, false, sample.status, sample.timeUs};
+        chain.process(value);
+        sample.filterFlags = (value.valid ? LIDAR_FILTER_VALID : 0) | (value.held ? LIDAR_FILTER_HELD : 0);
+        sample.filtered = value.valid ? (uint16_t)lroundf(value.value) : 0;
+
+        uint16_t distance;
+        LidarGateInput input = lidar_gate_input(sample, useFiltered, filterConfig.reject, distance);
+        LidarCrossing crossing;
+        if (input != LIDAR_GATE_SKIP && gate.process(sample.timeUs, distance, input == LIDAR_GATE_DISTANCE, crossing))
+        {
+            crossings.push_back(crossing);
+        }
+    }
+    return crossings;
+}
+
+static LidarGateConfig gate_config(uint16_t thresholdMm, uint16_t hysteresisMm)
+{
+    LidarGateConfig config = lidarGateDefaults;
+    config.enabled = true;
+    config.thresholdMm = thresholdMm;
+    config.hysteresisMm = hysteresisMm;
+    return config;
+}
+
+// A runner passing both sensors: top at 50 Hz, bottom at 30 Hz, 5 ms out of phase
+static void test_top_and_bottom_pass()
+{
+    CrossingDetector top, bottom;
+    top.configure(gate_config(1000, 50));
+    bottom.configure(gate_config(1000, 50));
+
+    // 0 .. 140 ms
+    std::vector<LidarCrossing> topCrossings = replay(top, trace_at(0, 20000, {2000, 2000, 1800, 600, 600, 600, 1400, 2000}));
+    CHECK_EQ(topCrossings.size(), 2);
+    CHECK_EQ(topCrossings[0].edge, LIDAR_EDGE_BREAK);
+    CHECK_EQ(topCrossings[0].sampleUs, 60000);
+    CHECK_EQ(topCrossings[0].distance, 600);
+    CHECK(topCrossings[0].interpolated);
+    CHECK_NEAR(topCrossings[0].timeUs, 53333, 1); // 1800 -> 600 crosses 1000 at 2/3
+    CHECK_EQ(topCrossings[1].edge, LIDAR_EDGE_RESTORE);
+    CHECK_EQ(topCrossings[1].sampleUs, 120000);
+    CHECK(topCrossings[1].interpolated);
+    CHECK_NEAR(topCrossings[1].timeUs, 111250, 1); // 600 -> 1400 crosses 1050 at 0.5625
+    CHECK(!top.isBlocked());
+
+    // 5 .. 170 ms; the runner leaves the bottom sensor with nothing in range
+    std::vector<LidarCrossing> bottomCrossings = replay(bottom, trace_at(5000, 33000, {0, 1500, 500, 500, 0, 1500}));
+    CHECK_EQ(bottomCrossings.size(), 2);
+    CHECK_EQ(bottomCrossings[0].edge, LIDAR_EDGE_BREAK);
+    CHECK(bottomCrossings[0].interpolated);
+    CHECK_NEAR(bottomCrossings[0].timeUs, 54500, 1); // halfway from 1500 to 500
+    CHECK_EQ(bottomCrossings[1].edge, LIDAR_EDGE_RESTORE);
+    CHECK(!bottomCrossings[1].interpolated);
+    CHECK_EQ(bottomCrossings[1].distance, 0);
+    CHECK_EQ(bottomCrossings[1].timeUs, 137000);
+    CHECK_EQ(bottomCrossings[1].sampleUs, 137000);
+}
+
+// Blocked from the first sample: nothing is reported until it clears
+static void test_first_sample_primes()
+{
+    CrossingDetector gate;
+    gate.configure(gate_config(1000, 50));
+    LidarCrossing crossing;
+    CHECK(!gate.process(0, 500, true, crossing));
+    CHECK(gate.isBlocked());
+    CHECK(!gate.process(20000, 520, true, crossing));
+
+    CHECK(gate.process(40000, 1200, true, crossing));
+    CHECK_EQ(crossing.edge, LIDAR_EDGE_RESTORE);
+    CHECK(crossing.interpolated);
+    CHECK_NEAR(crossing.timeUs, 20000 + 20000 * 530 / 680, 1);
+
+    // Clear first sample: the next close one is a break
+    gate.reset();
+    CHECK(!gate.isBlocked());
+    CHECK(!gate.process(100000, 1500, true, crossing));
+    CHECK(gate.process(120000, 900, true, crossing));
+    CHECK_EQ(crossing.edge, LIDAR_EDGE_BREAK);
+}
+
+// After a sample with nothing in range there is no distance to interpolate from
+static void test_no_interpolation_after_out_of_range()
+{
+    CrossingDetector gate;
+    gate.configure(gate_config(1000, 50));
+    std::vector<LidarCrossing> crossings = replay(gate, trace_at(0, 20000, {0, 0, 700, 700, 0, 400}));
+    CHECK_EQ(crossings.size(), 3);
+    CHECK(crossings[0].edge == LIDAR_EDGE_BREAK && !crossings[0].interpolated);
+    CHECK_EQ(crossings[0].timeUs, 40000);
+    CHECK(crossings[1].edge == LIDAR_EDGE_RESTORE && !crossings[1].interpolated);
+    CHECK_EQ(crossings[1].timeUs, 80000);
+    CHECK(crossings[2].edge == LIDAR_EDGE_BREAK && !crossings[2].interpolated);
+    CHECK_EQ(crossings[2].timeUs, 100000);
+}
+
+// Between threshold and threshold + hysteresis the state holds either way
+static void test_hysteresis()
+{
+    CrossingDetector gate;
+    gate.configure(gate_config(1000, 50));
+    std::vector<LidarCrossing> crossings =
+        replay(gate, trace_at(0, 10000, {1200, 1000, 1040, 999, 1020, 1040, 1060, 990, 1049, 1050}));
+    CHECK_EQ(crossings.size(), 4);
+    CHECK_EQ(crossings[0].edge, LIDAR_EDGE_BREAK); // 1000 is not below the threshold, 999 is
+    CHECK_EQ(crossings[0].sampleUs, 30000);
+    CHECK_EQ(crossings[1].edge, LIDAR_EDGE_RESTORE);
+    CHECK_EQ(crossings[1].sampleUs, 60000);
+    CHECK_NEAR(crossings[1].timeUs, 55000, 1); // 1040 -> 1060 crosses 1050 halfway
+    CHECK_EQ(crossings[2].edge, LIDAR_EDGE_BREAK);
+    CHECK_EQ(crossings[2].sampleUs, 70000);
+    CHECK_EQ(crossings[3].edge, LIDAR_EDGE_RESTORE); // exactly at the restore level
+    CHECK_EQ(crossings[3].sampleUs, 90000);
+    CHECK(crossings[3].interpolated);
+    CHECK_EQ(crossings[3].timeUs, 90000);
+}
+
+static void test_disabled()
+{
+    CrossingDetector gate;
+    gate.configure(lidarGateDefaults);
+    CHECK(replay(gate, trace_at(0, 20000, {2000, 500, 2000, 0, 500})).empty());
+    CHECK(!gate.isBlocked());
+}
+
+// A new config re-primes: a sensor already blocked does not report a break
+static void test_configure_reprimes()
+{
+    CrossingDetector gate;
+    gate.configure(gate_config(1000, 50));
+    replay(gate, trace_at(0, 20000, {2000, 2000}));
+    gate.configure(gate_config(1500, 50));
+    std::vector<LidarCrossing> crossings = replay(gate, trace_at(40000, 20000, {1200, 1300, 1600}));
+    CHECK_EQ(crossings.size(), 1);
+    CHECK_EQ(crossings[0].edge, LIDAR_EDGE_RESTORE);
+    CHECK_NEAR(crossings[0].timeUs, 60000 + 20000 * 250 / 300, 1);
+}
+
+// Failed statuses report junk distances (13 mm on a signal fail here); they
+// must not break the beam whichever value the gate uses
+static void test_failed_status_samples()
+{
+    std::vector<LidarSample> samples;
+    const uint16_t distance[] = {1500, 13, 1480, 20, 1490, 400, 420, 8190, 1500};
+    const uint8_t status[] = {LIDAR_STATUS_VALID, LIDAR_STATUS_SIGNAL_FAIL, LIDAR_STATUS_VALID,
+                              LIDAR_STATUS_HARDWARE_FAIL, LIDAR_STATUS_VALID, LIDAR_STATUS_VALID,
+                              LIDAR_STATUS_MIN_RANGE, LIDAR_STATUS_PHASE_FAIL, LIDAR_STATUS_VALID};
+    for (int i = 0; i < 9; i++)
+    {
+        LidarSample sample = {};
+        sample.timeUs = i * 20000;
+        sample.distance = distance[i];
+        sample.status = status[i];
+        samples.push_back(sample);
+    }
+
+    // Filter chain off, as by default: every output is marked valid
+    for (bool useFiltered : {true, false})
+    {
+        std::vector<LidarCrossing> crossings = replay_samples(samples, lidarFilterDefaults, useFiltered);
+        CHECK_EQ(crossings.size(), 2);
+        CHECK_EQ(crossings[0].edge, LIDAR_EDGE_BREAK);
+        CHECK_EQ(crossings[0].sampleUs, 100000);
+        CHECK(crossings[0].interpolated); // from 1490, the skipped failures in between do not count
+        CHECK_EQ(crossings[1].edge, LIDAR_EDGE_RESTORE);
+        CHECK_EQ(crossings[1].sampleUs, 140000); // out of range clears
+        CHECK_EQ(crossings[1].distance, 0);
+    }
+
+    // Reject stage on: failures are held over with the last good value, the
+    // out-of-range sample too, so the beam clears on the next real distance
+    LidarFilterConfig filter = lidarFilterDefaults;
+    filter.reject = true;
+    filter.holdMs = 50;
+    std::vector<LidarCrossing> crossings = replay_samples(samples, filter, true);
+    CHECK_EQ(crossings.size(), 2);
+    CHECK_EQ(crossings[0].sampleUs, 100000);
+    CHECK_EQ(crossings[1].sampleUs, 160000);
+    CHECK_EQ(crossings[1].distance, 1500);
+}
+
+int main()
+{
+    RUN_TEST(test_top_and_bottom_pass);
+    RUN_TEST(test_first_sample_primes);
+    RUN_TEST(test_no_interpolation_after_out_of_range);
+    RUN_TEST(test_hysteresis);
+    RUN_TEST(test_disabled);
+    RUN_TEST(test_configure_reprimes);
+    RUN_TEST(test_failed_status_samples);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,70 @@
+// Ranging schedule: the effective period is max(period, timing budget) and
+// the built-in profiles stay within what the VL53L0X accepts.
+#include "hosttest.h"
+#include "lidarprofile.h"
+
+static void test_period_longer_than_budget()
+{
+    const LidarProfileConfig &config = lidarProfiles[LIDAR_PROFILE_DEFAULT]; // 33 ms budget
+    CHECK_EQ(lidar_effective_period_us(config, 50), 50000);
+    CHECK_NEAR(lidar_effective_rate_hz(config, 50), 20.0, 1e-3);
+}
+
+static void test_period_shorter_than_budget_runs_back_to_back()
+{
+    const LidarProfileConfig &config = lidarProfiles[LIDAR_PROFILE_HIGH_ACCURACY]; // 200 ms budget
+    CHECK_EQ(lidar_effective_period_us(config, 20), 200000);
+    CHECK_EQ(lidar_effective_period_us(config, 0), 200000);
+    CHECK_NEAR(lidar_effective_rate_hz(config, 20), 5.0, 1e-3);
+}
+
+static void test_profile_defaults_plan_on_budget()
+{
+    const double expectHz[LIDAR_PROFILE_COUNT] = {1000.0 / 33, 50.0, 1000.0 / 33, 5.0};
+    for (int i = 0; i < LIDAR_PROFILE_COUNT; i++)
+    {
+        const LidarProfileConfig &config = lidarProfiles[i];
+        CHECK((uint32_t)config.periodMs * 1000 >= config.timingBudgetUs);
+        CHECK_EQ(lidar_effective_period_us(config, config.periodMs), (uint32_t)config.periodMs * 1000);
+        CHECK_NEAR(lidar_effective_rate_hz(config, config.periodMs), expectHz[i], 0.01);
+    }
+}
+
+// Same limits the driver enforces
+static void test_profiles_within_sensor_limits()
+{
+    for (int i = 0; i < LIDAR_PROFILE_COUNT; i++)
+    {
+        const LidarProfileConfig &config = lidarProfiles[i];
+        CHECK(config.timingBudgetUs >= 20000);
+        CHECK(config.preRangeVcsel % 2 == 0 && config.preRangeVcsel >= 12 && config.preRangeVcsel <= 18);
+        CHECK(config.finalRangeVcsel % 2 == 0 && config.finalRangeVcsel >= 8 && config.finalRangeVcsel <= 14);
+        CHECK(config.signalLimitMcps > 0 && config.sigmaLimitMm > 0);
+    }
+}
+
+static void test_profile_find()
+{
+    LidarProfile profile = LIDAR_PROFILE_DEFAULT;
+    CHECK(lidar_profile_find("long_range", profile));
+    CHECK_EQ(profile, LIDAR_PROFILE_LONG_RANGE);
+    for (int i = 0; i < LIDAR_PROFILE_COUNT; i++)
+    {
+        CHECK(lidar_profile_find(lidarProfiles[i].name, profile));
+        CHECK_EQ(profile, i);
+    }
+    profile = LIDAR_PROFILE_HIGH_SPEED;
+    CHECK(!lidar_profile_find("fast", profile));
+    CHECK(!lidar_profile_find("", profile));
+    CHECK_EQ(profile, LIDAR_PROFILE_HIGH_SPEED); // untouched on a miss
+}
+
+int main()
+{
+    RUN_TEST(test_period_longer_than_budget);
+    RUN_TEST(test_period_shorter_than_budget_runs_back_to_back);
+    RUN_TEST(test_profile_defaults_plan_on_budget);
+    RUN_TEST(test_profiles_within_sensor_limits);
+    RUN_TEST(test_profile_find);
+    return HOST_TEST_RESULT();
+}
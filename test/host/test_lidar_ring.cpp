@@ -0,0 +1,230 @@
+// Lidar sample ring and the two-sensor merge behind lidar.read_batch: samples
+// come from scripted sensors, are stamped and pushed as the acquisition task
+// does, and are drained oldest first.
+#include "hosttest.h"
+#include "fakerangesensor.h"
+#include "samplering.h"
+#include "lidarmerge.h"
+#include <thread>
+#include <vector>
+
+#define RING 16
+
+// Stand-in for Lidar: its peek/readBatch are the ring's peek/pop
+struct RingSource
+{
+    SampleRing<LidarSample, RING> ring;
+    bool peek(LidarSample &sample) { return ring.peek(sample); }
+    size_t readBatch(LidarSample *out, size_t max) { return ring.pop(out, max); }
+};
+
+// One acquisition per result the sensor has, periodUs apart from startUs
+static void acquire_all(FakeRangeSensor &sensor, RingSource &source, int64_t startUs, int64_t periodUs)
+{
+    for (int64_t t = startUs; sensor.dataReady(); t += periodUs)
+    {
+        LidarSample sample;
+        if (sensor.readSample(sample))
+        {
+            sample.timeUs = t;
+            source.ring.push(sample);
+        }
+    }
+}
+
+struct Merged
+{
+    int sensor;
+    LidarSample sample;
+};
+
+static std::vector<Merged> drain(RingSource *sources[2], bool top, bool bottom, size_t max)
+{
+    std::vector<Merged> out;
+    bool use[2] = {top, bottom};
+    size_t count = lidar_merge_drain(sources, use, max, [&](int i, const LidarSample &sample) {
+        out.push_back({i, sample});
+    });
+    CHECK_EQ(count, out.size());
+    return out;
+}
+
+static void test_overflow_drops_newest()
+{
+    FakeRangeSensor sensor;
+    sensor.startContinuous(20);
+    for (int i = 0; i < RING + 5; i++)
+    {
+        sensor.queue(100 + i);
+    }
+    RingSource source;
+    acquire_all(sensor, source, 0, 20000);
+
+    CHECK_EQ(source.ring.size(), RING);
+    CHECK_EQ(source.ring.dropped(), 5);
+    LidarSample out[RING];
+    CHECK_EQ(source.ring.pop(out, RING), RING);
+    for (int i = 0; i < RING; i++)
+    {
+        CHECK_EQ(out[i].distance, 100 + i); // the oldest survive
+    }
+
+    // Room again after the consumer caught up; the drop count stays
+    sensor.queue(500);
+    acquire_all(sensor, source, 1000000, 20000);
+    CHECK_EQ(source.ring.size(), 1);
+    CHECK_EQ(source.ring.dropped(), 5);
+}
+
+static void test_pop_partial_and_clear()
+{
+    RingSource source;
+    for (int i = 0; i < 10; i++)
+    {
+        LidarSample sample = {};
+        sample.timeUs = i;
+        source.ring.push(sample);
+    }
+    LidarSample out[4];
+    CHECK_EQ(source.ring.pop(out, 4), 4);
+    CHECK_EQ(out[3].timeUs, 3);
+    LidarSample head;
+    CHECK(source.ring.peek(head));
+    CHECK_EQ(head.timeUs, 4);
+    CHECK_EQ(source.ring.size(), 6);
+    source.ring.clear();
+    CHECK_EQ(source.ring.size(), 0);
+    CHECK(!source.ring.peek(head));
+    CHECK_EQ(source.ring.pop(out, 4), 0);
+}
+
+// One producer and one consumer thread: order is kept and every sample is
+// either delivered or counted as dropped
+static void test_concurrent_producer_consumer()
+{
+    const int total = 200000;
+    SampleRing<LidarSample, RING> ring;
+    std::thread producer([&] {
+        for (int i = 0; i < total; i++)
+        {
+            LidarSample sample = {};
+            sample.timeUs = i;
+            ring.push(sample);
+        }
+    });
+
+    int received = 0, outOfOrder = 0;
+    int64_t last = -1;
+    auto consume = [&] {
+        LidarSample out[RING];
+        size_t n = ring.pop(out, RING);
+        for (size_t i = 0; i < n; i++)
+        {
+            if (out[i].timeUs <= last)
+            {
+                outOfOrder++;
+            }
+            last = out[i].timeUs;
+        }
+        received += n;
+    };
+    while (received + (int)ring.dropped() < total)
+    {
+        consume();
+    }
+    producer.join();
+    consume();
+
+    CHECK_EQ(outOfOrder, 0);
+    CHECK_EQ(received + (int)ring.dropped(), total);
+    CHECK_EQ(ring.size(), 0);
+}
+
+static void test_merge_by_time()
+{
+    FakeRangeSensor top, bottom;
+    top.startContinuous(20);
+    bottom.startContinuous(33);
+    for (int i = 0; i < 6; i++)
+    {
+        top.queue(1000 + i);
+        bottom.queue(2000 + i);
+    }
+    RingSource topRing, bottomRing;
+    acquire_all(top, topRing, 0, 20000);        // 0, 20, 40, 60, 80, 100 ms
+    acquire_all(bottom, bottomRing, 5000, 33000); // 5, 38, 71, 104, 137, 170 ms
+
+    RingSource *sources[2] = {&topRing, &bottomRing};
+    std::vector<Merged> merged = drain(sources, true, true, 100);
+    CHECK_EQ(merged.size(), 12);
+    const int expectSensor[12] = {0, 1, 0, 1, 0, 0, 1, 0, 0, 1, 1, 1};
+    for (size_t i = 0; i < merged.size(); i++)
+    {
+        CHECK_EQ(merged[i].sensor, expectSensor[i]);
+        if (i > 0)
+        {
+            CHECK(merged[i].sample.timeUs >= merged[i - 1].sample.timeUs);
+        }
+    }
+    CHECK_EQ(merged[0].sample.distance, 1000);
+    CHECK_EQ(merged[11].sample.distance, 2005);
+}
+
+static void test_merge_ties_and_limit()
+{
+    FakeRangeSensor top, bottom;
+    top.startContinuous(20);
+    bottom.startContinuous(20);
+    for (int i = 0; i < 4; i++)
+    {
+        top.queue(1000 + i);
+        bottom.queue(2000 + i);
+    }
+    RingSource topRing, bottomRing;
+    acquire_all(top, topRing, 0, 20000);
+    acquire_all(bottom, bottomRing, 0, 20000); // same timestamps
+
+    RingSource *sources[2] = {&topRing, &bottomRing};
+    std::vector<Merged> first = drain(sources, true, true, 3);
+    CHECK_EQ(first.size(), 3);
+    CHECK(first[0].sensor == 0 && first[1].sensor == 1 && first[2].sensor == 0); // top first on a tie
+    CHECK_EQ(topRing.ring.size(), 2);
+    CHECK_EQ(bottomRing.ring.size(), 3); // what was not taken stays queued
+
+    std::vector<Merged> rest = drain(sources, true, true, 100);
+    CHECK_EQ(rest.size(), 5);
+    CHECK_EQ(rest[0].sensor, 1); // bottom's 20 ms sample was peeked, not lost
+    CHECK_EQ(rest[0].sample.distance, 2001);
+
+    CHECK_EQ(drain(sources, true, true, 0).size(), 0);
+}
+
+static void test_merge_one_sensor()
+{
+    FakeRangeSensor top, bottom;
+    top.startContinuous(20);
+    bottom.startContinuous(20);
+    top.queue(1000);
+    bottom.queue(2000);
+    bottom.queue(2001);
+    RingSource topRing, bottomRing;
+    acquire_all(top, topRing, 0, 20000);
+    acquire_all(bottom, bottomRing, 0, 20000);
+
+    RingSource *sources[2] = {&topRing, &bottomRing};
+    std::vector<Merged> merged = drain(sources, false, true, 100);
+    CHECK_EQ(merged.size(), 2);
+    CHECK(merged[0].sensor == 1 && merged[1].sensor == 1);
+    CHECK_EQ(topRing.ring.size(), 1); // untouched
+}
+
+int main()
+{
+    RUN_TEST(test_overflow_drops_newest);
+    RUN_TEST(test_pop_partial_and_clear);
+    RUN_TEST(test_concurrent_producer_consumer);
+    RUN_TEST(test_merge_by_time);
+    RUN_TEST(test_merge_ties_and_limit);
+    RUN_TEST(test_merge_one_sensor);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,180 @@
+// Queue line ring behind queue.read: lines assembled from BLE-sized writes,
+// lines longer than the ring while the peer honours the pause, and the
+// truncation left for a peer that does not.
+#include "hosttest.h"
+#include "linering.h"
+#include <memory>
+#include <thread>
+
+#define WRITE_SIZE 180 // one BLE write's worth of line data
+
+static std::string line_text(int seed, size_t length)
+{
+    std::string text(length, 0);
+    for (size_t i = 0; i < length; i++)
+    {
+        text[i] = (char)('a' + (seed + i) % 26);
+    }
+    return text;
+}
+
+static void write_str(LineRing &ring, const std::string &data)
+{
+    ring.write((const uint8_t *)data.data(), data.size());
+}
+
+static void test_lines_split_across_writes()
+{
+    std::unique_ptr<LineRing> ring(new LineRing);
+    write_str(*ring, "abc");
+    write_str(*ring, "de\nfg");
+    CHECK_EQ(ring->count(), 1);
+    write_str(*ring, "h\n\n");
+    CHECK_EQ(ring->count(), 3);
+
+    std::string line;
+    CHECK(ring->take(line) && line == "abcde");
+    CHECK(ring->take(line) && line == "fgh");
+    CHECK(ring->take(line) && line.empty());
+    CHECK(!ring->take(line));
+    CHECK_EQ(ring->count(), 0);
+    CHECK_EQ(ring->stats.lines, 3);
+}
+
+// The reader pulls chunks of the unfinished line, which lifts the pause;
+// nothing is truncated however long the line
+static void test_line_longer_than_ring()
+{
+    std::unique_ptr<LineRing> ring(new LineRing);
+    std::string data = line_text(0, 5 * LQUEUE_RING_SIZE + 77);
+    std::string line;
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        if (ring->pauseWanted())
+        {
+            CHECK(!ring->take(line));
+            CHECK(!ring->pauseWanted());
+            continue;
+        }
+        size_t n = std::min((size_t)WRITE_SIZE, data.size() - offset);
+        write_str(*ring, data.substr(offset, n));
+        offset += n;
+    }
+    CHECK_EQ(ring->count(), 0);
+    write_str(*ring, "\n");
+    CHECK_EQ(ring->count(), 1);
+    CHECK(ring->take(line));
+    CHECK_EQ(line.size(), data.size());
+    CHECK(line == data);
+    CHECK_EQ(ring->stats.truncatedLines, 0);
+    CHECK(ring->stats.pauses >= 5);
+}
+
+static void test_peer_ignoring_pause_truncates()
+{
+    std::unique_ptr<LineRing> ring(new LineRing);
+    std::string data = line_text(3, LQUEUE_RING_SIZE + 1000);
+    write_str(*ring, data + "\n");
+    CHECK_EQ(ring->stats.truncatedLines, 1);
+    CHECK(ring->stats.droppedBytes > 1000);
+
+    std::string line;
+    CHECK(ring->take(line));
+    CHECK(line.size() < LQUEUE_RING_SIZE);
+    CHECK(line == data.substr(0, line.size()));
+    write_str(*ring, "next\n"); // the rest of the line was skipped, not the next one
+    CHECK(ring->take(line) && line == "next");
+}
+
+static void test_pause_transitions()
+{
+    std::unique_ptr<LineRing> ring(new LineRing);
+    int changes = 0;
+    ring->onPauseChange = [&] { changes++; };
+
+    std::string data = line_text(0, 100);
+    while (!ring->pauseWanted())
+    {
+        write_str(*ring, data + "\n");
+    }
+    CHECK_EQ(changes, 1);
+    write_str(*ring, data + "\n"); // still above the high mark
+    CHECK_EQ(changes, 1);
+
+    std::string line;
+    while (ring->take(line))
+    {
+    }
+    CHECK_EQ(changes, 2);
+    CHECK(!ring->pauseWanted());
+    CHECK_EQ(ring->stats.pauses, 1);
+}
+
+static void test_clear_keeps_partial_line()
+{
+    std::unique_ptr<LineRing> ring(new LineRing);
+    write_str(*ring, "one\ntwo\nthr");
+    ring->pull();
+    ring->clear();
+    CHECK_EQ(ring->count(), 0);
+    write_str(*ring, "ee\n");
+    std::string line;
+    CHECK(ring->take(line) && line == "three");
+}
+
+// Writer and reader on their own threads, the writer holding off while the
+// pause is wanted as a well-behaved peer does
+static void test_concurrent_long_lines()
+{
+    std::unique_ptr<LineRing> ring(new LineRing);
+    const int lines = 60;
+    std::thread writer([&] {
+        for (int i = 0; i < lines; i++)
+        {
+            std::string data = line_text(i, (size_t)i * 397 % (3 * LQUEUE_RING_SIZE)) + "\n";
+            for (size_t offset = 0; offset < data.size();)
+            {
+                if (ring->pauseWanted())
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                size_t n = std::min((size_t)WRITE_SIZE, data.size() - offset);
+                write_str(*ring, data.substr(offset, n));
+                offset += n;
+            }
+        }
+    });
+
+    int received = 0, mismatched = 0;
+    std::string line;
+    while (received < lines)
+    {
+        if (!ring->take(line))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (line != line_text(received, (size_t)received * 397 % (3 * LQUEUE_RING_SIZE)))
+        {
+            mismatched++;
+        }
+        received++;
+    }
+    writer.join();
+    CHECK_EQ(mismatched, 0);
+    CHECK_EQ(ring->stats.truncatedLines, 0);
+    CHECK_EQ(ring->count(), 0);
+}
+
+int main()
+{
+    RUN_TEST(test_lines_split_across_writes);
+    RUN_TEST(test_line_longer_than_ring);
+    RUN_TEST(test_peer_ignoring_pause_truncates);
+    RUN_TEST(test_pause_transitions);
+    RUN_TEST(test_clear_keeps_partial_line);
+    RUN_TEST(test_concurrent_long_lines);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,85 @@
+// Profiler report entries: ranking by samples, JSON escaping of chunk names
+// taken from script text, and entries dropped whole when the buffer is short.
+#include "hosttest.h"
+#include "profilereport.h"
+#include <string>
+
+static LuaProfileEntry entry(const char *source, int line, const char *function, uint32_t samples)
+{
+    LuaProfileEntry e = {};
+    strncpy(e.source, source, sizeof(e.source) - 1);
+    strncpy(e.function, function, sizeof(e.function) - 1);
+    e.line = line;
+    e.funcLine = 1;
+    e.samples = samples;
+    e.allocBytes = -16;
+    return e;
+}
+
+static std::string format(const LuaProfileEntry *entries, int count, size_t outSize)
+{
+    char out[512];
+    size_t pos = profile_format_entries(out, 0, outSize, 0, entries, count);
+    return std::string(out, pos);
+}
+
+static void test_rank_by_samples()
+{
+    LuaProfileEntry entries[4] = {entry("a", 1, "", 5), entry("b", 2, "", 40),
+                                  entry("c", 3, "", 7), entry("d", 4, "", 90)};
+    CHECK_EQ(profile_rank(entries, 4, 2), 2);
+    CHECK_EQ(entries[0].samples, 90);
+    CHECK_EQ(entries[1].samples, 40);
+    CHECK_EQ(profile_rank(entries, 4, 10), 4);
+    CHECK_EQ(entries[3].samples, 5);
+    CHECK_EQ(profile_rank(entries, 0, 10), 0);
+}
+
+// luaL_dostring names a chunk after the script's first line
+static void test_escapes_chunk_names()
+{
+    LuaProfileEntry entries[2] = {entry("[string \"print(\"a\\\\b\")\"]", 1, "on\"tick", 3),
+                                  entry("tab\there\nnl", 2, "", 1)};
+    CHECK(format(entries, 2, 512) ==
+          "[\"[string \\\"print(\\\"a\\\\\\\\b\\\")\\\"]\",1,\"on\\\"tick\",1,3,-16],"
+          "[\"tab\\u0009here\\u000anl\",2,\"\",1,1,-16]");
+}
+
+// A UTF-8 sequence cut short by the copy into the entry must not reach the JSON
+static void test_replaces_non_ascii()
+{
+    LuaProfileEntry e = entry("\xc3\xa9t\xc3", 1, "f", 1);
+    CHECK(format(&e, 1, 512) == "[\"??t?\",1,\"f\",1,1,-16]");
+}
+
+static void test_drops_entries_that_do_not_fit()
+{
+    LuaProfileEntry entries[3] = {entry("main", 10, "loop", 9), entry("q\"q", 20, "", 4),
+                                  entry("x", 30, "", 1)};
+    std::string all = format(entries, 3, 512);
+    std::string first = "[\"main\",10,\"loop\",1,9,-16]";
+    CHECK(all.compare(0, first.size(), first) == 0);
+
+    // One byte short of the second entry, escapes included
+    size_t second = all.find(",[\"x\"");
+    CHECK(second != std::string::npos);
+    CHECK(format(entries, 3, second - 1) == first);
+    CHECK(format(entries, 3, second) == all.substr(0, second));
+    CHECK(format(entries, 3, first.size() - 1).empty());
+
+    // The reserve keeps room for what the caller closes the report with
+    char out[64];
+    memcpy(out, "{", 1);
+    CHECK_EQ(profile_format_entries(out, 1, first.size() + 4, 3, entries, 3), first.size() + 1);
+    CHECK_EQ(profile_format_entries(out, 1, first.size() + 3, 3, entries, 3), 1);
+    CHECK_EQ(profile_format_entries(out, 62, sizeof(out), 3, entries, 3), 62);
+}
+
+int main()
+{
+    RUN_TEST(test_rank_by_samples);
+    RUN_TEST(test_escapes_chunk_names);
+    RUN_TEST(test_replaces_non_ascii);
+    RUN_TEST(test_drops_entries_that_do_not_fit);
+    return HOST_TEST_RESULT();
+}
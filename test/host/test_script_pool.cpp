@@ -0,0 +1,139 @@
+// Script slot pool: producers on several threads acquire, fill and hand
+// slots to one consumer (the Lua task's role), which checks and releases them.
+#include "hosttest.h"
+#include "scriptpool.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static void test_acquire_all_then_timeout()
+{
+    ScriptPool pool;
+    CHECK(pool.init());
+    CHECK_EQ(pool.freeCount(), LUA_WRAPPER_SCRIPT_SLOTS);
+
+    ScriptHandle handles[LUA_WRAPPER_SCRIPT_SLOTS];
+    for (int i = 0; i < LUA_WRAPPER_SCRIPT_SLOTS; i++)
+    {
+        char *buffer = nullptr;
+        size_t capacity = 0;
+        handles[i] = pool.acquire(&buffer, &capacity, 0);
+        CHECK(pool.isValid(handles[i]));
+        CHECK(buffer == pool.data(handles[i]));
+        CHECK_EQ(capacity, LUA_WRAPPER_SCRIPT_SLOT_SIZE);
+    }
+    char *buffer;
+    size_t capacity;
+    CHECK_EQ(pool.acquire(&buffer, &capacity, 10), SCRIPT_HANDLE_INVALID);
+    CHECK_EQ(pool.freeCount(), 0);
+    CHECK_EQ(pool.minFree(), 0);
+
+    for (int i = 0; i < LUA_WRAPPER_SCRIPT_SLOTS; i++)
+    {
+        CHECK(pool.release(handles[i]));
+    }
+    CHECK_EQ(pool.freeCount(), LUA_WRAPPER_SCRIPT_SLOTS);
+    pool.destroy();
+}
+
+static void test_double_and_invalid_release()
+{
+    ScriptPool pool;
+    CHECK(pool.init());
+    char *buffer;
+    size_t capacity;
+    ScriptHandle handle = pool.acquire(&buffer, &capacity, 0);
+    CHECK(pool.release(handle));
+    CHECK(!pool.release(handle)); // must not land on the free list twice
+    CHECK(!pool.release(SCRIPT_HANDLE_INVALID));
+    CHECK(!pool.release(LUA_WRAPPER_SCRIPT_SLOTS));
+    CHECK_EQ(pool.freeCount(), LUA_WRAPPER_SCRIPT_SLOTS);
+    pool.destroy();
+}
+
+static void test_stress_producers_consumer()
+{
+    const int producers = 6;
+    const int perProducer = 2000;
+    ScriptPool pool;
+    CHECK(pool.init());
+
+    QueueHandle_t commands = xQueueCreate(LUA_WRAPPER_SCRIPT_SLOTS, sizeof(ScriptHandle));
+    std::atomic<int> owners[LUA_WRAPPER_SCRIPT_SLOTS];
+    for (auto &owner : owners)
+    {
+        owner = 0;
+    }
+    std::atomic<int> doubleOwned{0}, corrupted{0}, rejected{0}, consumed{0};
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&, p] {
+            for (int n = 0; n < perProducer; n++)
+            {
+                char *buffer;
+                size_t capacity;
+                ScriptHandle handle = pool.acquire(&buffer, &capacity, 1000);
+                if (handle == SCRIPT_HANDLE_INVALID)
+                {
+                    rejected++;
+                    continue;
+                }
+                if (owners[handle].fetch_add(1) != 0)
+                {
+                    doubleOwned++;
+                }
+                snprintf(buffer, capacity, "print(%d, %d)", p, n);
+                if (xQueueSend(commands, &handle, 1000) != pdTRUE)
+                {
+                    owners[handle]--;
+                    pool.release(handle);
+                    rejected++;
+                }
+            }
+        });
+    }
+
+    std::thread consumer([&] {
+        while (consumed + rejected < producers * perProducer)
+        {
+            ScriptHandle handle;
+            if (xQueueReceive(commands, &handle, 10) != pdTRUE)
+            {
+                continue;
+            }
+            int p, n;
+            if (sscanf(pool.data(handle), "print(%d, %d)", &p, &n) != 2 || p < 0 || p >= producers)
+            {
+                corrupted++;
+            }
+            owners[handle]--;
+            pool.release(handle);
+            consumed++;
+        }
+    });
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    consumer.join();
+
+    CHECK_EQ(doubleOwned.load(), 0);
+    CHECK_EQ(corrupted.load(), 0);
+    CHECK_EQ(rejected.load(), 0);
+    CHECK_EQ(consumed.load(), producers * perProducer);
+    CHECK_EQ(pool.freeCount(), LUA_WRAPPER_SCRIPT_SLOTS); // nothing leaked
+    CHECK(pool.minFree() < LUA_WRAPPER_SCRIPT_SLOTS);
+    vQueueDelete(commands);
+    pool.destroy();
+}
+
+int main()
+{
+    RUN_TEST(test_acquire_all_then_timeout);
+    RUN_TEST(test_double_and_invalid_release);
+    RUN_TEST(test_stress_producers_consumer);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,53 @@
+-- requiree loader benchmark
+-- Generates 4 KB, 32 KB and 128 KB modules, loads each from source (cache off)
+-- and reports load time, transient system heap and retained Lua heap.
+
+print("=== requiree Loader Benchmark ===")
+
+local sizes = { 4, 32, 128 }
+
+local function write_module(name, kb)
+    local f = io.open("/" .. name .. ".lua", "w")
+    if not f then
+        return false
+    end
+    local target = kb * 1024
+    local written = 0
+    local i = 0
+    f:write("local M = {}\n")
+    while written < target do
+        local line = string.format("function M.f%d(a, b) return a * %d + b end\n", i, i)
+        f:write(line)
+        written = written + #line
+        i = i + 1
+    end
+    f:write("return M\n")
+    f:close()
+    return true
+end
+
+require_cache.enable(false)
+require_cache.verbosity(0)
+
+for _, kb in ipairs(sizes) do
+    local name = "bench_" .. kb .. "k"
+    if not write_module(name, kb) then
+        print(string.format("   ✗ Could not write %s.lua", name))
+    else
+        local ok, err = pcall(requiree, name)
+        local r = require_cache.last_load()
+        if ok then
+            print(string.format("   ✓ %4d KB: %6d bytes in %7d us, sys heap peak %6d, vm heap %7d",
+                kb, r.bytes, r.us, r.sys_heap_peak, r.vm_heap))
+        else
+            print(string.format("   ✗ %4d KB: %s", kb, tostring(err)))
+        end
+        os.remove("/" .. name .. ".lua")
+    end
+    collectgarbage()
+end
+
+require_cache.verbosity(1)
+require_cache.enable(true)
+
+print("=== Benchmark Complete ===")